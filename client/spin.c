@@ -2,7 +2,12 @@
 #include <cstdlib>
 #include <cstring>
 #include <chrono>
+#include <mutex>
+#include <string>
 #include <thread>
+#include <unistd.h>
+
+#include "../common/include/cgi_protocol.h"
 
 double get_seconds() {
     auto now = std::chrono::system_clock::now();
@@ -10,10 +15,9 @@ double get_seconds() {
     return std::chrono::duration<double>(duration).count();
 }
 
-int main() {
-    // Get spin duration from QUERY_STRING
+// Spin for QUERY_STRING seconds and return the whole CGI output
+std::string spin(const char* query) {
     double spin_for = 0.0;
-    const char* query = std::getenv("QUERY_STRING");
     if (query) {
         spin_for = std::atof(query); // safer than atoi for floating point
     }
@@ -31,10 +35,63 @@ int main() {
     content += "<p>My only purpose is to waste time on the server!</p>\r\n";
     content += "<p>I spun for " + std::to_string(t2 - t1) + " seconds</p>\r\n";
 
+    std::string output;
+    output += "Content-Length: " + std::to_string(content.size()) + "\r\n";
+    output += "Content-Type: text/html\r\n\r\n";
+    output += content;
+    return output;
+}
+
+// ---- Worker mode: serve requests over the socket on fd 0 (see cgi_protocol.h) ----
+// Each request runs on its own thread, so a long spin does not hold up the others.
+static std::mutex g_write_mutex;
+
+static void write_all(const std::string& data) {
+    std::lock_guard<std::mutex> lock(g_write_mutex);
+    size_t written = 0;
+    while (written < data.size()) {
+        ssize_t rc = write(STDIN_FILENO, data.data() + written, data.size() - written);
+        if (rc <= 0)
+            std::exit(0); // The server is gone
+        written += static_cast<size_t>(rc);
+    }
+}
+
+static void answer(uint16_t request_id, std::string query) {
+    std::string output = spin(query.c_str());
+
+    std::string frames;
+    append_cgi_frame(frames, CgiFrameType::STDOUT, request_id, output.data(), output.size());
+    append_cgi_frame(frames, CgiFrameType::END, request_id, "", 0);
+    write_all(frames);
+}
+
+static int serve_as_worker() {
+    CgiFrameReader reader;
+    CgiFrame frame;
+    char buffer[16384];
+
+    while (true) {
+        ssize_t rc = read(STDIN_FILENO, buffer, sizeof(buffer));
+        if (rc <= 0)
+            return 0; // The server closed the socket
+
+        reader.append(buffer, static_cast<size_t>(rc));
+        while (reader.next(frame)) {
+            if (frame.type == CgiFrameType::BEGIN)
+                std::thread(answer, frame.request_id, frame.payload).detach();
+        }
+        if (reader.failed())
+            return 1;
+    }
+}
+
+int main() {
+    if (std::getenv(CGI_WORKER_ENV))
+        return serve_as_worker();
+
     // Output HTTP response
-    std::cout << "Content-Length: " << content.size() << "\r\n";
-    std::cout << "Content-Type: text/html\r\n\r\n";
-    std::cout << content;
+    std::cout << spin(std::getenv("QUERY_STRING"));
     std::cout.flush();
 
     return 0;
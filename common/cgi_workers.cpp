@@ -0,0 +1,110 @@
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <spawn.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#include "include/cgi_workers.h"
+#include "include/cgi_protocol.h"
+
+extern char** environ;
+
+CgiWorkerConfig g_cgi_workers;
+
+bool CgiWorkerConfig::serves(std::string_view path) const {
+  for (const std::string& worker_path : paths) {
+    if (worker_path == path) {
+      return true;
+    }
+  }
+  return false;
+}
+
+CgiWorkerProcess::CgiWorkerProcess()
+  : child(-1),
+    socket_fd(-1),
+    started_ms(0),
+    restart_at_ms(0),
+    backoff_ms(CGI_WORKER_FIRST_BACKOFF_MS),
+    restart_count(0) {}
+
+CgiWorkerProcess::~CgiWorkerProcess() {
+  stop(0);
+}
+
+bool CgiWorkerProcess::start(const std::string& program, bool nonblocking, uint64_t now_ms) {
+  if (running()) {
+    return true;
+  }
+
+  int fds[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) != 0) {
+    schedule_restart(now_ms, true);
+    return false;
+  }
+
+  std::string protocol_variable = std::string(CGI_WORKER_ENV) + "=" +
+                                  std::to_string(CGI_PROTOCOL_VERSION);
+  std::vector<char*> envp;
+  for (char** variable = environ; *variable != nullptr; ++variable) {
+    envp.push_back(*variable);
+  }
+  envp.push_back(const_cast<char*>(protocol_variable.c_str()));
+  envp.push_back(nullptr);
+
+  char* argv[] = { const_cast<char*>(program.c_str()), nullptr };
+
+  posix_spawn_file_actions_t actions;
+  posix_spawn_file_actions_init(&actions);
+  posix_spawn_file_actions_adddup2(&actions, fds[1], STDIN_FILENO);
+  posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+
+  pid_t pid;
+  int rc = posix_spawn(&pid, program.c_str(), &actions, nullptr, argv, envp.data());
+  posix_spawn_file_actions_destroy(&actions);
+  close(fds[1]);
+
+  if (rc != 0) {
+    close(fds[0]);
+    schedule_restart(now_ms, true);
+    return false;
+  }
+
+  if (nonblocking) {
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+  }
+  child = pid;
+  socket_fd = fds[0];
+  started_ms = now_ms;
+  return true;
+}
+
+void CgiWorkerProcess::stop(uint64_t now_ms) {
+  if (socket_fd >= 0) {
+    close(socket_fd);
+    socket_fd = -1;
+  }
+  if (child > 0) {
+    // The worker already closed its end or broke the protocol
+    kill(child, SIGKILL);
+    while (waitpid(child, nullptr, 0) < 0 && errno == EINTR) {
+    }
+    child = -1;
+    schedule_restart(now_ms, now_ms - started_ms < CGI_WORKER_MIN_UPTIME_MS);
+  }
+}
+
+void CgiWorkerProcess::schedule_restart(uint64_t now_ms, bool failed_start) {
+  restart_count++;
+  if (!failed_start) {
+    backoff_ms = CGI_WORKER_FIRST_BACKOFF_MS;
+    restart_at_ms = now_ms;
+    return;
+  }
+
+  restart_at_ms = now_ms + backoff_ms;
+  backoff_ms = backoff_ms * 2 < CGI_WORKER_MAX_BACKOFF_MS ? backoff_ms * 2 : CGI_WORKER_MAX_BACKOFF_MS;
+}
@@ -0,0 +1,380 @@
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+
+#include "include/file_cache.h"
+#include "include/mime_types.h"
+#include "include/logger.h"
+
+FileCache g_file_cache;
+
+// Changes that make a cached entry for a file in a watched directory stale
+static const uint32_t WATCH_MASK = IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE |
+                                   IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |
+                                   IN_DELETE_SELF | IN_MOVE_SELF;
+
+/*
+ * Whether canonical_path() would rewrite a path: it has an empty or "."
+ * segment past the leading "./", or a ".." with a segment to fold into.
+ * Canonical paths pass unchanged, so a hit costs no allocation.
+ */
+static bool needs_canonical(const std::string& path) {
+  if (path == "." || path == "/") {
+    return false;
+  }
+  bool absolute = !path.empty() && path[0] == '/';
+  bool named = absolute;  // A ".." here would be folded or dropped
+
+  size_t start = absolute ? 1 : (path.compare(0, 2, "./") == 0 ? 2 : 0);
+  while (start <= path.size()) {
+    size_t end = path.find('/', start);
+    if (end == std::string::npos) {
+      end = path.size();
+    }
+    size_t length = end - start;
+    bool dot = length == 1 && path[start] == '.';
+    bool dot_dot = length == 2 && path[start] == '.' && path[start + 1] == '.';
+    if (length == 0 || dot || (dot_dot && named)) {
+      return true;
+    }
+    named = named || !dot_dot;
+    start = end + 1;
+  }
+  return false;
+}
+
+/*
+ * Lexically normalize a path: drop empty and "." segments and fold ".."
+ * into the segment before it. Clients can spell one file many ways
+ * ("./sub/./x", ".//sub/x", "./sub/../sub/x"); they must share one cache
+ * entry and one directory watch, or each spelling would be kept forever.
+ */
+static std::string canonical_path(const std::string& path) {
+  bool absolute = !path.empty() && path[0] == '/';
+  std::vector<std::string> segments;
+
+  size_t start = 0;
+  while (start <= path.size()) {
+    size_t end = path.find('/', start);
+    if (end == std::string::npos) {
+      end = path.size();
+    }
+    std::string segment = path.substr(start, end - start);
+    if (segment == "..") {
+      if (!segments.empty() && segments.back() != "..") {
+        segments.pop_back();
+      } else if (!absolute) {
+        segments.push_back(segment);
+      }
+    } else if (!segment.empty() && segment != ".") {
+      segments.push_back(segment);
+    }
+    start = end + 1;
+  }
+
+  std::string canonical = absolute ? "" : ".";
+  for (const std::string& segment : segments) {
+    canonical += '/';
+    canonical += segment;
+  }
+  return canonical.empty() ? "/" : canonical;
+}
+
+CachedFile::CachedFile()
+  : fd(-1), size(0), mode(0), mime_type(nullptr) {
+  mtime.tv_sec  = 0;
+  mtime.tv_nsec = 0;
+}
+
+CachedFile::~CachedFile() {
+  if (fd >= 0) {
+    close(fd);
+  }
+}
+
+FileCache::FileCache(size_t max_entries)
+  : shard_capacity(max_entries / FILE_CACHE_SHARDS),
+    inotify_fd(-1),
+    stop_fd(-1),
+    hit_count(0),
+    miss_count(0),
+    invalidation_count(0),
+    eviction_count(0) {
+  if (shard_capacity == 0) {
+    shard_capacity = 1;
+  }
+}
+
+FileCache::~FileCache() {
+  if (watcher.joinable()) {
+    uint64_t one = 1;
+    ssize_t rc = write(stop_fd, &one, sizeof(one));
+    (void)rc;
+    watcher.join();
+  }
+  if (stop_fd >= 0) {
+    close(stop_fd);
+  }
+  if (inotify_fd >= 0) {
+    close(inotify_fd);
+  }
+}
+
+bool FileCache::start() {
+  inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (inotify_fd < 0) {
+    LOG_ERROR("[Error] inotify unavailable, file cache disabled");
+    return false;
+  }
+
+  stop_fd = eventfd(0, EFD_CLOEXEC);
+  if (stop_fd < 0) {
+    close(inotify_fd);
+    inotify_fd = -1;
+    LOG_ERROR("[Error] eventfd failed, file cache disabled");
+    return false;
+  }
+
+  watcher = std::thread(&FileCache::watch_loop, this);
+  return true;
+}
+
+std::shared_ptr<const CachedFile> FileCache::lookup(const std::string& path) {
+  if (needs_canonical(path)) {
+    return lookup(canonical_path(path));
+  }
+
+  if (inotify_fd < 0) {
+    miss_count.fetch_add(1, std::memory_order_relaxed);
+    return load(path);
+  }
+
+  Shard& shard = shard_for(path);
+  uint64_t generation;
+  {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.entries.find(path);
+    if (it != shard.entries.end()) {
+      shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+      hit_count.fetch_add(1, std::memory_order_relaxed);
+      return *it->second;
+    }
+    generation = shard.generation;
+  }
+  miss_count.fetch_add(1, std::memory_order_relaxed);
+
+  // Watch before stat(), so a change right after it is not missed
+  bool watched = watch_directory_of(path);
+
+  std::shared_ptr<const CachedFile> entry = load(path);
+  if (!entry || !watched) {
+    return entry;
+  }
+
+  std::lock_guard<std::mutex> lock(shard.mutex);
+
+  // An invalidation since the miss may have been for this file
+  if (shard.generation != generation || shard.entries.count(path) != 0) {
+    return entry;
+  }
+
+  shard.lru.push_front(entry);
+  shard.entries[path] = shard.lru.begin();
+
+  if (shard.entries.size() > shard_capacity) {
+    shard.entries.erase(shard.lru.back()->path);
+    shard.lru.pop_back();
+    eviction_count.fetch_add(1, std::memory_order_relaxed);
+  }
+  return entry;
+}
+
+std::shared_ptr<const CachedFile> FileCache::find(const std::string& path) {
+  if (inotify_fd < 0) {
+    return nullptr;
+  }
+  if (needs_canonical(path)) {
+    return find(canonical_path(path));
+  }
+
+  Shard& shard = shard_for(path);
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  auto it = shard.entries.find(path);
+  if (it == shard.entries.end()) {
+    return nullptr;  // lookup() counts the miss
+  }
+  shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+  hit_count.fetch_add(1, std::memory_order_relaxed);
+  return *it->second;
+}
+
+uint64_t FileCache::hits() const {
+  return hit_count.load(std::memory_order_relaxed);
+}
+
+uint64_t FileCache::misses() const {
+  return miss_count.load(std::memory_order_relaxed);
+}
+
+uint64_t FileCache::invalidations() const {
+  return invalidation_count.load(std::memory_order_relaxed);
+}
+
+uint64_t FileCache::evictions() const {
+  return eviction_count.load(std::memory_order_relaxed);
+}
+
+size_t FileCache::size() {
+  size_t total = 0;
+  for (Shard& shard : shards) {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    total += shard.entries.size();
+  }
+  return total;
+}
+
+FileCache::Shard& FileCache::shard_for(const std::string& path) {
+  return shards[std::hash<std::string>()(path) % FILE_CACHE_SHARDS];
+}
+
+/*
+ * stat() the path and, for a readable regular file, open it
+ */
+std::shared_ptr<const CachedFile> FileCache::load(const std::string& path) {
+  struct stat file_stat;
+  if (stat(path.c_str(), &file_stat) < 0) {
+    return nullptr;
+  }
+
+  std::shared_ptr<CachedFile> entry = std::make_shared<CachedFile>();
+  entry->path      = path;
+  entry->size      = file_stat.st_size;
+  entry->mode      = file_stat.st_mode;
+  entry->mtime     = file_stat.st_mtim;
+  entry->mime_type = mime_type_for(path);
+
+  if (S_ISREG(file_stat.st_mode)) {
+    entry->fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  }
+  return entry;
+}
+
+/*
+ * Make sure the directory holding `path` is watched. `path` is canonical,
+ * but a symlinked directory still shares its watch descriptor with the
+ * real one, so each spelling is recorded.
+ */
+bool FileCache::watch_directory_of(const std::string& path) {
+  size_t slash = path.find_last_of('/');
+  std::string dir;
+  if (slash == std::string::npos) {
+    dir = ".";
+  } else if (slash == 0) {
+    dir = "/";
+  } else {
+    dir = path.substr(0, slash);
+  }
+
+  std::lock_guard<std::mutex> lock(watch_mutex);
+  if (watched_dirs.count(dir) != 0) {
+    return true;
+  }
+
+  int wd = inotify_add_watch(inotify_fd, dir.c_str(), WATCH_MASK);
+  if (wd < 0) {
+    return false;
+  }
+  watched_dirs[dir] = wd;
+  watch_dirs[wd].push_back(dir);
+  return true;
+}
+
+void FileCache::invalidate(const std::string& path) {
+  Shard& shard = shard_for(path);
+  std::lock_guard<std::mutex> lock(shard.mutex);
+
+  shard.generation++;
+  auto it = shard.entries.find(path);
+  if (it != shard.entries.end()) {
+    shard.lru.erase(it->second);
+    shard.entries.erase(it);
+    invalidation_count.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+void FileCache::invalidate_all() {
+  for (Shard& shard : shards) {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.generation++;
+    invalidation_count.fetch_add(shard.entries.size(), std::memory_order_relaxed);
+    shard.entries.clear();
+    shard.lru.clear();
+  }
+}
+
+/*
+ * Watcher thread: turn inotify events into invalidations until the
+ * cache is destroyed
+ */
+void FileCache::watch_loop() {
+  alignas(struct inotify_event) char buffer[16384];
+
+  struct pollfd fds[2];
+  fds[0].fd     = inotify_fd;
+  fds[0].events = POLLIN;
+  fds[1].fd     = stop_fd;
+  fds[1].events = POLLIN;
+
+  while (true) {
+    if (poll(fds, 2, -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      LOG_ERROR("[Error] File cache watcher stopped");
+      invalidate_all();
+      return;
+    }
+    if (fds[1].revents & POLLIN) {
+      return;
+    }
+
+    ssize_t length = read(inotify_fd, buffer, sizeof(buffer));
+    if (length <= 0) {
+      continue;
+    }
+
+    for (char* ptr = buffer; ptr < buffer + length;) {
+      const struct inotify_event* event = reinterpret_cast<const struct inotify_event*>(ptr);
+      ptr += sizeof(struct inotify_event) + event->len;
+
+      // Lost events, or a directory renamed or removed: anything may be stale
+      if (event->mask & (IN_Q_OVERFLOW | IN_ISDIR | IN_DELETE_SELF | IN_MOVE_SELF)) {
+        invalidate_all();
+        continue;
+      }
+
+      std::lock_guard<std::mutex> lock(watch_mutex);
+      auto dirs = watch_dirs.find(event->wd);
+      if (dirs == watch_dirs.end()) {
+        continue;
+      }
+
+      if (event->mask & IN_IGNORED) {
+        for (const std::string& dir : dirs->second) {
+          watched_dirs.erase(dir);
+        }
+        watch_dirs.erase(dirs);
+        continue;
+      }
+
+      if (event->len > 0) {
+        for (const std::string& dir : dirs->second) {
+          invalidate(dir + "/" + event->name);
+        }
+      }
+    }
+  }
+}
@@ -0,0 +1,171 @@
+#include <charconv>
+#include <cstring>
+
+#include "include/http_header.h"
+
+/*
+ * Status lines after the "HTTP/1.x " prefix, with their reason phrases
+ */
+struct StatusEntry {
+  int code;
+  const char* line;    // "404 Not Found\r\n"
+  size_t line_length;
+  const char* reason;  // "Not Found"
+};
+
+#define STATUS_ENTRY(code, reason) \
+  { code, #code " " reason "\r\n", sizeof(#code " " reason "\r\n") - 1, reason }
+
+static const StatusEntry STATUS_TABLE[] = {
+  STATUS_ENTRY(200, "OK"),
+  STATUS_ENTRY(204, "No Content"),
+  STATUS_ENTRY(302, "Found"),
+  STATUS_ENTRY(304, "Not Modified"),
+  STATUS_ENTRY(400, "Bad Request"),
+  STATUS_ENTRY(403, "Forbidden"),
+  STATUS_ENTRY(404, "Not Found"),
+  STATUS_ENTRY(431, "Request Header Fields Too Large"),
+  STATUS_ENTRY(500, "Internal Server Error"),
+  STATUS_ENTRY(501, "Not Implemented"),
+  STATUS_ENTRY(502, "Bad Gateway"),
+  STATUS_ENTRY(503, "Service Unavailable"),
+};
+
+#undef STATUS_ENTRY
+
+static const StatusEntry* find_status(int status_code) {
+  for (const StatusEntry& entry : STATUS_TABLE) {
+    if (entry.code == status_code) {
+      return &entry;
+    }
+  }
+  return nullptr;
+}
+
+const char* http_date(time_t now) {
+  static const char* const DAYS[]   = { "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat" };
+  static const char* const MONTHS[] = { "Jan", "Feb", "Mar", "Apr", "May", "Jun",
+                                        "Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
+
+  thread_local time_t cached_second = -1;
+  thread_local char cached[HTTP_DATE_LENGTH + 1];
+
+  if (now != cached_second) {
+    struct tm utc;
+    gmtime_r(&now, &utc);
+
+    char* out = cached;
+    auto two_digits = [&out](int value) {
+      *out++ = static_cast<char>('0' + value / 10);
+      *out++ = static_cast<char>('0' + value % 10);
+    };
+
+    memcpy(out, DAYS[utc.tm_wday], 3);
+    out += 3;
+    *out++ = ',';
+    *out++ = ' ';
+    two_digits(utc.tm_mday);
+    *out++ = ' ';
+    memcpy(out, MONTHS[utc.tm_mon], 3);
+    out += 3;
+    *out++ = ' ';
+    two_digits((utc.tm_year + 1900) / 100);
+    two_digits((utc.tm_year + 1900) % 100);
+    *out++ = ' ';
+    two_digits(utc.tm_hour);
+    *out++ = ':';
+    two_digits(utc.tm_min);
+    *out++ = ':';
+    two_digits(utc.tm_sec);
+    memcpy(out, " GMT", 5);
+
+    cached_second = now;
+  }
+  return cached;
+}
+
+const char* status_reason(int status_code) {
+  const StatusEntry* entry = find_status(status_code);
+  return entry ? entry->reason : "Unknown";
+}
+
+void append_number(std::string& out, uint64_t value) {
+  char digits[20];
+  std::to_chars_result result = std::to_chars(digits, digits + sizeof(digits), value);
+  out.append(digits, static_cast<size_t>(result.ptr - digits));
+}
+
+HeaderBuilder::HeaderBuilder(const char* version, int status_code)
+  : HeaderBuilder(version, status_code, std::string_view()) {
+}
+
+HeaderBuilder::HeaderBuilder(const char* version, int status_code, std::string_view reason)
+  : length(0) {
+  append(version, strlen(version));
+  append(" ", 1);
+
+  const StatusEntry* entry = reason.empty() ? find_status(status_code) : nullptr;
+  if (entry) {
+    append(entry->line, entry->line_length);
+    return;
+  }
+
+  char digits[12];
+  std::to_chars_result result = std::to_chars(digits, digits + sizeof(digits), status_code);
+  append(digits, static_cast<size_t>(result.ptr - digits));
+  append(" ", 1);
+  if (reason.empty()) {
+    reason = "Unknown";
+  }
+  append(reason.data(), reason.size());
+  append("\r\n", 2);
+}
+
+HeaderBuilder& HeaderBuilder::add(const char* name, const char* value) {
+  append(name, strlen(name));
+  append(": ", 2);
+  append(value, strlen(value));
+  append("\r\n", 2);
+  return *this;
+}
+
+HeaderBuilder& HeaderBuilder::add(const char* name, uint64_t value) {
+  char digits[20];
+  std::to_chars_result result = std::to_chars(digits, digits + sizeof(digits), value);
+
+  append(name, strlen(name));
+  append(": ", 2);
+  append(digits, static_cast<size_t>(result.ptr - digits));
+  append("\r\n", 2);
+  return *this;
+}
+
+HeaderBuilder& HeaderBuilder::add_date() {
+  append("Date: ", 6);
+  append(http_date(time(nullptr)), HTTP_DATE_LENGTH);
+  append("\r\n", 2);
+  return *this;
+}
+
+HeaderBuilder& HeaderBuilder::add_raw(const char* lines) {
+  append(lines, strlen(lines));
+  return *this;
+}
+
+HeaderBuilder& HeaderBuilder::finish() {
+  append("\r\n", 2);
+  return *this;
+}
+
+void HeaderBuilder::append(const char* bytes, size_t count) {
+  if (spilled.empty() && length + count <= sizeof(buffer)) {
+    memcpy(buffer + length, bytes, count);
+    length += count;
+    return;
+  }
+  if (spilled.empty()) {
+    spilled.reserve(2 * (length + count));
+    spilled.assign(buffer, length);
+  }
+  spilled.append(bytes, count);
+}
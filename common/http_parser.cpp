@@ -0,0 +1,424 @@
+#include <charconv>
+#include <cstring>
+#include <strings.h>
+
+#include "include/http_parser.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HTTP_PARSER_X86 1
+#endif
+
+/* ----------------------------
+ * Delimiter scanning
+ * ---------------------------- */
+
+/*
+ * Offset of the first byte equal to a or b, or length if there is none
+ */
+typedef size_t (*ScanFunction)(const char* data, size_t length, char a, char b);
+
+static size_t scan_scalar(const char* data, size_t length, char a, char b) {
+  for (size_t i = 0; i < length; ++i) {
+    if (data[i] == a || data[i] == b) {
+      return i;
+    }
+  }
+  return length;
+}
+
+#ifdef HTTP_PARSER_X86
+__attribute__((target("sse2")))
+static size_t scan_sse2(const char* data, size_t length, char a, char b) {
+  const __m128i match_a = _mm_set1_epi8(a);
+  const __m128i match_b = _mm_set1_epi8(b);
+
+  size_t i = 0;
+  for (; i + 16 <= length; i += 16) {
+    __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+    __m128i hits  = _mm_or_si128(_mm_cmpeq_epi8(block, match_a), _mm_cmpeq_epi8(block, match_b));
+    int mask = _mm_movemask_epi8(hits);
+    if (mask != 0) {
+      return i + static_cast<size_t>(__builtin_ctz(static_cast<unsigned>(mask)));
+    }
+  }
+  return i + scan_scalar(data + i, length - i, a, b);
+}
+
+__attribute__((target("avx2")))
+static size_t scan_avx2(const char* data, size_t length, char a, char b) {
+  const __m256i match_a = _mm256_set1_epi8(a);
+  const __m256i match_b = _mm256_set1_epi8(b);
+
+  size_t i = 0;
+  for (; i + 32 <= length; i += 32) {
+    __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+    __m256i hits  = _mm256_or_si256(_mm256_cmpeq_epi8(block, match_a),
+                                    _mm256_cmpeq_epi8(block, match_b));
+    unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(hits));
+    if (mask != 0) {
+      return i + static_cast<size_t>(__builtin_ctz(mask));
+    }
+  }
+  return i + scan_sse2(data + i, length - i, a, b);
+}
+#endif
+
+static ScanFunction pick_scan_function() {
+#ifdef HTTP_PARSER_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return scan_avx2;
+  }
+  if (__builtin_cpu_supports("sse2")) {
+    return scan_sse2;
+  }
+#endif
+  return scan_scalar;
+}
+
+static const ScanFunction scan_for = pick_scan_function();
+
+/* ----------------------------
+ * Helpers
+ * ---------------------------- */
+
+static bool equals_ignore_case(std::string_view a, std::string_view b) {
+  return a.size() == b.size() && strncasecmp(a.data(), b.data(), a.size()) == 0;
+}
+
+static std::string_view trim(std::string_view value) {
+  while (!value.empty() && (value.front() == ' ' || value.front() == '\t')) {
+    value.remove_prefix(1);
+  }
+  while (!value.empty() && (value.back() == ' ' || value.back() == '\t')) {
+    value.remove_suffix(1);
+  }
+  return value;
+}
+
+/*
+ * Call fn on every comma-separated, trimmed token of a header value
+ */
+template <typename Fn>
+static void for_each_token(std::string_view value, Fn fn) {
+  while (!value.empty()) {
+    size_t comma = value.find(',');
+    fn(trim(value.substr(0, comma)));
+    if (comma == std::string_view::npos) {
+      break;
+    }
+    value.remove_prefix(comma + 1);
+  }
+}
+
+/*
+ * Length of the line ending at data[length]: 2 for CRLF, 1 for a bare LF
+ * (RFC 9112, 2.2), 0 for a bare CR, which is rejected
+ */
+static size_t line_ending(const char* data, size_t length) {
+  if (data[length] == '\n') {
+    return 1;
+  }
+  return data[length + 1] == '\n' ? 2 : 0;
+}
+
+static ParseStatus fail(HttpRequest& request, int status) {
+  request.error_status = status;
+  return ParseStatus::ERROR;
+}
+
+/*
+ * Record what a header means for framing and persistence
+ */
+static ParseStatus apply_header(HttpRequest& request, const HttpHeader& header) {
+  if (equals_ignore_case(header.name, "content-length")) {
+    uint64_t length = 0;
+    const char* end = header.value.data() + header.value.size();
+    std::from_chars_result result = std::from_chars(header.value.data(), end, length);
+    if (header.value.empty() || result.ec != std::errc() || result.ptr != end) {
+      return fail(request, 400);
+    }
+    if (request.has_content_length && request.content_length != length) {
+      return fail(request, 400);
+    }
+    request.has_content_length = true;
+    request.content_length = length;
+  } else if (equals_ignore_case(header.name, "transfer-encoding")) {
+    // Only a body whose final coding is chunked has a knowable length
+    std::string_view last;
+    for_each_token(header.value, [&last](std::string_view token) { last = token; });
+    if (!equals_ignore_case(last, "chunked")) {
+      return fail(request, 400);
+    }
+    request.chunked = true;
+  } else if (equals_ignore_case(header.name, "connection")) {
+    for_each_token(header.value, [&request](std::string_view token) {
+      if (equals_ignore_case(token, "close")) {
+        request.connection_close = true;
+      } else if (equals_ignore_case(token, "keep-alive")) {
+        request.connection_keep_alive = true;
+      }
+    });
+  }
+  return ParseStatus::COMPLETE;
+}
+
+/* ----------------------------
+ * HttpRequest
+ * ---------------------------- */
+
+std::string_view HttpRequest::header(std::string_view name) const {
+  for (size_t i = 0; i < header_count; ++i) {
+    if (equals_ignore_case(headers[i].name, name)) {
+      return headers[i].value;
+    }
+  }
+  return std::string_view();
+}
+
+/* ----------------------------
+ * HttpParser
+ * ---------------------------- */
+
+ParseStatus HttpParser::parse(const char* data, size_t length, HttpRequest& request) {
+  // Empty lines before a request line are ignored
+  size_t start = 0;
+  while (start < length && (data[start] == '\r' || data[start] == '\n')) {
+    start++;
+  }
+
+  // Find the blank line that ends the header block, resuming after the
+  // bytes searched by earlier calls. Lines may end in CRLF or a bare LF,
+  // so the block ends at "\n\r\n" or "\n\n"; data[start] is never '\n'.
+  size_t position = scanned > start ? scanned : start;
+  size_t header_end = 0;
+  size_t block_end = 0;  // Start of the blank line
+  while (true) {
+    position += scan_for(data + position, length - position, '\n', '\n');
+    if (position >= length) {
+      // A terminator completed later is found by looking back from its '\n'
+      scanned = length;
+      return ParseStatus::INCOMPLETE;
+    }
+    if (data[position - 1] == '\n') {
+      header_end = position + 1;
+      block_end = position;
+      break;
+    }
+    if (position >= start + 2 && data[position - 1] == '\r' && data[position - 2] == '\n') {
+      header_end = position + 1;
+      block_end = position - 1;
+      break;
+    }
+    position++;
+  }
+
+  request.header_count          = 0;
+  request.has_content_length    = false;
+  request.content_length        = 0;
+  request.chunked               = false;
+  request.connection_close      = false;
+  request.connection_keep_alive = false;
+  request.header_length         = header_end;
+  request.error_status          = 0;
+
+  // Request line: METHOD SP target SP HTTP/1.x CRLF
+  const char* line = data + start;
+  size_t line_length = scan_for(line, header_end - start, '\r', '\n');
+  size_t line_end = line_ending(line, line_length);
+  if (line_end == 0) {
+    return fail(request, 400);
+  }
+
+  std::string_view request_line(line, line_length);
+  size_t first_space = request_line.find(' ');
+  size_t second_space = request_line.find(' ', first_space == std::string_view::npos
+                                                   ? first_space : first_space + 1);
+  if (first_space == 0 || first_space == std::string_view::npos ||
+      second_space == std::string_view::npos || second_space == first_space + 1) {
+    return fail(request, 400);
+  }
+
+  request.method  = request_line.substr(0, first_space);
+  request.target  = request_line.substr(first_space + 1, second_space - first_space - 1);
+  request.version = request_line.substr(second_space + 1);
+
+  if (request.version.size() != 8 || request.version.compare(0, 7, "HTTP/1.") != 0 ||
+      request.version[7] < '0' || request.version[7] > '9') {
+    return fail(request, 400);
+  }
+  request.minor_version = request.version[7] - '0';
+
+  // Header lines: name ":" OWS value OWS CRLF, up to the blank line
+  const char* cursor = line + line_length + line_end;
+  const char* headers_end = data + block_end;
+  while (cursor < headers_end) {
+    size_t remaining = static_cast<size_t>(headers_end - cursor);
+
+    // Obsolete line folding is rejected rather than unfolded
+    if (*cursor == ' ' || *cursor == '\t') {
+      return fail(request, 400);
+    }
+
+    size_t colon = scan_for(cursor, remaining, ':', '\n');
+    if (colon == 0 || colon >= remaining || cursor[colon] != ':' ||
+        cursor[colon - 1] == ' ' || cursor[colon - 1] == '\t' ||
+        memchr(cursor, '\r', colon) != nullptr) {
+      return fail(request, 400);
+    }
+
+    const char* value = cursor + colon + 1;
+    size_t value_length = scan_for(value, static_cast<size_t>(headers_end - value), '\r', '\n');
+    size_t value_end = line_ending(value, value_length);
+    if (value_end == 0) {
+      return fail(request, 400);
+    }
+
+    if (request.header_count == HTTP_MAX_HEADERS) {
+      return fail(request, 431);
+    }
+    HttpHeader& header = request.headers[request.header_count++];
+    header.name  = std::string_view(cursor, colon);
+    header.value = trim(std::string_view(value, value_length));
+
+    if (apply_header(request, header) == ParseStatus::ERROR) {
+      return ParseStatus::ERROR;
+    }
+
+    cursor = value + value_length + value_end;
+  }
+
+  return ParseStatus::COMPLETE;
+}
+
+/* ----------------------------
+ * BodyDecoder
+ * ---------------------------- */
+
+BodyDecoder::BodyDecoder()
+  : state(State::DONE), remaining(0), size_digits(false) {}
+
+void BodyDecoder::reset(const HttpRequest& request) {
+  size_digits = false;
+  if (request.chunked) {
+    state = State::CHUNK_SIZE;
+    remaining = 0;
+  } else if (request.content_length > 0) {
+    state = State::LENGTH_DATA;
+    remaining = request.content_length;
+  } else {
+    state = State::DONE;
+    remaining = 0;
+  }
+}
+
+static int hex_value(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+ParseStatus BodyDecoder::decode(const char* data, size_t length, size_t& consumed,
+                                std::string_view& payload) {
+  consumed = 0;
+  payload = std::string_view();
+
+  while (consumed < length && state != State::DONE) {
+    char c = data[consumed];
+
+    switch (state) {
+      case State::LENGTH_DATA:
+      case State::CHUNK_DATA: {
+        size_t available = length - consumed;
+        size_t take = remaining < available ? static_cast<size_t>(remaining) : available;
+        payload = std::string_view(data + consumed, take);
+        consumed += take;
+        remaining -= take;
+        if (remaining == 0) {
+          state = (state == State::LENGTH_DATA) ? State::DONE : State::CHUNK_DATA_CR;
+        }
+        return state == State::DONE ? ParseStatus::COMPLETE : ParseStatus::INCOMPLETE;
+      }
+
+      case State::CHUNK_SIZE: {
+        int digit = hex_value(c);
+        if (digit >= 0) {
+          if (remaining >> 59) {
+            return ParseStatus::ERROR;  // Chunk size overflow
+          }
+          remaining = (remaining << 4) | static_cast<uint64_t>(digit);
+          size_digits = true;
+        } else if (!size_digits) {
+          return ParseStatus::ERROR;
+        } else if (c == '\r') {
+          state = State::CHUNK_SIZE_LF;
+        } else if (c == ';' || c == ' ' || c == '\t') {
+          state = State::CHUNK_EXT;
+        } else {
+          return ParseStatus::ERROR;
+        }
+        break;
+      }
+
+      case State::CHUNK_EXT:
+        if (c == '\r') {
+          state = State::CHUNK_SIZE_LF;
+        }
+        break;
+
+      case State::CHUNK_SIZE_LF:
+        if (c != '\n') {
+          return ParseStatus::ERROR;
+        }
+        size_digits = false;
+        state = (remaining == 0) ? State::TRAILER_START : State::CHUNK_DATA;
+        break;
+
+      case State::CHUNK_DATA_CR:
+        if (c != '\r') {
+          return ParseStatus::ERROR;
+        }
+        state = State::CHUNK_DATA_LF;
+        break;
+
+      case State::CHUNK_DATA_LF:
+        if (c != '\n') {
+          return ParseStatus::ERROR;
+        }
+        state = State::CHUNK_SIZE;
+        break;
+
+      case State::TRAILER_START:
+        state = (c == '\r') ? State::FINAL_LF : State::TRAILER_LINE;
+        break;
+
+      case State::TRAILER_LINE:
+        if (c == '\r') {
+          state = State::TRAILER_LF;
+        }
+        break;
+
+      case State::TRAILER_LF:
+        if (c != '\n') {
+          return ParseStatus::ERROR;
+        }
+        state = State::TRAILER_START;
+        break;
+
+      case State::FINAL_LF:
+        if (c != '\n') {
+          return ParseStatus::ERROR;
+        }
+        state = State::DONE;
+        break;
+
+      case State::DONE:
+        break;
+    }
+    consumed++;
+  }
+
+  return state == State::DONE ? ParseStatus::COMPLETE : ParseStatus::INCOMPLETE;
+}
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/*
+ * CGI worker protocol constants
+ */
+constexpr uint8_t CGI_PROTOCOL_VERSION    = 1;
+constexpr size_t  CGI_FRAME_HEADER_SIZE   = 8;
+constexpr size_t  CGI_MAX_FRAME_PAYLOAD   = 65536;  // Longer payloads are split
+constexpr const char* CGI_WORKER_ENV      = "CGI_WORKER_PROTOCOL";  // Set to the version
+
+/*
+ * The framed protocol spoken between the server and a persistent CGI
+ * worker, a minimal relative of FastCGI.
+ *
+ * The server starts the program with a connected stream socket as its
+ * fd 0 and CGI_WORKER_PROTOCOL=1 in its environment. Both directions
+ * carry frames with an 8-byte header:
+ *
+ *   version (1) | type (1) | request id (2, big-endian) | length (4, big-endian)
+ *
+ * followed by `length` payload bytes. The server sends BEGIN with the
+ * query string as payload; the worker answers with any number of
+ * STDOUT frames, holding what a CGI program would print (header block
+ * and body), and then one END frame. Requests are multiplexed: the
+ * server may send the next BEGIN before earlier requests have ended,
+ * and a worker may interleave the frames of different requests.
+ *
+ * Header-only, and C++11, so worker programs can include it as is.
+ */
+enum class CgiFrameType : uint8_t {
+  BEGIN  = 1,  // Server to worker: start a request; payload is QUERY_STRING
+  STDOUT = 2,  // Worker to server: response bytes
+  END    = 3   // Worker to server: response complete; empty payload
+};
+
+struct CgiFrame {
+  CgiFrameType type;
+  uint16_t request_id;
+  std::string payload;
+};
+
+/*
+ * Append the frames carrying `length` bytes of payload to `out`. STDOUT
+ * data longer than CGI_MAX_FRAME_PAYLOAD is split over several frames.
+ */
+inline void append_cgi_frame(std::string& out, CgiFrameType type, uint16_t request_id,
+                             const char* data, size_t length) {
+  do {
+    size_t take = length < CGI_MAX_FRAME_PAYLOAD ? length : CGI_MAX_FRAME_PAYLOAD;
+    char header[CGI_FRAME_HEADER_SIZE] = {
+      static_cast<char>(CGI_PROTOCOL_VERSION),
+      static_cast<char>(type),
+      static_cast<char>(request_id >> 8),
+      static_cast<char>(request_id & 0xff),
+      static_cast<char>((take >> 24) & 0xff),
+      static_cast<char>((take >> 16) & 0xff),
+      static_cast<char>((take >> 8) & 0xff),
+      static_cast<char>(take & 0xff),
+    };
+    out.append(header, CGI_FRAME_HEADER_SIZE).append(data, take);
+    data += take;
+    length -= take;
+  } while (length > 0);
+}
+
+/*
+ * Incremental frame decoder: append() what the socket delivered, then
+ * call next() until it returns false
+ */
+class CgiFrameReader {
+public:
+  CgiFrameReader() : consumed(0), bad(false) {}
+
+  void append(const char* data, size_t length) {
+    if (consumed > 0 && consumed == buffer.size()) {
+      buffer.clear();
+      consumed = 0;
+    }
+    buffer.append(data, length);
+  }
+
+  /*
+   * Decode the next complete frame into `frame`. Returns false when
+   * more bytes are needed, or for good once the stream is malformed
+   * (see failed()).
+   */
+  bool next(CgiFrame& frame) {
+    if (bad || buffer.size() - consumed < CGI_FRAME_HEADER_SIZE) {
+      return false;
+    }
+
+    const unsigned char* header = reinterpret_cast<const unsigned char*>(buffer.data() + consumed);
+    size_t length = (size_t(header[4]) << 24) | (size_t(header[5]) << 16) |
+                    (size_t(header[6]) << 8) | size_t(header[7]);
+    if (header[0] != CGI_PROTOCOL_VERSION || header[1] < 1 || header[1] > 3 ||
+        length > CGI_MAX_FRAME_PAYLOAD) {
+      bad = true;
+      return false;
+    }
+    if (buffer.size() - consumed < CGI_FRAME_HEADER_SIZE + length) {
+      return false;
+    }
+
+    frame.type = static_cast<CgiFrameType>(header[1]);
+    frame.request_id = static_cast<uint16_t>((header[2] << 8) | header[3]);
+    frame.payload.assign(buffer, consumed + CGI_FRAME_HEADER_SIZE, length);
+    consumed += CGI_FRAME_HEADER_SIZE + length;
+
+    // Keep the buffer from growing without bound on a busy stream
+    if (consumed > CGI_MAX_FRAME_PAYLOAD) {
+      buffer.erase(0, consumed);
+      consumed = 0;
+    }
+    return true;
+  }
+
+  bool failed() const { return bad; }
+
+  void reset() {
+    buffer.clear();
+    consumed = 0;
+    bad = false;
+  }
+
+private:
+  std::string buffer;
+  size_t consumed;  // Bytes of buffer already decoded
+  bool bad;
+};
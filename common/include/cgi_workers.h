@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <sys/types.h>
+
+/*
+ * CGI worker constants
+ */
+constexpr size_t   DEFAULT_CGI_WORKERS       = 4;      // Workers per program
+constexpr uint64_t CGI_WORKER_MIN_UPTIME_MS  = 1000;   // Dying sooner counts as a failed start
+constexpr uint64_t CGI_WORKER_FIRST_BACKOFF_MS = 100;
+constexpr uint64_t CGI_WORKER_MAX_BACKOFF_MS = 10000;
+
+/*
+ * Which CGI programs run as persistent workers, and how many of each.
+ * Programs are named by URL path (e.g. "/spin.cgi"); every other CGI
+ * program is still started once per request.
+ */
+struct CgiWorkerConfig {
+  std::vector<std::string> paths;
+  size_t workers_per_program = DEFAULT_CGI_WORKERS;
+
+  bool serves(std::string_view path) const;
+};
+
+/*
+ * Set from the command line before the server starts
+ */
+extern CgiWorkerConfig g_cgi_workers;
+
+/*
+ * One persistent worker process and the server's end of its socket.
+ *
+ * The program is started with posix_spawn(), which does not copy the
+ * server's page tables, with one end of a socketpair as its fd 0 and
+ * CGI_WORKER_PROTOCOL set (see cgi_protocol.h). Its stdout goes to
+ * /dev/null so stray prints cannot corrupt the frame stream.
+ *
+ * Restart policy: a worker that ran for at least
+ * CGI_WORKER_MIN_UPTIME_MS may be restarted at once. One that died
+ * sooner is held back, starting at CGI_WORKER_FIRST_BACKOFF_MS and
+ * doubling up to CGI_WORKER_MAX_BACKOFF_MS, so a program that cannot
+ * run as a worker does not fork in a tight loop.
+ *
+ * Not thread-safe; the caller serializes start() and stop().
+ */
+class CgiWorkerProcess {
+public:
+  CgiWorkerProcess();
+  ~CgiWorkerProcess();
+
+  CgiWorkerProcess(const CgiWorkerProcess&) = delete;
+  CgiWorkerProcess& operator=(const CgiWorkerProcess&) = delete;
+
+  /*
+   * Start `program`. The socket is non-blocking if asked. Returns false
+   * (and schedules a retry) if the process cannot be created.
+   */
+  bool start(const std::string& program, bool nonblocking, uint64_t now_ms);
+
+  /*
+   * Kill and reap the process and close the socket; the caller must
+   * have stopped watching it first. Schedules the restart.
+   */
+  void stop(uint64_t now_ms);
+
+  bool running() const { return socket_fd >= 0; }
+  int fd() const { return socket_fd; }
+  pid_t pid() const { return child; }
+
+  bool restart_due(uint64_t now_ms) const { return !running() && now_ms >= restart_at_ms; }
+  uint64_t restart_at() const { return restart_at_ms; }
+  uint64_t restarts() const { return restart_count; }
+
+private:
+  void schedule_restart(uint64_t now_ms, bool failed_start);
+
+  pid_t child;
+  int socket_fd;
+  uint64_t started_ms;
+  uint64_t restart_at_ms;
+  uint64_t backoff_ms;     // Next hold-back after a failed start
+  uint64_t restart_count;
+};
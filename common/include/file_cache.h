@@ -0,0 +1,130 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <ctime>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+/*
+ * File cache constants
+ */
+constexpr size_t DEFAULT_FILE_CACHE_ENTRIES = 1024;
+constexpr size_t FILE_CACHE_SHARDS = 16;
+
+/*
+ * What the servers need to know about a path to answer a request.
+ *
+ * Regular, readable files keep an open descriptor that responses send
+ * from; it is closed when the last response holding the entry is done,
+ * even if the entry was evicted or invalidated in the meantime.
+ */
+struct CachedFile {
+  std::string path;
+  int fd;                  // -1 unless a readable regular file
+  off_t size;
+  mode_t mode;
+  struct timespec mtime;
+  const char* mime_type;
+
+  CachedFile();
+  ~CachedFile();
+
+  CachedFile(const CachedFile&) = delete;
+  CachedFile& operator=(const CachedFile&) = delete;
+};
+
+/*
+ * Bounded, thread-safe cache of stat() results and open descriptors,
+ * keyed by the resolved request path (e.g. "./index.html"), lexically
+ * normalized so "./sub/../index.html" shares that entry.
+ *
+ * Entries are spread over FILE_CACHE_SHARDS independently locked LRU
+ * lists, so concurrent lookups of different files rarely contend. A hit
+ * costs no system calls. A background thread watches the directories of
+ * cached files with inotify and drops entries whose file changes, moves
+ * or disappears.
+ *
+ * Without inotify nothing would tell the cache that a file changed, so
+ * if it cannot be set up every lookup goes to the filesystem.
+ */
+class FileCache {
+public:
+  explicit FileCache(size_t max_entries = DEFAULT_FILE_CACHE_ENTRIES);
+  ~FileCache();
+
+  FileCache(const FileCache&) = delete;
+  FileCache& operator=(const FileCache&) = delete;
+
+  /*
+   * Start the inotify watcher thread. Call once, after chdir() into the
+   * document root. Returns false if inotify is unavailable.
+   */
+  bool start();
+
+  /*
+   * Metadata (and descriptor) for a path, or nullptr with errno set if
+   * stat() fails
+   */
+  std::shared_ptr<const CachedFile> lookup(const std::string& path);
+
+  /*
+   * Cached entry for a path, or nullptr on a miss. Never touches the
+   * filesystem, so an event loop can try it first and leave misses to
+   * lookup() on another thread.
+   */
+  std::shared_ptr<const CachedFile> find(const std::string& path);
+
+  // ---- Metrics ----
+  uint64_t hits() const;
+  uint64_t misses() const;
+  uint64_t invalidations() const;
+  uint64_t evictions() const;
+  size_t size();
+
+private:
+  typedef std::list<std::shared_ptr<const CachedFile>> LruList;
+
+  struct Shard {
+    std::mutex mutex;
+    LruList lru;  // Most recently used first
+    std::unordered_map<std::string, LruList::iterator> entries;
+    uint64_t generation = 0;  // Bumped by every invalidation
+  };
+
+  Shard& shard_for(const std::string& path);
+  std::shared_ptr<const CachedFile> load(const std::string& path);
+  bool watch_directory_of(const std::string& path);
+  void invalidate(const std::string& path);
+  void invalidate_all();
+  void watch_loop();
+
+  Shard shards[FILE_CACHE_SHARDS];
+  size_t shard_capacity;
+
+  // inotify state
+  int inotify_fd;
+  int stop_fd;  // eventfd that wakes the watcher thread on shutdown
+  std::thread watcher;
+  std::mutex watch_mutex;
+  std::unordered_map<std::string, int> watched_dirs;        // directory -> watch descriptor
+  std::unordered_map<int, std::vector<std::string>> watch_dirs;  // watch descriptor -> directories
+
+  std::atomic<uint64_t> hit_count;
+  std::atomic<uint64_t> miss_count;
+  std::atomic<uint64_t> invalidation_count;
+  std::atomic<uint64_t> eviction_count;
+};
+
+/*
+ * Process-wide cache shared by every reactor or worker thread
+ */
+extern FileCache g_file_cache;
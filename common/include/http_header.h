@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <string>
+#include <string_view>
+
+/*
+ * Header builder constants
+ */
+constexpr size_t HEADER_BUFFER_SIZE = 512;
+constexpr size_t HTTP_DATE_LENGTH   = 29;   // "Sun, 06 Nov 1994 08:49:37 GMT"
+
+/*
+ * Current time as an HTTP date. Each thread formats it at most once per
+ * second; the returned buffer stays valid until the thread's next call.
+ */
+const char* http_date(time_t now);
+
+/*
+ * Reason phrase for a status code ("Not Found" for 404)
+ */
+const char* status_reason(int status_code);
+
+/*
+ * Append the decimal form of value to out, without going through a stream
+ */
+void append_number(std::string& out, uint64_t value);
+
+/*
+ * Builds a response header block in a fixed on-stack buffer: no heap
+ * allocation, no locale-aware formatting. Status lines come from a
+ * static table, integers are formatted with std::to_chars and the Date
+ * header from the per-second cache above.
+ *
+ * The buffer is sized for the headers these servers send; a block that
+ * outgrows it (a long value) moves to the heap rather than lose lines.
+ */
+class HeaderBuilder {
+public:
+  /*
+   * Start with the status line, e.g. HeaderBuilder("HTTP/1.1", 200)
+   */
+  HeaderBuilder(const char* version, int status_code);
+
+  /*
+   * As above, but with the given reason phrase (e.g. one a CGI program
+   * sent); it must hold no control characters. An empty one means the
+   * table's.
+   */
+  HeaderBuilder(const char* version, int status_code, std::string_view reason);
+
+  HeaderBuilder(const HeaderBuilder&) = delete;
+  HeaderBuilder& operator=(const HeaderBuilder&) = delete;
+
+  /*
+   * Append "name: value\r\n"
+   */
+  HeaderBuilder& add(const char* name, const char* value);
+  HeaderBuilder& add(const char* name, uint64_t value);
+
+  /*
+   * Append "Date: <now>\r\n"
+   */
+  HeaderBuilder& add_date();
+
+  /*
+   * Append preformatted header lines, CRLFs included
+   */
+  HeaderBuilder& add_raw(const char* lines);
+
+  /*
+   * Append the blank line that ends the header block
+   */
+  HeaderBuilder& finish();
+
+  const char* data() const { return spilled.empty() ? buffer : spilled.data(); }
+  size_t size() const { return spilled.empty() ? length : spilled.size(); }
+
+private:
+  void append(const char* bytes, size_t count);
+
+  char buffer[HEADER_BUFFER_SIZE];
+  size_t length;
+  std::string spilled;  // The whole block, once it no longer fits in buffer
+};
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+/*
+ * Parser limits
+ */
+constexpr size_t HTTP_MAX_HEADERS = 64;
+
+enum class ParseStatus {
+  INCOMPLETE,  // Need more bytes
+  COMPLETE,    // A full header block (or body) was parsed
+  ERROR        // Malformed; see HttpRequest::error_status
+};
+
+struct HttpHeader {
+  std::string_view name;
+  std::string_view value;
+};
+
+/*
+ * A parsed request head. Every view points into the caller's buffer, so
+ * it is only valid until that buffer is modified.
+ */
+struct HttpRequest {
+  std::string_view method;
+  std::string_view target;
+  std::string_view version;
+  int minor_version;                  // 1 for HTTP/1.1, 0 for HTTP/1.0
+
+  HttpHeader headers[HTTP_MAX_HEADERS];
+  size_t header_count;
+
+  // Framing, taken from Content-Length / Transfer-Encoding
+  bool has_content_length;
+  uint64_t content_length;
+  bool chunked;
+
+  // Connection header tokens
+  bool connection_close;
+  bool connection_keep_alive;
+
+  size_t header_length;  // Bytes from the buffer start through the blank line
+  int error_status;      // HTTP status to answer with after ParseStatus::ERROR
+
+  /*
+   * Value of the first header with this name (case-insensitive), or an
+   * empty view if there is none
+   */
+  std::string_view header(std::string_view name) const;
+
+  /*
+   * True if a message body follows the header block
+   */
+  bool has_body() const { return chunked || content_length > 0; }
+};
+
+/*
+ * Incremental HTTP/1.x request-head parser.
+ *
+ * parse() is handed the whole unconsumed buffer each time more bytes
+ * arrive and resumes the search for the end of the header block where
+ * the previous call stopped, so a request split across reads is never
+ * rescanned. Lines may end in CRLF or a bare LF (RFC 9112, 2.2); a bare
+ * CR is an error. Nothing is copied or allocated: the request is described
+ * with views into the buffer. Delimiter scans use AVX2 or SSE2 when the
+ * CPU has them.
+ */
+class HttpParser {
+public:
+  HttpParser() : scanned(0) {}
+
+  /*
+   * Parse the request that starts at data[0]. On COMPLETE the request is
+   * filled in and request.header_length bytes belong to it; call reset()
+   * before parsing the next one.
+   */
+  ParseStatus parse(const char* data, size_t length, HttpRequest& request);
+
+  void reset() { scanned = 0; }
+
+private:
+  size_t scanned;  // Bytes already searched for the end of the header block
+};
+
+/*
+ * Incremental decoder for a request body framed by Content-Length or
+ * chunked transfer coding.
+ */
+class BodyDecoder {
+public:
+  BodyDecoder();
+
+  /*
+   * Start decoding the body announced by `request`
+   */
+  void reset(const HttpRequest& request);
+
+  /*
+   * Consume body bytes from data. Each call stops after at most one run
+   * of payload bytes, returned in `payload`; `consumed` counts framing and
+   * payload bytes used. Returns INCOMPLETE until the body has ended.
+   */
+  ParseStatus decode(const char* data, size_t length, size_t& consumed,
+                     std::string_view& payload);
+
+private:
+  enum class State {
+    LENGTH_DATA,   // Content-Length payload
+    CHUNK_SIZE,    // Hex digits of a chunk size
+    CHUNK_EXT,     // Chunk extension, ignored up to CRLF
+    CHUNK_SIZE_LF,
+    CHUNK_DATA,
+    CHUNK_DATA_CR,
+    CHUNK_DATA_LF,
+    TRAILER_START, // Start of a trailer line, or the final CRLF
+    TRAILER_LINE,
+    TRAILER_LF,
+    FINAL_LF,
+    DONE
+  };
+
+  State state;
+  uint64_t remaining;   // Payload bytes left in the body or current chunk
+  bool size_digits;     // Saw at least one hex digit of the chunk size
+};
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#include "timer_wheel.h"
+
+/*
+ * Load shedding constants
+ */
+constexpr uint64_t SHED_INTERVAL_MS = 100;          // Window a standing delay must fill
+constexpr uint32_t SHED_RETRY_AFTER_SECONDS = 1;    // Sent in Retry-After
+
+/*
+ * Turn a client away: send the precomputed 503 (with Retry-After and
+ * Connection: close) without blocking, discard whatever request bytes
+ * have already arrived, and close the socket. Counted in
+ * connections_shed() and as a closed connection, so the caller must
+ * already have recorded it as opened.
+ */
+void shed_connection(int fd);
+
+/*
+ * Connections turned away so far, by both shed_connection() callers
+ */
+uint64_t connections_shed();
+
+/*
+ * Decides when a request has waited too long to be worth serving, after
+ * CoDel as adapted to server queues: what matters is not a delay spike
+ * but a standing delay, one that stayed above the target for a whole
+ * SHED_INTERVAL_MS window even at its minimum.
+ *
+ *   - Callers record how long each request waited before service began
+ *     (time in a queue, or event loop lag).
+ *   - While there is no standing delay, a request is shed only if it
+ *     waited longer than the whole window: a burst drains normally.
+ *   - Once there is, anything that waited longer than the target is
+ *     shed, which empties the queue quickly; clients get a 503 at once
+ *     instead of timing out behind it.
+ *
+ * record() and too_late() may be called from any thread.
+ */
+class LoadShedder {
+public:
+  LoadShedder() = default;
+
+  LoadShedder(const LoadShedder&) = delete;
+  LoadShedder& operator=(const LoadShedder&) = delete;
+
+  /*
+   * Shed once the standing delay passes target_ms; 0 (the default)
+   * never sheds. Only call before the server starts handling requests.
+   */
+  void configure(uint32_t target_ms);
+  bool enabled() const { return target_us != 0; }
+
+  void record(uint64_t delay_us, uint64_t now_us);
+
+  /*
+   * Whether a request that waited delay_us should be shed
+   */
+  bool too_late(uint64_t delay_us) const;
+
+  /*
+   * Whether the last full window had a standing delay
+   */
+  bool overloaded() const { return standing.load(std::memory_order_relaxed); }
+
+private:
+  uint64_t target_us = 0;
+  std::atomic<uint64_t> window_min_us{UINT64_MAX};  // Smallest delay seen this window
+  std::atomic<uint64_t> window_end_us{0};
+  std::atomic<bool> standing{false};
+};
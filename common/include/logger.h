@@ -0,0 +1,170 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <type_traits>
+
+/*
+ * Log levels. The build sets LOG_LEVEL to the lowest level compiled in
+ * (default LOG_LEVEL_INFO); a LOG_* call below it is still type-checked
+ * but compiles to nothing, and its arguments are never evaluated.
+ */
+#define LOG_LEVEL_DEBUG 0
+#define LOG_LEVEL_INFO  1
+#define LOG_LEVEL_WARN  2
+#define LOG_LEVEL_ERROR 3
+#define LOG_LEVEL_OFF   4
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+/*
+ * Logger constants
+ */
+constexpr size_t LOG_RECORD_SIZE = 256;         // One ring slot, arguments included
+constexpr size_t LOG_RING_SLOTS = 1024;         // Records one thread can have pending
+constexpr unsigned LOG_FLUSH_INTERVAL_MS = 10;  // How often the writer thread drains
+
+enum class LogLevel : uint8_t {
+  DEBUG,
+  INFO,
+  WARN,   // WARN and ERROR go to stderr, the rest to stdout
+  ERROR
+};
+
+/*
+ * How an argument is stored in a record: this tag, then its payload
+ */
+enum LogArgType : uint8_t {
+  LOG_ARG_SIGNED,    // int64_t
+  LOG_ARG_UNSIGNED,  // uint64_t
+  LOG_ARG_CHAR,      // One byte
+  LOG_ARG_STRING     // uint16_t length, then the bytes
+};
+
+/*
+ * One log call, as the calling thread left it: a pointer to the format
+ * string (a literal, so it outlives the record) and the arguments in
+ * binary. Formatting waits for the writer thread.
+ */
+struct LogRecord {
+  const char* format;
+  LogLevel level;
+  uint16_t arg_bytes;
+  unsigned char args[LOG_RECORD_SIZE - sizeof(const char*) - 4];
+};
+static_assert(sizeof(LogRecord) == LOG_RECORD_SIZE, "records fill their slots exactly");
+
+/*
+ * Asynchronous logger. Each thread appends records to its own
+ * single-producer ring, so logging takes no lock and makes no system
+ * call; a background thread drains every ring every
+ * LOG_FLUSH_INTERVAL_MS, formats the records and writes them out.
+ *
+ * A record that finds its ring full is dropped and counted, never
+ * waited for; the writer thread reports the count. Lines from one
+ * thread keep their order, lines from different threads may not.
+ */
+class Logger {
+public:
+  /*
+   * Log `format` with each "{}" replaced by the next argument: integers,
+   * bools and chars are stored as they are, strings are copied (and cut
+   * short if the record fills up). Use the LOG_* macros.
+   */
+  template <size_t N, typename... Args>
+  static void write(LogLevel level, const char (&format)[N], const Args&... args);
+
+  /*
+   * Drain every ring and write the lines out now. Also runs at exit.
+   */
+  static void flush();
+
+  /*
+   * Records dropped so far because their thread's ring was full
+   */
+  static uint64_t dropped();
+
+private:
+  // Next free slot of this thread's ring, or nullptr (counted) if full
+  static LogRecord* claim();
+  static void publish();
+
+  /*
+   * Appends arguments to a record
+   */
+  class ArgWriter {
+  public:
+    explicit ArgWriter(LogRecord& log_record) : record(log_record) {
+      record.arg_bytes = 0;
+    }
+
+    template <typename T>
+    void put(const T& value) {
+      using Type = std::decay_t<T>;
+      if constexpr (std::is_same_v<Type, bool>) {
+        put_integer(LOG_ARG_UNSIGNED, static_cast<uint64_t>(value));
+      } else if constexpr (std::is_same_v<Type, char>) {
+        put_bytes(LOG_ARG_CHAR, &value, 1);
+      } else if constexpr (std::is_integral_v<Type> && std::is_signed_v<Type>) {
+        put_integer(LOG_ARG_SIGNED, static_cast<uint64_t>(static_cast<int64_t>(value)));
+      } else if constexpr (std::is_integral_v<Type>) {
+        put_integer(LOG_ARG_UNSIGNED, static_cast<uint64_t>(value));
+      } else {
+        static_assert(std::is_convertible_v<const T&, std::string_view>,
+                      "log arguments are integers, chars, bools or strings");
+        std::string_view text(value);
+        put_bytes(LOG_ARG_STRING, text.data(), text.size());
+      }
+    }
+
+  private:
+    void put_integer(LogArgType type, uint64_t value) {
+      put_bytes(type, &value, sizeof(value));
+    }
+
+    void put_bytes(LogArgType type, const void* data, size_t length);
+
+    LogRecord& record;
+  };
+};
+
+template <size_t N, typename... Args>
+void Logger::write(LogLevel level, const char (&format)[N], const Args&... args) {
+  LogRecord* record = claim();
+  if (!record) {
+    return;
+  }
+  record->format = format;
+  record->level = level;
+
+  ArgWriter writer(*record);
+  (writer.put(args), ...);
+  publish();
+}
+
+#if LOG_LEVEL <= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(...) Logger::write(LogLevel::DEBUG, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) do { if (false) Logger::write(LogLevel::DEBUG, __VA_ARGS__); } while (0)
+#endif
+
+#if LOG_LEVEL <= LOG_LEVEL_INFO
+#define LOG_INFO(...) Logger::write(LogLevel::INFO, __VA_ARGS__)
+#else
+#define LOG_INFO(...) do { if (false) Logger::write(LogLevel::INFO, __VA_ARGS__); } while (0)
+#endif
+
+#if LOG_LEVEL <= LOG_LEVEL_WARN
+#define LOG_WARN(...) Logger::write(LogLevel::WARN, __VA_ARGS__)
+#else
+#define LOG_WARN(...) do { if (false) Logger::write(LogLevel::WARN, __VA_ARGS__); } while (0)
+#endif
+
+#if LOG_LEVEL <= LOG_LEVEL_ERROR
+#define LOG_ERROR(...) Logger::write(LogLevel::ERROR, __VA_ARGS__)
+#else
+#define LOG_ERROR(...) do { if (false) Logger::write(LogLevel::ERROR, __VA_ARGS__); } while (0)
+#endif
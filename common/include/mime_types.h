@@ -0,0 +1,20 @@
+#pragma once
+
+#include <string_view>
+
+/*
+ * Content-Type served for files whose extension is not in the table
+ */
+constexpr const char* DEFAULT_MIME_TYPE = "text/plain";
+
+/*
+ * Extension of the last path component, without the dot ("gz" for
+ * "a/b.tar.gz"), or an empty view if it has none
+ */
+std::string_view file_extension(std::string_view path);
+
+/*
+ * Content-Type for a file, from its extension (case-insensitive).
+ * One hash probe into a table built at compile time.
+ */
+const char* mime_type_for(std::string_view filename);
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "routes.h"
+
+/*
+ * Latency histogram constants
+ */
+constexpr unsigned HISTOGRAM_SUB_BITS = 5;   // 32 linear buckets per power of two
+constexpr unsigned HISTOGRAM_MAX_BITS = 32;  // Larger values (over 71 minutes) are clamped
+constexpr size_t HISTOGRAM_BUCKETS =
+  size_t(HISTOGRAM_MAX_BITS - HISTOGRAM_SUB_BITS + 1) << HISTOGRAM_SUB_BITS;
+
+/*
+ * HDR-style histogram of durations in microseconds: exact below 32 us,
+ * then 32 linear buckets per power of two, so a bucket's values are
+ * within about 3% of each other at any magnitude.
+ *
+ * Only one thread records into a histogram, with plain loads and stores
+ * on relaxed atomics (no locked instruction); any thread may read it,
+ * seeing each bucket's count as of some recent moment.
+ */
+class LatencyHistogram {
+public:
+  void record(uint64_t value_us);
+
+  uint64_t count(size_t bucket) const { return counts[bucket].load(std::memory_order_relaxed); }
+  uint64_t sum_us() const { return sum.load(std::memory_order_relaxed); }
+
+  static size_t bucket_of(uint64_t value_us);
+
+  /*
+   * Largest value recorded into bucket, which is what quantiles report
+   */
+  static uint64_t bucket_highest(size_t bucket);
+
+private:
+  std::atomic<uint64_t> counts[HISTOGRAM_BUCKETS] = {};
+  std::atomic<uint64_t> sum{0};
+};
+
+/*
+ * What kind of request a response answered; a request refused before it
+ * was routed (an unsupported method) is REJECTED
+ */
+enum class RequestClass {
+  STATIC,
+  CGI,
+  METRICS,
+  REJECTED,
+  COUNT
+};
+
+RequestClass request_class(RouteKind kind);
+
+/*
+ * Where a request's time went
+ */
+enum class RequestPhase {
+  QUEUE,    // Waiting for a worker thread (multithreaded server)
+  READ,     // Start of the request to the end of its header block
+  RESPOND,  // End of the header block to the last response byte sent
+  COUNT
+};
+
+/*
+ * Recording. Each thread writes only its own histograms and counters,
+ * allocated on its first use, so recording never contends; a thread's
+ * block is handed to a later thread once it exits, so nothing recorded
+ * is lost and memory stays bounded as threads come and go.
+ */
+void record_request(RequestClass kind, int status, uint64_t total_us);
+void record_phase(RequestPhase phase, uint64_t duration_us);
+void record_bytes_sent(uint64_t bytes);
+void record_connection_opened();
+void record_connection_closed();
+
+/*
+ * Append every thread's request histograms, merged now, in Prometheus
+ * text format:
+ *
+ *   - http_request_duration_seconds: histogram of total time by class
+ *     and status code
+ *   - http_request_latency_seconds: the same as a summary, with the
+ *     0.5, 0.9, 0.99 and 0.999 quantiles
+ *   - http_request_phase_seconds: summary of each phase
+ *   - bytes_sent_total and open_connections
+ */
+void append_request_metrics(std::string& out);
+
+/*
+ * Append one unlabelled sample with its # TYPE line
+ */
+void append_metric(std::string& out, const char* name, const char* type, uint64_t value);
+void append_metric(std::string& out, const char* name, const char* type, double value);
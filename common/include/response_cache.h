@@ -0,0 +1,111 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "file_cache.h"
+
+/*
+ * Response cache constants
+ */
+constexpr size_t DEFAULT_RESPONSE_CACHE_MAX_FILE = 16384;      // Largest body kept in memory
+constexpr size_t DEFAULT_RESPONSE_CACHE_BUDGET   = 16777216;   // Total bytes across all entries
+constexpr size_t RESPONSE_CACHE_SHARDS = 16;
+
+/*
+ * Fully rendered responses (status line, headers and body in one
+ * buffer) for small static files, so a hit is answered with one send()
+ * and no header formatting or file I/O.
+ *
+ * A file can have several renderings, e.g. with "Connection: close" and
+ * with "Connection: keep-alive"; the caller tells them apart with a
+ * small variant number. An entry is only used while the file's mtime and
+ * size match what it was rendered from; a changed file is re-rendered
+ * on its next request. A Date header in the rendering is brought up to
+ * date at most once a second, by swapping in a patched copy.
+ *
+ * Entries live in RESPONSE_CACHE_SHARDS independently locked LRU lists
+ * that split the memory budget between them.
+ */
+class ResponseCache {
+public:
+  ResponseCache(size_t max_file_size = DEFAULT_RESPONSE_CACHE_MAX_FILE,
+                size_t memory_budget = DEFAULT_RESPONSE_CACHE_BUDGET);
+
+  ResponseCache(const ResponseCache&) = delete;
+  ResponseCache& operator=(const ResponseCache&) = delete;
+
+  /*
+   * Change the limits. Only call before the server starts handling
+   * requests; a max_file_size of 0 disables the cache.
+   */
+  void configure(size_t max_file_size, size_t memory_budget);
+
+  /*
+   * Cached rendering of `file`, or nullptr if there is none or the file
+   * has changed since it was rendered
+   */
+  std::shared_ptr<const std::string> find(const CachedFile& file, int variant);
+
+  /*
+   * Render `header` followed by the file's contents and cache the result
+   * if it fits the budget. Returns nullptr if the file is over the size
+   * threshold or cannot be read in full.
+   */
+  std::shared_ptr<const std::string> store(const CachedFile& file, int variant,
+                                           std::string_view header);
+
+  /*
+   * True if the file is small enough to be kept as a rendering
+   */
+  bool cacheable(const CachedFile& file) const;
+
+  // ---- Metrics ----
+  uint64_t hits() const;
+  uint64_t misses() const;
+  uint64_t evictions() const;
+  size_t bytes_used();
+
+private:
+  struct Entry {
+    std::string key;
+    struct timespec mtime;
+    off_t size;
+    std::shared_ptr<const std::string> response;
+    size_t date_offset;  // Where the Date value starts, or npos
+    time_t date_second;  // Second the Date value shows
+  };
+  typedef std::list<Entry> LruList;
+
+  struct Shard {
+    std::mutex mutex;
+    LruList lru;  // Most recently used first
+    std::unordered_map<std::string, LruList::iterator> entries;
+    size_t bytes = 0;
+  };
+
+  static std::string make_key(const CachedFile& file, int variant);
+  Shard& shard_for(const std::string& key);
+  void erase(Shard& shard, LruList::iterator it);
+
+  Shard shards[RESPONSE_CACHE_SHARDS];
+  size_t max_file_size;
+  size_t shard_budget;
+
+  std::atomic<uint64_t> hit_count;
+  std::atomic<uint64_t> miss_count;
+  std::atomic<uint64_t> eviction_count;
+};
+
+/*
+ * Process-wide cache shared by every reactor or worker thread
+ */
+extern ResponseCache g_response_cache;
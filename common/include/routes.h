@@ -0,0 +1,25 @@
+#pragma once
+
+#include <string_view>
+
+/*
+ * Where a request target is sent
+ */
+enum class RouteKind {
+  STATIC,   // File under the document root
+  CGI,      // Program under /cgi-bin/ or named *.cgi
+  METRICS   // Built-in /metrics page
+};
+
+struct Route {
+  RouteKind kind;
+  std::string_view path;   // Target without the query string
+  std::string_view query;  // Text after '?', empty if there is none
+};
+
+/*
+ * Classify a request target. Built-in pages are matched exactly through
+ * a table laid out at compile time; CGI is recognised by the /cgi-bin/
+ * prefix or the .cgi extension of the path, never by the query string.
+ */
+Route route_request(std::string_view target);
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+/*
+ * FNV-1a over a string, usable at compile time
+ */
+constexpr uint32_t fnv1a_hash(std::string_view key) {
+  uint32_t hash = 2166136261u;
+  for (char c : key) {
+    hash ^= static_cast<unsigned char>(c);
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+/*
+ * Fixed string-keyed lookup table laid out at compile time.
+ *
+ * Keys are placed by open addressing (FNV-1a, linear probing) in a table
+ * of Slots entries; keep Slots a power of two at least twice the number
+ * of keys so a lookup usually touches one slot. Building a map with more
+ * keys than slots fails to compile.
+ */
+template <typename Value, size_t Slots>
+class StaticMap {
+  static_assert((Slots & (Slots - 1)) == 0, "Slots must be a power of two");
+
+public:
+  struct Entry {
+    std::string_view key{};
+    Value value{};
+  };
+
+  template <size_t N>
+  constexpr StaticMap(const Entry (&entries)[N]) : slots(), used() {
+    static_assert(N * 2 <= Slots, "StaticMap is too full");
+    for (size_t i = 0; i < N; ++i) {
+      size_t slot = fnv1a_hash(entries[i].key) & (Slots - 1);
+      while (used[slot]) {
+        slot = (slot + 1) & (Slots - 1);
+      }
+      slots[slot] = entries[i];
+      used[slot] = true;
+    }
+  }
+
+  /*
+   * Value stored under key, or nullptr
+   */
+  constexpr const Value* find(std::string_view key) const {
+    size_t slot = fnv1a_hash(key) & (Slots - 1);
+    while (used[slot]) {
+      if (slots[slot].key == key) {
+        return &slots[slot].value;
+      }
+      slot = (slot + 1) & (Slots - 1);
+    }
+    return nullptr;
+  }
+
+private:
+  Entry slots[Slots];
+  bool used[Slots];
+};
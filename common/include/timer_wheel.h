@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*
+ * Timer wheel constants
+ */
+constexpr uint64_t TIMER_TICK_MS     = 10;  // Resolution: timers fire up to one tick late
+constexpr unsigned TIMER_LEVEL_BITS  = 6;
+constexpr unsigned TIMER_LEVELS      = 4;   // 64^4 ticks, about 46 hours at 10 ms
+constexpr size_t   TIMER_SLOTS       = size_t(1) << TIMER_LEVEL_BITS;
+
+/*
+ * Milliseconds on the monotonic clock
+ */
+uint64_t monotonic_ms();
+
+/*
+ * Microseconds on the same clock, for measuring delays
+ */
+uint64_t monotonic_us();
+
+/*
+ * A timer, embedded in the object it times out. The wheel links it into
+ * a slot list in place, so scheduling and cancelling never allocate.
+ */
+struct TimerNode {
+  TimerNode* prev;
+  TimerNode* next;
+  uint64_t expires;  // Tick the timer fires on
+  void* owner;       // Handed back untouched when the timer fires
+
+  explicit TimerNode(void* owner_ptr = nullptr)
+    : prev(nullptr), next(nullptr), expires(0), owner(owner_ptr) {}
+
+  bool pending() const { return prev != nullptr; }
+};
+
+/*
+ * Hierarchical timer wheel: TIMER_LEVELS rings of TIMER_SLOTS slots,
+ * each level TIMER_SLOTS times coarser than the one below. A timer goes
+ * in the finest level that can hold its deadline and moves down a level
+ * each time the slot it sits in comes round.
+ *
+ * Scheduling, rescheduling and cancelling are O(1). Every level keeps a
+ * bitmap of its non-empty slots, so the time to the next deadline is
+ * found without looking at any timer, and an event loop can sleep
+ * exactly that long.
+ *
+ * Not thread-safe; each event loop owns one.
+ */
+class TimerWheel {
+public:
+  explicit TimerWheel(uint64_t now_ms = monotonic_ms());
+
+  TimerWheel(const TimerWheel&) = delete;
+  TimerWheel& operator=(const TimerWheel&) = delete;
+
+  /*
+   * Arm node to fire at deadline_ms, moving it if it is already pending
+   */
+  void schedule(TimerNode* node, uint64_t deadline_ms);
+
+  void cancel(TimerNode* node);
+
+  /*
+   * Milliseconds until the wheel next needs advance(), for use as a
+   * poll timeout: -1 with no timers pending, 0 if something is due
+   */
+  int next_timeout_ms(uint64_t now_ms) const;
+
+  /*
+   * Run the wheel up to now_ms and append every timer that fired to
+   * expired; they are no longer pending
+   */
+  void advance(uint64_t now_ms, std::vector<TimerNode*>& expired);
+
+  size_t size() const { return count; }
+
+private:
+  void link(TimerNode* node);
+  void unlink(TimerNode* node);
+  void cascade(unsigned level, size_t slot);
+
+  TimerNode slots[TIMER_LEVELS][TIMER_SLOTS];  // List heads (circular, sentinel)
+  uint64_t occupied[TIMER_LEVELS];             // Bit per non-empty slot
+  uint64_t current_tick;                       // Last tick processed
+  size_t count;
+};
@@ -0,0 +1,90 @@
+#include <cerrno>
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "include/load_shedder.h"
+#include "include/http_header.h"
+#include "include/request_metrics.h"
+
+static std::atomic<uint64_t> g_connections_shed{0};
+
+/*
+ * The whole 503, rendered once. It carries no Date header: computing one
+ * per shed connection is exactly the work shedding is meant to avoid.
+ */
+static const std::string& overload_response() {
+  static const std::string response = [] {
+    static const char body[] = "503: Server overloaded, retry later\n";
+    HeaderBuilder header("HTTP/1.1", 503);
+    header.add("Retry-After", SHED_RETRY_AFTER_SECONDS)
+          .add("Content-Type", "text/plain")
+          .add("Content-Length", sizeof(body) - 1)
+          .add("Connection", "close")
+          .finish();
+    return std::string(header.data(), header.size()) + body;
+  }();
+  return response;
+}
+
+void shed_connection(int fd) {
+  const std::string& response = overload_response();
+  while (send(fd, response.data(), response.size(), MSG_DONTWAIT | MSG_NOSIGNAL) < 0 &&
+         errno == EINTR) {
+  }
+
+  // Closing with unread request bytes would reset the connection and
+  // could discard the 503 before the client reads it
+  shutdown(fd, SHUT_WR);
+  char discard[4096];
+  while (recv(fd, discard, sizeof(discard), MSG_DONTWAIT) > 0) {
+  }
+  close(fd);
+  record_connection_closed();
+
+  g_connections_shed.fetch_add(1, std::memory_order_relaxed);
+}
+
+uint64_t connections_shed() {
+  return g_connections_shed.load(std::memory_order_relaxed);
+}
+
+/* ----------------------------
+ * LoadShedder
+ * ---------------------------- */
+
+void LoadShedder::configure(uint32_t target_ms) {
+  target_us = static_cast<uint64_t>(target_ms) * 1000;
+  window_end_us.store(monotonic_us() + SHED_INTERVAL_MS * 1000, std::memory_order_relaxed);
+}
+
+void LoadShedder::record(uint64_t delay_us, uint64_t now_us) {
+  if (!enabled()) {
+    return;
+  }
+
+  uint64_t seen = window_min_us.load(std::memory_order_relaxed);
+  while (delay_us < seen &&
+         !window_min_us.compare_exchange_weak(seen, delay_us, std::memory_order_relaxed)) {
+  }
+
+  // Whoever first records past the window's end closes it
+  uint64_t end = window_end_us.load(std::memory_order_relaxed);
+  if (now_us < end ||
+      !window_end_us.compare_exchange_strong(end, now_us + SHED_INTERVAL_MS * 1000,
+                                             std::memory_order_relaxed)) {
+    return;
+  }
+  uint64_t window_min = window_min_us.exchange(UINT64_MAX, std::memory_order_relaxed);
+  if (window_min != UINT64_MAX) {
+    standing.store(window_min > target_us, std::memory_order_relaxed);
+  }
+}
+
+bool LoadShedder::too_late(uint64_t delay_us) const {
+  if (!enabled()) {
+    return false;
+  }
+  uint64_t allowed = overloaded() ? target_us : SHED_INTERVAL_MS * 1000;
+  return delay_us > allowed;
+}
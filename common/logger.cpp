@@ -0,0 +1,284 @@
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "logger.h"
+
+/*
+ * One thread's records. The thread is the only producer and the writer
+ * thread the only consumer, so head and tail are all the coordination
+ * there is; they sit on separate cache lines so the two never contend.
+ */
+struct LogRing {
+  LogRecord slots[LOG_RING_SLOTS];
+  alignas(64) std::atomic<uint64_t> head{0};  // Records published by the thread
+  alignas(64) std::atomic<uint64_t> tail{0};  // Records consumed by the writer
+  std::atomic<uint64_t> dropped{0};           // Written by the thread only
+  std::atomic<bool> retired{false};           // Thread has exited; free once drained
+};
+
+/*
+ * Every ring, the writer thread, and the lines formatted but not yet
+ * written. Created on the first log call and never destroyed, so threads
+ * still logging while the process exits find it intact.
+ */
+class LogWriter {
+public:
+  LogWriter() {
+    std::thread(&LogWriter::run, this).detach();
+    std::atexit(Logger::flush);
+  }
+
+  LogRing* attach() {
+    LogRing* ring = new LogRing();
+    std::lock_guard<std::mutex> lock(rings_mutex);
+    rings.push_back(ring);
+    return ring;
+  }
+
+  void drain();
+  uint64_t dropped();
+
+private:
+  void run() {
+    while (true) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(LOG_FLUSH_INTERVAL_MS));
+      drain();
+    }
+  }
+
+  void drain_ring(LogRing* ring);
+  static void write_all(int fd, std::string& text);
+
+  std::mutex rings_mutex;        // Guards rings and retired_dropped
+  std::vector<LogRing*> rings;
+  uint64_t retired_dropped = 0;  // Drops counted by rings already freed
+
+  std::mutex drain_mutex;        // One drain at a time; guards the rest
+  std::string out;               // Lines for stdout
+  std::string err;               // Lines for stderr
+  uint64_t reported_dropped = 0;
+};
+
+static LogWriter& writer() {
+  static LogWriter* instance = new LogWriter();
+  return *instance;
+}
+
+/*
+ * Retires the thread's ring when the thread exits
+ */
+struct RingOwner {
+  LogRing* ring = nullptr;
+
+  ~RingOwner() {
+    if (ring) {
+      ring->retired.store(true, std::memory_order_release);
+    }
+  }
+};
+
+static thread_local RingOwner t_ring;
+
+/* ----------------------------
+ * Producer side
+ * ---------------------------- */
+
+LogRecord* Logger::claim() {
+  if (!t_ring.ring) {
+    t_ring.ring = writer().attach();
+  }
+  LogRing& ring = *t_ring.ring;
+
+  uint64_t head = ring.head.load(std::memory_order_relaxed);
+  if (head - ring.tail.load(std::memory_order_acquire) == LOG_RING_SLOTS) {
+    ring.dropped.store(ring.dropped.load(std::memory_order_relaxed) + 1,
+                       std::memory_order_relaxed);
+    return nullptr;
+  }
+  return &ring.slots[head % LOG_RING_SLOTS];
+}
+
+void Logger::publish() {
+  LogRing& ring = *t_ring.ring;
+  ring.head.store(ring.head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+/*
+ * Store one argument, or as much of a string as still fits. An argument
+ * that does not fit at all is left out and its "{}" printed as is.
+ */
+void Logger::ArgWriter::put_bytes(LogArgType type, const void* data, size_t length) {
+  size_t room = sizeof(record.args) - record.arg_bytes;
+  unsigned char* slot = record.args + record.arg_bytes;
+
+  if (type == LOG_ARG_STRING) {
+    if (room < 1 + sizeof(uint16_t)) {
+      return;
+    }
+    uint16_t stored = static_cast<uint16_t>(std::min(length, room - 1 - sizeof(uint16_t)));
+    slot[0] = type;
+    memcpy(slot + 1, &stored, sizeof(stored));
+    memcpy(slot + 1 + sizeof(stored), data, stored);
+    record.arg_bytes = static_cast<uint16_t>(record.arg_bytes + 1 + sizeof(stored) + stored);
+    return;
+  }
+
+  if (room < 1 + length) {
+    return;
+  }
+  slot[0] = type;
+  memcpy(slot + 1, data, length);
+  record.arg_bytes = static_cast<uint16_t>(record.arg_bytes + 1 + length);
+}
+
+void Logger::flush() {
+  writer().drain();
+}
+
+uint64_t Logger::dropped() {
+  return writer().dropped();
+}
+
+/* ----------------------------
+ * Writer side
+ * ---------------------------- */
+
+/*
+ * Append the argument at `arg` as text; returns the next argument
+ */
+static const unsigned char* append_arg(const unsigned char* arg, std::string& line) {
+  char digits[24];
+  LogArgType type = static_cast<LogArgType>(arg[0]);
+  ++arg;
+
+  switch (type) {
+    case LOG_ARG_SIGNED: {
+      int64_t value;
+      memcpy(&value, arg, sizeof(value));
+      line.append(digits, std::to_chars(digits, digits + sizeof(digits), value).ptr);
+      return arg + sizeof(value);
+    }
+    case LOG_ARG_UNSIGNED: {
+      uint64_t value;
+      memcpy(&value, arg, sizeof(value));
+      line.append(digits, std::to_chars(digits, digits + sizeof(digits), value).ptr);
+      return arg + sizeof(value);
+    }
+    case LOG_ARG_CHAR:
+      line += static_cast<char>(arg[0]);
+      return arg + 1;
+
+    case LOG_ARG_STRING: {
+      uint16_t length;
+      memcpy(&length, arg, sizeof(length));
+      arg += sizeof(length);
+      line.append(reinterpret_cast<const char*>(arg), length);
+      return arg + length;
+    }
+  }
+  return arg;
+}
+
+static void format_record(const LogRecord& record, std::string& line) {
+  const unsigned char* arg = record.args;
+  const unsigned char* end = record.args + record.arg_bytes;
+
+  for (const char* c = record.format; *c != '\0'; ++c) {
+    if (c[0] == '{' && c[1] == '}' && arg < end) {
+      arg = append_arg(arg, line);
+      ++c;
+    } else {
+      line += *c;
+    }
+  }
+  line += '\n';
+}
+
+void LogWriter::drain_ring(LogRing* ring) {
+  uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+  uint64_t head = ring->head.load(std::memory_order_acquire);
+
+  for (; tail != head; ++tail) {
+    const LogRecord& record = ring->slots[tail % LOG_RING_SLOTS];
+    format_record(record, record.level >= LogLevel::WARN ? err : out);
+  }
+  // Hands the slots back to the thread
+  ring->tail.store(tail, std::memory_order_release);
+}
+
+void LogWriter::drain() {
+  std::lock_guard<std::mutex> drain_lock(drain_mutex);
+
+  std::vector<LogRing*> snapshot;
+  {
+    std::lock_guard<std::mutex> lock(rings_mutex);
+    snapshot = rings;
+  }
+
+  std::vector<LogRing*> finished;
+  for (LogRing* ring : snapshot) {
+    // Read before draining: everything a retired thread logged is in by now
+    bool retired = ring->retired.load(std::memory_order_acquire);
+    drain_ring(ring);
+    if (retired) {
+      finished.push_back(ring);
+    }
+  }
+
+  if (!finished.empty()) {
+    std::lock_guard<std::mutex> lock(rings_mutex);
+    for (LogRing* ring : finished) {
+      retired_dropped += ring->dropped.load(std::memory_order_relaxed);
+      rings.erase(std::find(rings.begin(), rings.end(), ring));
+      delete ring;
+    }
+  }
+
+  uint64_t total_dropped = dropped();
+  if (total_dropped > reported_dropped) {
+    err += "[Log] Dropped ";
+    err += std::to_string(total_dropped - reported_dropped);
+    err += " records, log rings full\n";
+    reported_dropped = total_dropped;
+  }
+
+  write_all(STDOUT_FILENO, out);
+  write_all(STDERR_FILENO, err);
+}
+
+uint64_t LogWriter::dropped() {
+  std::lock_guard<std::mutex> lock(rings_mutex);
+  uint64_t total = retired_dropped;
+  for (const LogRing* ring : rings) {
+    total += ring->dropped.load(std::memory_order_relaxed);
+  }
+  return total;
+}
+
+/*
+ * Write and clear `text`. Only this thread ever waits on a slow stdout.
+ */
+void LogWriter::write_all(int fd, std::string& text) {
+  size_t written = 0;
+  while (written < text.size()) {
+    ssize_t rc = ::write(fd, text.data() + written, text.size() - written);
+    if (rc < 0 && errno == EINTR) {
+      continue;
+    }
+    if (rc <= 0) {
+      break;  // Nowhere to log to; the lines are lost
+    }
+    written += static_cast<size_t>(rc);
+  }
+  text.clear();
+}
@@ -0,0 +1,103 @@
+#include "include/mime_types.h"
+#include "include/static_map.h"
+
+/*
+ * Longest extension in the table; anything longer cannot match
+ */
+constexpr size_t MAX_EXTENSION_LENGTH = 11;
+
+typedef StaticMap<const char*, 256> MimeMap;
+
+static constexpr MimeMap::Entry MIME_ENTRIES[] = {
+  // Text and documents
+  { "html",  "text/html" },
+  { "htm",   "text/html" },
+  { "css",   "text/css" },
+  { "txt",   "text/plain" },
+  { "csv",   "text/csv" },
+  { "md",    "text/markdown" },
+  { "xml",   "application/xml" },
+  { "js",    "text/javascript" },
+  { "mjs",   "text/javascript" },
+  { "json",  "application/json" },
+  { "map",   "application/json" },
+  { "webmanifest", "application/manifest+json" },
+  { "pdf",   "application/pdf" },
+  { "wasm",  "application/wasm" },
+  { "rtf",   "application/rtf" },
+
+  // Images
+  { "gif",   "image/gif" },
+  { "jpg",   "image/jpeg" },
+  { "jpeg",  "image/jpeg" },
+  { "png",   "image/png" },
+  { "webp",  "image/webp" },
+  { "avif",  "image/avif" },
+  { "svg",   "image/svg+xml" },
+  { "ico",   "image/vnd.microsoft.icon" },
+  { "bmp",   "image/bmp" },
+  { "tif",   "image/tiff" },
+  { "tiff",  "image/tiff" },
+
+  // Fonts
+  { "woff",  "font/woff" },
+  { "woff2", "font/woff2" },
+  { "ttf",   "font/ttf" },
+  { "otf",   "font/otf" },
+  { "eot",   "application/vnd.ms-fontobject" },
+
+  // Audio and video
+  { "mp3",   "audio/mpeg" },
+  { "ogg",   "audio/ogg" },
+  { "oga",   "audio/ogg" },
+  { "wav",   "audio/wav" },
+  { "flac",  "audio/flac" },
+  { "aac",   "audio/aac" },
+  { "m4a",   "audio/mp4" },
+  { "mp4",   "video/mp4" },
+  { "m4v",   "video/mp4" },
+  { "webm",  "video/webm" },
+  { "ogv",   "video/ogg" },
+  { "mov",   "video/quicktime" },
+  { "avi",   "video/x-msvideo" },
+
+  // Archives and binaries
+  { "zip",   "application/zip" },
+  { "gz",    "application/gzip" },
+  { "tgz",   "application/gzip" },
+  { "tar",   "application/x-tar" },
+  { "bz2",   "application/x-bzip2" },
+  { "xz",    "application/x-xz" },
+  { "7z",    "application/x-7z-compressed" },
+  { "bin",   "application/octet-stream" },
+  { "exe",   "application/octet-stream" },
+  { "iso",   "application/octet-stream" },
+};
+
+static constexpr MimeMap MIME_TYPES(MIME_ENTRIES);
+
+std::string_view file_extension(std::string_view path) {
+  size_t slash = path.rfind('/');
+  size_t dot = path.rfind('.');
+  if (dot == std::string_view::npos || (slash != std::string_view::npos && dot < slash)) {
+    return std::string_view();
+  }
+  return path.substr(dot + 1);
+}
+
+const char* mime_type_for(std::string_view filename) {
+  std::string_view extension = file_extension(filename);
+  if (extension.empty() || extension.size() > MAX_EXTENSION_LENGTH) {
+    return DEFAULT_MIME_TYPE;
+  }
+
+  // Table keys are lower case
+  char lowered[MAX_EXTENSION_LENGTH];
+  for (size_t i = 0; i < extension.size(); ++i) {
+    char c = extension[i];
+    lowered[i] = (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+  }
+
+  const char* const* type = MIME_TYPES.find(std::string_view(lowered, extension.size()));
+  return type ? *type : DEFAULT_MIME_TYPE;
+}
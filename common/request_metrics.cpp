@@ -0,0 +1,368 @@
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "include/request_metrics.h"
+#include "include/http_header.h"
+
+/*
+ * Status codes with a histogram slot of their own
+ */
+constexpr int FIRST_STATUS = 100;
+constexpr int LAST_STATUS = 599;
+constexpr size_t STATUS_SLOTS = LAST_STATUS - FIRST_STATUS + 1;
+
+constexpr size_t CLASSES = static_cast<size_t>(RequestClass::COUNT);
+constexpr size_t PHASES = static_cast<size_t>(RequestPhase::COUNT);
+
+static const char* const CLASS_NAMES[CLASSES] = { "static", "cgi", "metrics", "rejected" };
+static const char* const PHASE_NAMES[PHASES] = { "queue", "read", "respond" };
+
+// Upper bounds of the exported histogram buckets, in microseconds
+static const uint64_t EXPORTED_BOUNDS_US[] = {
+  100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000,
+  100000, 250000, 500000, 1000000, 2500000, 5000000, 10000000
+};
+
+static const double QUANTILES[] = { 0.5, 0.9, 0.99, 0.999 };
+
+/* ----------------------------
+ * LatencyHistogram
+ * ---------------------------- */
+
+// The owning thread is the only writer, so a load and a store make an increment
+static inline void bump(std::atomic<uint64_t>& counter, uint64_t amount) {
+  counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+}
+
+void LatencyHistogram::record(uint64_t value_us) {
+  bump(counts[bucket_of(value_us)], 1);
+  bump(sum, value_us);
+}
+
+size_t LatencyHistogram::bucket_of(uint64_t value_us) {
+  constexpr uint64_t largest = (uint64_t(1) << HISTOGRAM_MAX_BITS) - 1;
+  constexpr uint64_t linear = uint64_t(1) << HISTOGRAM_SUB_BITS;
+
+  if (value_us > largest) {
+    value_us = largest;
+  }
+  if (value_us < linear) {
+    return static_cast<size_t>(value_us);
+  }
+  unsigned magnitude = 63 - static_cast<unsigned>(__builtin_clzll(value_us));
+  unsigned shift = magnitude - HISTOGRAM_SUB_BITS;
+  return (size_t(shift + 1) << HISTOGRAM_SUB_BITS) +
+         static_cast<size_t>((value_us >> shift) - linear);
+}
+
+uint64_t LatencyHistogram::bucket_highest(size_t bucket) {
+  constexpr size_t linear = size_t(1) << HISTOGRAM_SUB_BITS;
+
+  if (bucket < linear) {
+    return bucket;
+  }
+  unsigned shift = static_cast<unsigned>(bucket >> HISTOGRAM_SUB_BITS) - 1;
+  uint64_t lowest = static_cast<uint64_t>((bucket & (linear - 1)) + linear) << shift;
+  return lowest + (uint64_t(1) << shift) - 1;
+}
+
+/* ----------------------------
+ * Per-thread recording
+ * ---------------------------- */
+
+/*
+ * One thread's histograms and counters. Histograms are allocated the
+ * first time the thread records into them and published with a release
+ * store, so a scrape sees either nothing or a whole histogram.
+ */
+struct ThreadRequestMetrics {
+  std::atomic<LatencyHistogram*> totals[CLASSES][STATUS_SLOTS] = {};
+  std::atomic<LatencyHistogram*> phases[PHASES] = {};
+  std::atomic<uint64_t> bytes_sent{0};
+  std::atomic<uint64_t> connections_opened{0};
+  std::atomic<uint64_t> connections_closed{0};
+};
+
+/*
+ * Every thread's block, including blocks of threads that have exited,
+ * which wait in `retired` for the next new thread. Created on first use
+ * and never destroyed, so threads still recording while the process
+ * exits find it intact.
+ */
+class RequestMetricsRegistry {
+public:
+  ThreadRequestMetrics* attach() {
+    std::lock_guard<std::mutex> lock(blocks_mutex);
+    if (!retired.empty()) {
+      ThreadRequestMetrics* block = retired.back();
+      retired.pop_back();
+      return block;
+    }
+    blocks.push_back(new ThreadRequestMetrics());
+    return blocks.back();
+  }
+
+  void retire(ThreadRequestMetrics* block) {
+    std::lock_guard<std::mutex> lock(blocks_mutex);
+    retired.push_back(block);
+  }
+
+  template <typename Visit>
+  void for_each(Visit visit) {
+    std::lock_guard<std::mutex> lock(blocks_mutex);
+    for (const ThreadRequestMetrics* block : blocks) {
+      visit(*block);
+    }
+  }
+
+private:
+  std::mutex blocks_mutex;  // Guards both lists; taken once per thread and per scrape
+  std::vector<ThreadRequestMetrics*> blocks;
+  std::vector<ThreadRequestMetrics*> retired;
+};
+
+static RequestMetricsRegistry& registry() {
+  static RequestMetricsRegistry* instance = new RequestMetricsRegistry();
+  return *instance;
+}
+
+/*
+ * Hands the thread's block back when the thread exits
+ */
+struct BlockOwner {
+  ThreadRequestMetrics* block = nullptr;
+
+  ~BlockOwner() {
+    if (block) {
+      registry().retire(block);
+    }
+  }
+};
+
+static thread_local BlockOwner t_block;
+
+static ThreadRequestMetrics& local_metrics() {
+  if (!t_block.block) {
+    t_block.block = registry().attach();
+  }
+  return *t_block.block;
+}
+
+static LatencyHistogram& local_histogram(std::atomic<LatencyHistogram*>& slot) {
+  LatencyHistogram* histogram = slot.load(std::memory_order_relaxed);
+  if (!histogram) {
+    histogram = new LatencyHistogram();
+    slot.store(histogram, std::memory_order_release);
+  }
+  return *histogram;
+}
+
+RequestClass request_class(RouteKind kind) {
+  switch (kind) {
+    case RouteKind::STATIC:  return RequestClass::STATIC;
+    case RouteKind::CGI:     return RequestClass::CGI;
+    case RouteKind::METRICS: return RequestClass::METRICS;
+  }
+  return RequestClass::REJECTED;
+}
+
+void record_request(RequestClass kind, int status, uint64_t total_us) {
+  if (status < FIRST_STATUS || status > LAST_STATUS) {
+    return;
+  }
+  ThreadRequestMetrics& metrics = local_metrics();
+  local_histogram(metrics.totals[static_cast<size_t>(kind)][status - FIRST_STATUS]).record(total_us);
+}
+
+void record_phase(RequestPhase phase, uint64_t duration_us) {
+  local_histogram(local_metrics().phases[static_cast<size_t>(phase)]).record(duration_us);
+}
+
+void record_bytes_sent(uint64_t bytes) {
+  bump(local_metrics().bytes_sent, bytes);
+}
+
+void record_connection_opened() {
+  bump(local_metrics().connections_opened, 1);
+}
+
+void record_connection_closed() {
+  bump(local_metrics().connections_closed, 1);
+}
+
+/* ----------------------------
+ * Scraping
+ * ---------------------------- */
+
+/*
+ * Histograms of one series from every thread, added up
+ */
+struct MergedHistogram {
+  std::vector<uint64_t> counts;
+  uint64_t sum_us = 0;
+  uint64_t total = 0;
+
+  void add(const LatencyHistogram& histogram) {
+    if (counts.empty()) {
+      counts.assign(HISTOGRAM_BUCKETS, 0);
+    }
+    for (size_t i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+      uint64_t count = histogram.count(i);
+      counts[i] += count;
+      total += count;
+    }
+    sum_us += histogram.sum_us();
+  }
+
+  // Highest value of the bucket holding the q-th recorded value
+  uint64_t quantile(double q) const {
+    uint64_t rank = static_cast<uint64_t>(std::ceil(q * static_cast<double>(total)));
+    if (rank == 0) {
+      rank = 1;
+    }
+    uint64_t seen = 0;
+    for (size_t i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+      seen += counts[i];
+      if (seen >= rank) {
+        return LatencyHistogram::bucket_highest(i);
+      }
+    }
+    return LatencyHistogram::bucket_highest(HISTOGRAM_BUCKETS - 1);
+  }
+
+  // Values in buckets wholly at or below bound_us
+  uint64_t at_most(uint64_t bound_us) const {
+    uint64_t below = 0;
+    for (size_t i = 0; i < HISTOGRAM_BUCKETS && LatencyHistogram::bucket_highest(i) <= bound_us; ++i) {
+      below += counts[i];
+    }
+    return below;
+  }
+};
+
+static void append_double(std::string& out, double value) {
+  char text[32];
+  int length = std::snprintf(text, sizeof(text), "%.9g", value);
+  out.append(text, static_cast<size_t>(length));
+}
+
+static void append_seconds(std::string& out, uint64_t us) {
+  append_double(out, static_cast<double>(us) / 1e6);
+}
+
+static void append_header(std::string& out, const char* name, const char* type, const char* help) {
+  out.append("# HELP ").append(name).append(" ").append(help).append("\n");
+  out.append("# TYPE ").append(name).append(" ").append(type).append("\n");
+}
+
+// name{labels,quantile="q"} for each quantile, then name_sum{labels} and name_count{labels}
+static void append_summary(std::string& out, const char* name, const std::string& labels,
+                           const MergedHistogram& merged) {
+  for (double q : QUANTILES) {
+    out.append(name).append("{").append(labels).append(",quantile=\"");
+    append_double(out, q);
+    out.append("\"} ");
+    append_seconds(out, merged.quantile(q));
+    out += '\n';
+  }
+  out.append(name).append("_sum{").append(labels).append("} ");
+  append_seconds(out, merged.sum_us);
+  out.append("\n").append(name).append("_count{").append(labels).append("} ");
+  append_number(out, merged.total);
+  out += '\n';
+}
+
+void append_request_metrics(std::string& out) {
+  std::vector<MergedHistogram> totals(CLASSES * STATUS_SLOTS);
+  std::vector<MergedHistogram> phases(PHASES);
+  uint64_t bytes_sent = 0, opened = 0, closed = 0;
+
+  registry().for_each([&](const ThreadRequestMetrics& block) {
+    for (size_t kind = 0; kind < CLASSES; ++kind) {
+      for (size_t slot = 0; slot < STATUS_SLOTS; ++slot) {
+        const LatencyHistogram* histogram = block.totals[kind][slot].load(std::memory_order_acquire);
+        if (histogram) {
+          totals[kind * STATUS_SLOTS + slot].add(*histogram);
+        }
+      }
+    }
+    for (size_t phase = 0; phase < PHASES; ++phase) {
+      const LatencyHistogram* histogram = block.phases[phase].load(std::memory_order_acquire);
+      if (histogram) {
+        phases[phase].add(*histogram);
+      }
+    }
+    bytes_sent += block.bytes_sent.load(std::memory_order_relaxed);
+    opened += block.connections_opened.load(std::memory_order_relaxed);
+    closed += block.connections_closed.load(std::memory_order_relaxed);
+  });
+
+  auto series_labels = [](size_t index) {
+    std::string labels = "class=\"";
+    labels.append(CLASS_NAMES[index / STATUS_SLOTS]).append("\",code=\"");
+    append_number(labels, FIRST_STATUS + index % STATUS_SLOTS);
+    labels += '"';
+    return labels;
+  };
+
+  append_header(out, "http_request_duration_seconds", "histogram",
+                "Time from the start of a request to the last byte of its response");
+  for (size_t i = 0; i < totals.size(); ++i) {
+    if (totals[i].total == 0) {
+      continue;
+    }
+    std::string labels = series_labels(i);
+    for (uint64_t bound : EXPORTED_BOUNDS_US) {
+      out.append("http_request_duration_seconds_bucket{").append(labels).append(",le=\"");
+      append_seconds(out, bound);
+      out.append("\"} ");
+      append_number(out, totals[i].at_most(bound));
+      out += '\n';
+    }
+    out.append("http_request_duration_seconds_bucket{").append(labels).append(",le=\"+Inf\"} ");
+    append_number(out, totals[i].total);
+    out.append("\nhttp_request_duration_seconds_sum{").append(labels).append("} ");
+    append_seconds(out, totals[i].sum_us);
+    out.append("\nhttp_request_duration_seconds_count{").append(labels).append("} ");
+    append_number(out, totals[i].total);
+    out += '\n';
+  }
+
+  append_header(out, "http_request_latency_seconds", "summary",
+                "Quantiles of http_request_duration_seconds, to within 3%");
+  for (size_t i = 0; i < totals.size(); ++i) {
+    if (totals[i].total > 0) {
+      append_summary(out, "http_request_latency_seconds", series_labels(i), totals[i]);
+    }
+  }
+
+  append_header(out, "http_request_phase_seconds", "summary",
+                "Time requests spent in each phase, to within 3%");
+  for (size_t phase = 0; phase < PHASES; ++phase) {
+    if (phases[phase].total > 0) {
+      std::string labels = "phase=\"";
+      labels.append(PHASE_NAMES[phase]).append("\"");
+      append_summary(out, "http_request_phase_seconds", labels, phases[phase]);
+    }
+  }
+
+  append_metric(out, "bytes_sent_total", "counter", bytes_sent);
+  append_metric(out, "open_connections", "gauge", opened > closed ? opened - closed : 0);
+}
+
+void append_metric(std::string& out, const char* name, const char* type, uint64_t value) {
+  out.append("# TYPE ").append(name).append(" ").append(type).append("\n");
+  out.append(name).append(" ");
+  append_number(out, value);
+  out += '\n';
+}
+
+void append_metric(std::string& out, const char* name, const char* type, double value) {
+  out.append("# TYPE ").append(name).append(" ").append(type).append("\n");
+  out.append(name).append(" ");
+  append_double(out, value);
+  out += '\n';
+}
@@ -0,0 +1,167 @@
+#include <cerrno>
+#include <cstring>
+#include <iterator>
+#include <unistd.h>
+
+#include "include/response_cache.h"
+#include "include/http_header.h"
+
+ResponseCache g_response_cache;
+
+ResponseCache::ResponseCache(size_t max_file, size_t memory_budget)
+  : hit_count(0), miss_count(0), eviction_count(0) {
+  configure(max_file, memory_budget);
+}
+
+void ResponseCache::configure(size_t max_file, size_t memory_budget) {
+  max_file_size = max_file;
+  shard_budget  = memory_budget / RESPONSE_CACHE_SHARDS;
+}
+
+std::shared_ptr<const std::string> ResponseCache::find(const CachedFile& file, int variant) {
+  if (!cacheable(file)) {
+    return nullptr;
+  }
+
+  std::string key = make_key(file, variant);
+  Shard& shard = shard_for(key);
+  std::lock_guard<std::mutex> lock(shard.mutex);
+
+  auto it = shard.entries.find(key);
+  if (it == shard.entries.end()) {
+    miss_count.fetch_add(1, std::memory_order_relaxed);
+    return nullptr;
+  }
+
+  Entry& entry = *it->second;
+  if (entry.size != file.size ||
+      entry.mtime.tv_sec != file.mtime.tv_sec ||
+      entry.mtime.tv_nsec != file.mtime.tv_nsec) {
+    erase(shard, it->second);
+    miss_count.fetch_add(1, std::memory_order_relaxed);
+    return nullptr;
+  }
+
+  // Responses already handed out keep the buffer they were given
+  time_t now = time(nullptr);
+  if (entry.date_offset != std::string::npos && entry.date_second != now) {
+    std::shared_ptr<std::string> patched = std::make_shared<std::string>(*entry.response);
+    memcpy(&(*patched)[entry.date_offset], http_date(now), HTTP_DATE_LENGTH);
+    entry.response    = patched;
+    entry.date_second = now;
+  }
+
+  shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+  hit_count.fetch_add(1, std::memory_order_relaxed);
+  return entry.response;
+}
+
+std::shared_ptr<const std::string> ResponseCache::store(const CachedFile& file, int variant,
+                                                        std::string_view header) {
+  if (!cacheable(file) || file.fd < 0) {
+    return nullptr;
+  }
+
+  // Render outside the lock: header, then the body read from the cached fd
+  size_t body_size = static_cast<size_t>(file.size);
+  std::shared_ptr<std::string> response = std::make_shared<std::string>(header);
+  response->resize(header.size() + body_size);
+
+  size_t done = 0;
+  while (done < body_size) {
+    ssize_t bytes_read = pread(file.fd, &(*response)[header.size() + done],
+                               body_size - done, static_cast<off_t>(done));
+    if (bytes_read < 0 && errno == EINTR) {
+      continue;
+    }
+    if (bytes_read <= 0) {
+      return nullptr;
+    }
+    done += static_cast<size_t>(bytes_read);
+  }
+
+  std::string key = make_key(file, variant);
+  size_t cost = key.size() + response->size();
+  if (cost > shard_budget) {
+    return response;
+  }
+
+  Shard& shard = shard_for(key);
+  std::lock_guard<std::mutex> lock(shard.mutex);
+
+  auto it = shard.entries.find(key);
+  if (it != shard.entries.end()) {
+    erase(shard, it->second);
+  }
+
+  Entry entry;
+  entry.key         = key;
+  entry.mtime       = file.mtime;
+  entry.size        = file.size;
+  entry.response    = response;
+  entry.date_offset = std::string::npos;
+  entry.date_second = 0;
+
+  size_t date_header = header.find("\r\nDate: ");
+  if (date_header != std::string_view::npos &&
+      date_header + 8 + HTTP_DATE_LENGTH <= header.size()) {
+    entry.date_offset = date_header + 8;
+    entry.date_second = time(nullptr);
+    memcpy(&(*response)[entry.date_offset], http_date(entry.date_second), HTTP_DATE_LENGTH);
+  }
+
+  shard.lru.push_front(std::move(entry));
+  shard.entries[key] = shard.lru.begin();
+  shard.bytes += cost;
+
+  while (shard.bytes > shard_budget) {
+    erase(shard, std::prev(shard.lru.end()));
+    eviction_count.fetch_add(1, std::memory_order_relaxed);
+  }
+  return response;
+}
+
+uint64_t ResponseCache::hits() const {
+  return hit_count.load(std::memory_order_relaxed);
+}
+
+uint64_t ResponseCache::misses() const {
+  return miss_count.load(std::memory_order_relaxed);
+}
+
+uint64_t ResponseCache::evictions() const {
+  return eviction_count.load(std::memory_order_relaxed);
+}
+
+size_t ResponseCache::bytes_used() {
+  size_t total = 0;
+  for (Shard& shard : shards) {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    total += shard.bytes;
+  }
+  return total;
+}
+
+bool ResponseCache::cacheable(const CachedFile& file) const {
+  return max_file_size > 0 && static_cast<size_t>(file.size) <= max_file_size;
+}
+
+std::string ResponseCache::make_key(const CachedFile& file, int variant) {
+  std::string key = file.path;
+  key += '\0';
+  key += static_cast<char>('0' + variant);
+  return key;
+}
+
+ResponseCache::Shard& ResponseCache::shard_for(const std::string& key) {
+  return shards[std::hash<std::string>()(key) % RESPONSE_CACHE_SHARDS];
+}
+
+/*
+ * Drop an entry; responses already handed out stay valid
+ */
+void ResponseCache::erase(Shard& shard, LruList::iterator it) {
+  shard.bytes -= it->key.size() + it->response->size();
+  shard.entries.erase(it->key);
+  shard.lru.erase(it);
+}
@@ -0,0 +1,32 @@
+#include "include/routes.h"
+#include "include/mime_types.h"
+#include "include/static_map.h"
+
+constexpr std::string_view CGI_PREFIX = "/cgi-bin/";
+
+typedef StaticMap<RouteKind, 16> RouteMap;
+
+static constexpr RouteMap::Entry ROUTE_ENTRIES[] = {
+  { "/metrics", RouteKind::METRICS },
+};
+
+static constexpr RouteMap BUILTIN_ROUTES(ROUTE_ENTRIES);
+
+Route route_request(std::string_view target) {
+  Route route;
+  size_t query_pos = target.find('?');
+  route.path  = target.substr(0, query_pos);
+  route.query = (query_pos == std::string_view::npos) ? std::string_view()
+                                                      : target.substr(query_pos + 1);
+
+  const RouteKind* builtin = BUILTIN_ROUTES.find(route.path);
+  if (builtin) {
+    route.kind = *builtin;
+  } else if (route.path.compare(0, CGI_PREFIX.size(), CGI_PREFIX) == 0 ||
+             file_extension(route.path) == "cgi") {
+    route.kind = RouteKind::CGI;
+  } else {
+    route.kind = RouteKind::STATIC;
+  }
+  return route;
+}
@@ -0,0 +1,177 @@
+#include <climits>
+#include <time.h>
+
+#include "include/timer_wheel.h"
+
+static_assert(TIMER_SLOTS == 64, "occupancy bitmaps assume 64 slots per level");
+
+uint64_t monotonic_ms() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return static_cast<uint64_t>(now.tv_sec) * 1000 + static_cast<uint64_t>(now.tv_nsec) / 1000000;
+}
+
+uint64_t monotonic_us() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return static_cast<uint64_t>(now.tv_sec) * 1000000 + static_cast<uint64_t>(now.tv_nsec) / 1000;
+}
+
+static inline uint64_t rotate_right(uint64_t bits, unsigned count) {
+  count &= 63;
+  return count == 0 ? bits : (bits >> count) | (bits << (64 - count));
+}
+
+TimerWheel::TimerWheel(uint64_t now_ms)
+  : current_tick(now_ms / TIMER_TICK_MS), count(0) {
+  for (unsigned level = 0; level < TIMER_LEVELS; ++level) {
+    occupied[level] = 0;
+    for (size_t slot = 0; slot < TIMER_SLOTS; ++slot) {
+      slots[level][slot].prev = &slots[level][slot];
+      slots[level][slot].next = &slots[level][slot];
+    }
+  }
+}
+
+void TimerWheel::schedule(TimerNode* node, uint64_t deadline_ms) {
+  if (node->pending()) {
+    unlink(node);
+  } else {
+    count++;
+  }
+
+  // Round up, so a timer never fires before its deadline; one already
+  // due fires on the next tick
+  uint64_t expires = (deadline_ms + TIMER_TICK_MS - 1) / TIMER_TICK_MS;
+  node->expires = expires > current_tick ? expires : current_tick + 1;
+  link(node);
+}
+
+void TimerWheel::cancel(TimerNode* node) {
+  if (node->pending()) {
+    unlink(node);
+    count--;
+  }
+}
+
+int TimerWheel::next_timeout_ms(uint64_t now_ms) const {
+  if (count == 0) {
+    return -1;
+  }
+
+  // Earliest tick at which some non-empty slot is processed: expired
+  // on level 0, cascaded one level down on the others
+  uint64_t next_tick = UINT64_MAX;
+  for (unsigned level = 0; level < TIMER_LEVELS; ++level) {
+    if (occupied[level] == 0) {
+      continue;
+    }
+    unsigned shift = level * TIMER_LEVEL_BITS;
+    uint64_t base = current_tick >> shift;
+    uint64_t ahead = rotate_right(occupied[level], static_cast<unsigned>(base + 1));
+    uint64_t tick = (base + 1 + static_cast<uint64_t>(__builtin_ctzll(ahead))) << shift;
+    if (tick < next_tick) {
+      next_tick = tick;
+    }
+  }
+
+  uint64_t due_ms = next_tick * TIMER_TICK_MS;
+  if (due_ms <= now_ms) {
+    return 0;
+  }
+  uint64_t wait = due_ms - now_ms;
+  return wait > INT_MAX ? INT_MAX : static_cast<int>(wait);
+}
+
+void TimerWheel::advance(uint64_t now_ms, std::vector<TimerNode*>& expired) {
+  uint64_t target = now_ms / TIMER_TICK_MS;
+
+  if (count == 0) {
+    if (target > current_tick) {
+      current_tick = target;
+    }
+    return;
+  }
+
+  while (current_tick < target) {
+    current_tick++;
+
+    // At each level boundary, pull the next slot of the level above down
+    for (unsigned level = 1; level < TIMER_LEVELS; ++level) {
+      unsigned shift = (level - 1) * TIMER_LEVEL_BITS;
+      if ((current_tick >> shift) & (TIMER_SLOTS - 1)) {
+        break;
+      }
+      cascade(level, (current_tick >> (shift + TIMER_LEVEL_BITS)) & (TIMER_SLOTS - 1));
+    }
+
+    size_t slot = current_tick & (TIMER_SLOTS - 1);
+    TimerNode* head = &slots[0][slot];
+    while (head->next != head) {
+      TimerNode* node = head->next;
+      unlink(node);
+      count--;
+      expired.push_back(node);
+    }
+
+    if (count == 0) {
+      current_tick = target;
+    }
+  }
+}
+
+/*
+ * Put a timer in the finest level whose span covers its deadline
+ */
+void TimerWheel::link(TimerNode* node) {
+  uint64_t expires = node->expires;
+  uint64_t delta = expires - current_tick;
+
+  unsigned level = 0;
+  while (level + 1 < TIMER_LEVELS && delta >= (uint64_t(1) << ((level + 1) * TIMER_LEVEL_BITS))) {
+    level++;
+  }
+
+  // Past the top level's reach: park in its farthest slot and re-place later
+  uint64_t reach = uint64_t(1) << (TIMER_LEVELS * TIMER_LEVEL_BITS);
+  if (delta >= reach) {
+    expires = current_tick + reach - 1;
+  }
+
+  size_t slot = (expires >> (level * TIMER_LEVEL_BITS)) & (TIMER_SLOTS - 1);
+  TimerNode* head = &slots[level][slot];
+
+  node->prev = head->prev;
+  node->next = head;
+  head->prev->next = node;
+  head->prev = node;
+  occupied[level] |= uint64_t(1) << slot;
+}
+
+void TimerWheel::unlink(TimerNode* node) {
+  TimerNode* next = node->next;
+  node->prev->next = next;
+  next->prev = node->prev;
+
+  // Emptied a slot: the sentinel heads are the only self-linked nodes
+  if (next == node->prev && next->next == next) {
+    size_t index = static_cast<size_t>(next - &slots[0][0]);
+    occupied[index / TIMER_SLOTS] &= ~(uint64_t(1) << (index % TIMER_SLOTS));
+  }
+
+  node->prev = nullptr;
+  node->next = nullptr;
+}
+
+/*
+ * Re-place every timer in one slot now that it is close enough for a
+ * finer level
+ */
+void TimerWheel::cascade(unsigned level, size_t slot) {
+  TimerNode* head = &slots[level][slot];
+  while (head->next != head) {
+    TimerNode* node = head->next;
+    unlink(node);
+    link(node);
+  }
+}
@@ -0,0 +1,372 @@
+#include <charconv>
+#include <csignal>
+#include <cerrno>
+#include <cstring>
+#include <strings.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <unistd.h>
+#include <vector>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+#include "include/cgi_process.h"
+#include "include/connection.h"
+#include "include/request.h"
+#include "http_header.h"
+#include "http_parser.h"
+
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434
+#endif
+
+extern char** environ;
+
+static bool name_is(const std::string& line, size_t name_length, const char* name) {
+  return name_length == strlen(name) && strncasecmp(line.c_str(), name, name_length) == 0;
+}
+
+/*
+ * A reason phrase may hold tabs, spaces and visible characters only
+ * (RFC 9112, 4), so nothing a program sends can split the status line
+ */
+static bool valid_reason(const std::string& reason) {
+  for (unsigned char c : reason) {
+    if (c != '\t' && (c < 0x20 || c == 0x7f)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static std::string trim(const std::string& text) {
+  size_t start = text.find_first_not_of(" \t");
+  if (start == std::string::npos) {
+    return std::string();
+  }
+  size_t end = text.find_last_not_of(" \t");
+  return text.substr(start, end - start + 1);
+}
+
+CgiProcess::CgiProcess(Connection& client, pid_t child, int pipe_fd, bool allow_chunked)
+  : conn(&client),
+    owner(nullptr),
+    pid(child),
+    pidfd(-1),
+    output_fd(pipe_fd),
+    exited(false),
+    adopted(false),
+    output_armed(false),
+    exit_armed(false),
+    worker(nullptr),
+    request_id(0),
+    header_done(false),
+    chunked_allowed(allow_chunked),
+    framing(Framing::LENGTH),
+    body_remaining(0) {}
+
+CgiProcess::~CgiProcess() {
+  if (output_fd >= 0) {
+    close(output_fd);
+  }
+  if (pidfd >= 0) {
+    close(pidfd);
+  }
+}
+
+CgiProcess* CgiProcess::spawn(Connection& conn, const std::string& program,
+                              const std::string& query, bool allow_chunked) {
+  int pipe_fds[2];
+  if (pipe2(pipe_fds, O_CLOEXEC) != 0) {
+    return nullptr;
+  }
+  fcntl(pipe_fds[0], F_SETFL, O_NONBLOCK);
+
+  // The child's environment is ours with QUERY_STRING replaced
+  std::string query_variable = "QUERY_STRING=" + query;
+  std::vector<char*> envp;
+  for (char** variable = environ; *variable != nullptr; ++variable) {
+    if (strncmp(*variable, "QUERY_STRING=", 13) != 0) {
+      envp.push_back(*variable);
+    }
+  }
+  envp.push_back(const_cast<char*>(query_variable.c_str()));
+  envp.push_back(nullptr);
+
+  char* argv[] = { const_cast<char*>(program.c_str()), nullptr };
+
+  posix_spawn_file_actions_t actions;
+  posix_spawn_file_actions_init(&actions);
+  posix_spawn_file_actions_adddup2(&actions, pipe_fds[1], STDOUT_FILENO);
+  posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+
+  pid_t pid;
+  int rc = posix_spawn(&pid, program.c_str(), &actions, nullptr, argv, envp.data());
+  posix_spawn_file_actions_destroy(&actions);
+  close(pipe_fds[1]);
+
+  if (rc != 0) {
+    close(pipe_fds[0]);
+    errno = rc;
+    return nullptr;
+  }
+
+  CgiProcess* cgi = new CgiProcess(conn, pid, pipe_fds[0], allow_chunked);
+  cgi->pidfd = static_cast<int>(syscall(SYS_pidfd_open, pid, 0));
+  return cgi;
+}
+
+CgiProcess* CgiProcess::attach(Connection& conn, bool allow_chunked) {
+  CgiProcess* cgi = new CgiProcess(conn, -1, -1, allow_chunked);
+  cgi->exited = true;  // No child of our own to reap
+  return cgi;
+}
+
+bool CgiProcess::read_output() {
+  char chunk[CGI_READ_CHUNK_SIZE];
+  bool ended = false;
+
+  while (!ended && wants_output()) {
+    ssize_t bytes_read = read(output_fd, chunk, sizeof(chunk));
+
+    if (bytes_read > 0) {
+      ended = !relay(chunk, static_cast<size_t>(bytes_read));
+      continue;
+    }
+    if (bytes_read < 0 && errno == EINTR) {
+      continue;
+    }
+    if (bytes_read < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      return false;
+    }
+    ended = true;  // End of output, or a read error
+  }
+
+  // Otherwise paused until the client drains the queue
+  if (ended || !conn) {
+    end_output();
+  }
+  return conn == nullptr;
+}
+
+bool CgiProcess::relay(const char* data, size_t length) {
+  conn->last_active_ms = monotonic_ms();
+  if (header_done) {
+    queue_body(data, length);
+    return true;
+  }
+
+  header_buffer.append(data, length);
+  ParseStatus status = parse_header();
+  if (status == ParseStatus::COMPLETE) {
+    std::string body = std::move(header_buffer);
+    header_buffer.clear();
+    queue_body(body.data(), body.size());
+    return true;
+  }
+  // Else never a valid header block
+  return status == ParseStatus::INCOMPLETE && header_buffer.size() <= CGI_MAX_HEADER;
+}
+
+bool CgiProcess::wants_output() const {
+  return output_fd >= 0 && conn && conn->pending_bytes < MAX_PENDING_WRITE;
+}
+
+void CgiProcess::reap() {
+  if (exited) {
+    return;
+  }
+  pid_t rc;
+  do {
+    rc = waitpid(pid, nullptr, WNOHANG);
+  } while (rc < 0 && errno == EINTR);
+
+  if (rc == pid || (rc < 0 && errno == ECHILD)) {
+    exited = true;
+  }
+}
+
+void CgiProcess::close_output() {
+  if (output_fd >= 0) {
+    close(output_fd);
+    output_fd = -1;
+  }
+}
+
+void CgiProcess::abandon() {
+  if (!exited && pid > 0) {
+    kill(pid, SIGKILL);
+  }
+  conn = nullptr;
+  owner = nullptr;
+}
+
+/*
+ * Once the program's header block is complete, queue the response
+ * header built from it and leave any body bytes in header_buffer.
+ * INCOMPLETE while the block is still coming; ERROR for a block no
+ * valid response can be built from.
+ */
+ParseStatus CgiProcess::parse_header() {
+  // The block ends at the first empty line; programs use LF or CRLF
+  std::vector<std::string> lines;
+  size_t line_start = 0;
+  size_t body_start = std::string::npos;
+  while (true) {
+    size_t newline = header_buffer.find('\n', line_start);
+    if (newline == std::string::npos) {
+      return ParseStatus::INCOMPLETE;
+    }
+    size_t line_end = newline;
+    if (line_end > line_start && header_buffer[line_end - 1] == '\r') {
+      line_end--;
+    }
+    if (line_end == line_start) {
+      body_start = newline + 1;
+      break;
+    }
+    lines.push_back(header_buffer.substr(line_start, line_end - line_start));
+    line_start = newline + 1;
+  }
+
+  int status = 200;
+  std::string reason;
+  bool has_status = false;
+  bool has_location = false;
+  bool has_length = false;
+  std::string passed_through;
+
+  for (const std::string& line : lines) {
+    size_t colon = line.find(':');
+    if (colon == std::string::npos || colon == 0) {
+      continue;  // Not a header; drop it
+    }
+    std::string value = trim(line.substr(colon + 1));
+
+    if (name_is(line, colon, "Status")) {
+      int code = 0;
+      const char* end = value.data() + value.size();
+      std::from_chars_result result = std::from_chars(value.data(), end, code);
+      if (result.ec != std::errc() || code < 100 || code > 599 ||
+          (result.ptr != end && *result.ptr != ' ')) {
+        continue;  // Not a status; drop it
+      }
+      if (code < 200) {
+        return ParseStatus::ERROR;  // An interim status cannot end a response
+      }
+      status = code;
+      has_status = true;
+      reason = trim(std::string(result.ptr, end));
+      if (!valid_reason(reason)) {
+        reason.clear();
+      }
+      continue;
+    }
+    if (name_is(line, colon, "Connection") || name_is(line, colon, "Keep-Alive") ||
+        name_is(line, colon, "Transfer-Encoding")) {
+      continue;  // Hop-by-hop; the server decides these
+    }
+    if (name_is(line, colon, "Content-Length")) {
+      std::from_chars_result result =
+        std::from_chars(value.data(), value.data() + value.size(), body_remaining);
+      if (result.ec == std::errc() && result.ptr == value.data() + value.size()) {
+        has_length = true;
+      }
+      continue;  // Added below, once the status says there is a body
+    }
+    if (name_is(line, colon, "Location")) {
+      has_location = true;
+    }
+    passed_through.append(line).append("\r\n");
+  }
+
+  // A bare Location header is a redirect (RFC 3875, 6.2.3)
+  if (has_location && !has_status) {
+    status = 302;
+  }
+
+  if (status == 204 || status == 304) {
+    // No body and no framing header: anything the program prints is dropped
+    framing = Framing::LENGTH;
+    body_remaining = 0;
+  } else if (has_length) {
+    framing = Framing::LENGTH;
+    passed_through += "Content-Length: ";
+    append_number(passed_through, body_remaining);
+    passed_through += "\r\n";
+  } else if (chunked_allowed) {
+    framing = Framing::CHUNKED;
+    passed_through += "Transfer-Encoding: chunked\r\n";
+  } else {
+    framing = Framing::CLOSE;
+    conn->keep_alive = false;
+    conn->close_after_write = true;
+  }
+
+  conn->response_status = status;
+  HeaderBuilder header("HTTP/1.1", status, reason);
+  header.add("Server", "WebServer")
+        .add_date()
+        .add_raw(connection_header(*conn));
+
+  conn->queue_copy(header.data(), header.size());
+  conn->queue_copy(passed_through);
+  conn->queue_copy("\r\n", 2);
+
+  header_buffer.erase(0, body_start);
+  header_done = true;
+  return ParseStatus::COMPLETE;
+}
+
+void CgiProcess::queue_body(const char* data, size_t length) {
+  if (length == 0) {
+    return;
+  }
+
+  switch (framing) {
+    case Framing::LENGTH: {
+      // Anything past the promised length would corrupt the next response
+      size_t take = length < body_remaining ? length : static_cast<size_t>(body_remaining);
+      body_remaining -= take;
+      conn->queue_copy(data, take);
+      break;
+    }
+
+    case Framing::CHUNKED: {
+      char size_line[20];
+      std::to_chars_result result = std::to_chars(size_line, size_line + 16, length, 16);
+      result.ptr[0] = '\r';
+      result.ptr[1] = '\n';
+      conn->queue_copy(size_line, static_cast<size_t>(result.ptr + 2 - size_line));
+      conn->queue_copy(data, length);
+      conn->queue_copy("\r\n", 2);
+      break;
+    }
+
+    case Framing::CLOSE:
+      conn->queue_copy(data, length);
+      break;
+  }
+}
+
+void CgiProcess::end_output() {
+  if (!conn) {
+    return;
+  }
+
+  if (!header_done) {
+    send_error_response(*conn,
+                        502,
+                        "CGI program sent no valid header block",
+                        std::to_string(header_buffer.size()) + " bytes of output");
+  } else if (framing == Framing::CHUNKED) {
+    conn->queue_copy("0\r\n\r\n", 5);
+  } else if (framing == Framing::LENGTH && body_remaining > 0) {
+    // The body came up short; only closing tells the client
+    conn->keep_alive = false;
+    conn->close_after_write = true;
+  }
+
+  conn->cgi = nullptr;
+  conn = nullptr;
+}
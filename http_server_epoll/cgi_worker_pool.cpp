@@ -0,0 +1,228 @@
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "include/cgi_worker_pool.h"
+#include "include/cgi_process.h"
+#include "include/connection.h"
+#include "timer_wheel.h"
+#include "logger.h"
+
+static thread_local CgiWorkerPool* t_pool = nullptr;
+
+/*
+ * List each connection once: servicing one can free it
+ */
+static void add_touched(std::vector<Connection*>& touched, Connection* conn) {
+  if (std::find(touched.begin(), touched.end(), conn) == touched.end()) {
+    touched.push_back(conn);
+  }
+}
+
+bool CgiWorker::wants_read() const {
+  for (const auto& entry : requests) {
+    const Connection* conn = entry.second->conn;
+    if (conn && conn->pending_bytes >= MAX_PENDING_WRITE) {
+      return false;
+    }
+  }
+  return true;
+}
+
+CgiWorkerPool::~CgiWorkerPool() {
+  for (std::unique_ptr<CgiWorker>& worker : workers) {
+    for (auto& entry : worker->requests) {
+      delete entry.second;
+    }
+  }
+  if (t_pool == this) {
+    t_pool = nullptr;
+  }
+}
+
+CgiWorkerPool* CgiWorkerPool::for_this_thread() {
+  return t_pool;
+}
+
+void CgiWorkerPool::bind_to_this_thread() {
+  t_pool = this;
+}
+
+void CgiWorkerPool::start() {
+  uint64_t now = monotonic_ms();
+  for (const std::string& path : g_cgi_workers.paths) {
+    for (size_t i = 0; i < g_cgi_workers.workers_per_program; ++i) {
+      std::unique_ptr<CgiWorker> worker(new CgiWorker());
+      worker->path = path;
+      worker->program = "." + path;
+      if (!worker->process.start(worker->program, true, now)) {
+        LOG_ERROR("[Error] Could not start CGI worker {}", worker->program);
+      }
+      workers.push_back(std::move(worker));
+    }
+  }
+}
+
+/*
+ * The running worker for `path` with the fewest requests in flight
+ */
+CgiWorker* CgiWorkerPool::pick(std::string_view path) {
+  CgiWorker* best = nullptr;
+  for (std::unique_ptr<CgiWorker>& worker : workers) {
+    if (worker->path != path || !worker->process.running()) {
+      continue;
+    }
+    if (!best || worker->requests.size() < best->requests.size()) {
+      best = worker.get();
+    }
+  }
+  return best;
+}
+
+CgiProcess* CgiWorkerPool::submit(Connection& conn, std::string_view path,
+                                  const std::string& query, bool allow_chunked) {
+  CgiWorker* worker = pick(path);
+  if (!worker || worker->requests.size() >= UINT16_MAX) {
+    return nullptr;
+  }
+
+  // Ids wrap; 0 is never used and ids still in flight are skipped
+  uint16_t id = worker->next_request_id;
+  while (id == 0 || worker->requests.count(id) > 0) {
+    id++;
+  }
+  worker->next_request_id = static_cast<uint16_t>(id + 1);
+
+  CgiProcess* cgi = CgiProcess::attach(conn, allow_chunked);
+  cgi->worker = worker;
+  cgi->request_id = id;
+  worker->requests[id] = cgi;
+
+  append_cgi_frame(worker->outbound, CgiFrameType::BEGIN, id, query.data(), query.size());
+  flush(worker);  // A failure shows up as a hang-up on the socket
+  return cgi;
+}
+
+bool CgiWorkerPool::read(CgiWorker* worker, std::vector<Connection*>& touched) {
+  char chunk[CGI_READ_CHUNK_SIZE];
+
+  // Relaying after every chunk lets a client that falls behind stop the
+  // reads, so at most one chunk is queued past its limit
+  while (worker->wants_read()) {
+    ssize_t bytes_read = ::read(worker->process.fd(), chunk, sizeof(chunk));
+    if (bytes_read < 0 && errno == EINTR) {
+      continue;
+    }
+    if (bytes_read < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      return true;
+    }
+    if (bytes_read <= 0) {
+      return false;  // Hung up; what it sent before is relayed already
+    }
+    worker->reader.append(chunk, static_cast<size_t>(bytes_read));
+    if (!relay_frames(worker, touched)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/*
+ * Hand every complete frame in the reader to its request. Returns false
+ * if the worker broke the protocol.
+ */
+bool CgiWorkerPool::relay_frames(CgiWorker* worker, std::vector<Connection*>& touched) {
+  CgiFrame frame;
+  while (worker->reader.next(frame)) {
+    if (frame.type == CgiFrameType::BEGIN) {
+      return false;  // Only the server starts requests
+    }
+
+    auto it = worker->requests.find(frame.request_id);
+    if (it == worker->requests.end()) {
+      continue;  // Its client is gone
+    }
+    CgiProcess* cgi = it->second;
+    add_touched(touched, cgi->conn);
+
+    bool ok = frame.type == CgiFrameType::STDOUT &&
+              cgi->relay(frame.payload.data(), frame.payload.size());
+    if (!ok) {
+      cgi->end_output();
+      worker->requests.erase(it);
+      delete cgi;
+    }
+  }
+  return !worker->reader.failed();
+}
+
+bool CgiWorkerPool::flush(CgiWorker* worker) {
+  while (worker->wants_write()) {
+    ssize_t sent = send(worker->process.fd(),
+                        worker->outbound.data() + worker->outbound_offset,
+                        worker->outbound.size() - worker->outbound_offset,
+                        MSG_NOSIGNAL);
+    if (sent < 0 && errno == EINTR) {
+      continue;
+    }
+    if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      return true;
+    }
+    if (sent < 0) {
+      return false;
+    }
+    worker->outbound_offset += static_cast<size_t>(sent);
+  }
+
+  worker->outbound.clear();
+  worker->outbound_offset = 0;
+  return true;
+}
+
+void CgiWorkerPool::cancel(CgiProcess* cgi) {
+  cgi->worker->requests.erase(cgi->request_id);
+  delete cgi;
+}
+
+void CgiWorkerPool::fail(CgiWorker* worker, std::vector<Connection*>& touched) {
+  LOG_ERROR("[Error] CGI worker {} (pid {}) failed; restarting",
+            worker->program, worker->process.pid());
+
+  for (auto& entry : worker->requests) {
+    CgiProcess* cgi = entry.second;
+    add_touched(touched, cgi->conn);
+    cgi->end_output();
+    delete cgi;
+  }
+  worker->requests.clear();
+  worker->outbound.clear();
+  worker->outbound_offset = 0;
+  worker->reader.reset();
+  worker->process.stop(monotonic_ms());
+}
+
+void CgiWorkerPool::restart_due(uint64_t now_ms, std::vector<CgiWorker*>& restarted) {
+  for (std::unique_ptr<CgiWorker>& worker : workers) {
+    if (worker->process.restart_due(now_ms) &&
+        worker->process.start(worker->program, true, now_ms)) {
+      restarted.push_back(worker.get());
+    }
+  }
+}
+
+int CgiWorkerPool::next_restart_ms(uint64_t now_ms) const {
+  int wait = -1;
+  for (const std::unique_ptr<CgiWorker>& worker : workers) {
+    if (worker->process.running()) {
+      continue;
+    }
+    uint64_t due = worker->process.restart_at();
+    int until = due <= now_ms ? 0 : (due - now_ms > INT_MAX ? INT_MAX : static_cast<int>(due - now_ms));
+    if (wait < 0 || until < wait) {
+      wait = until;
+    }
+  }
+  return wait;
+}
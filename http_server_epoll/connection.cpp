@@ -0,0 +1,475 @@
+#include <cerrno>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/sendfile.h>
+#include <sys/uio.h>
+#include <climits>
+
+#include "include/connection.h"
+#include "include/request.h"
+#include "logger.h"
+
+unsigned int g_keepalive_max_requests = DEFAULT_KEEPALIVE_MAX_REQUESTS;
+int g_keepalive_idle_timeout = DEFAULT_KEEPALIVE_IDLE_TIMEOUT;
+uint32_t g_shed_target_ms = 0;
+
+Connection::Connection(int client_fd)
+  : fd(client_fd),
+    state(ConnState::READING_REQUEST),
+    discarding_body(false),
+    cgi(nullptr),
+    job(nullptr),
+    write_offset(0),
+    pending_bytes(0),
+    registered_events(0),
+    keep_alive(false),
+    close_after_write(false),
+    requests_served(0),
+    timer(this),
+    request_started_ms(monotonic_ms()),
+    last_active_ms(request_started_ms),
+    request_started_us(request_started_ms * 1000),
+    timing_started_us(0),
+    timing_parsed_us(0),
+    response_class(RequestClass::REJECTED),
+    response_status(0),
+    timing_open(false) {
+  record_connection_opened();
+}
+
+Connection::~Connection() {
+  if (fd >= 0) {
+    close(fd);
+    record_connection_closed();
+  }
+}
+
+void Connection::handle_events(uint32_t events) {
+  bool peer_closed = false;
+
+  if (events & EPOLLIN) {
+    peer_closed = !read_available();
+    if (state == ConnState::CLOSED) {
+      return;
+    }
+  }
+
+  process_input();
+
+  // A peer that hung up gets answers to what it already sent, nothing more
+  if (peer_closed) {
+    close_after_write = true;
+  }
+
+  bool held_back = pending_bytes >= MAX_PENDING_WRITE;
+  flush_writes();
+
+  // Requests parked while the queue was full get no new EPOLLIN of their
+  // own; keep answering them for as long as the socket takes each batch
+  while (held_back && pending_bytes < MAX_PENDING_WRITE && state != ConnState::CLOSED) {
+    process_input();
+    held_back = pending_bytes >= MAX_PENDING_WRITE;
+    flush_writes();
+  }
+}
+
+void Connection::consume_input(const char* data, size_t length) {
+  last_active_ms = monotonic_ms();
+  if (read_buffer.empty() && !discarding_body) {
+    request_started_us = monotonic_us();
+    request_started_ms = request_started_us / 1000;
+  }
+  read_buffer.append(data, length);
+  process_input();
+  update_state();
+}
+
+void Connection::consume_eof() {
+  process_input();
+  close_after_write = true;
+  update_state();
+}
+
+/*
+ * Describe up to max_iov unsent in-memory chunks, starting mid-chunk if
+ * a previous write was partial and stopping at the first file range.
+ * Returns the number of entries filled.
+ */
+int Connection::fill_write_iovecs(struct iovec* iov, int max_iov) const {
+  int iov_count = 0;
+  size_t offset = write_offset;
+
+  for (const WriteChunk& chunk : write_queue) {
+    if (iov_count == max_iov || chunk.is_file()) {
+      break;
+    }
+    iov[iov_count].iov_base = const_cast<char*>(chunk.bytes()) + offset;
+    iov[iov_count].iov_len  = chunk.size() - offset;
+    iov_count++;
+    offset = 0;
+  }
+  return iov_count;
+}
+
+/*
+ * Drop bytes the socket has accepted from the front of the queue
+ */
+void Connection::complete_write(size_t bytes_sent) {
+  pending_bytes -= bytes_sent;
+  if (bytes_sent > 0) {
+    last_active_ms = monotonic_ms();
+    record_bytes_sent(bytes_sent);
+  }
+
+  while (bytes_sent > 0) {
+    size_t chunk_left = write_queue.front().size() - write_offset;
+    if (bytes_sent < chunk_left) {
+      write_offset += bytes_sent;
+      break;
+    }
+    bytes_sent -= chunk_left;
+    write_queue.pop_front();
+    write_offset = 0;
+  }
+
+  update_state();
+}
+
+void Connection::resume_input() {
+  process_input();
+  update_state();
+}
+
+bool Connection::wants_input() const {
+  return state != ConnState::CLOSED &&
+         !close_after_write &&
+         pending_bytes < MAX_PENDING_WRITE &&
+         read_buffer.size() < MAX_READ_BUFFER;
+}
+
+/*
+ * Bytes only ever go at the end of the back buffer, within its capacity,
+ * so an engine with a send in flight from it never sees them move
+ */
+void Connection::queue_copy(const char* data, size_t length) {
+  if (length == 0) {
+    return;
+  }
+  if (write_queue.empty() || !write_queue.back().is_copy() ||
+      write_queue.back().copied.spare() < length) {
+    write_queue.emplace_back();
+  }
+  write_queue.back().copied.append(data, length);
+  pending_bytes += length;
+}
+
+void Connection::queue_write(std::shared_ptr<const std::string> data) {
+  if (!data->empty()) {
+    pending_bytes += data->size();
+    write_queue.emplace_back(std::move(data));
+  }
+}
+
+void Connection::queue_file(std::shared_ptr<const CachedFile> file, off_t offset, size_t length) {
+  if (length > 0) {
+    pending_bytes += length;
+    write_queue.emplace_back(std::move(file), offset, length);
+  }
+}
+
+uint32_t Connection::wanted_events() const {
+  if (state == ConnState::CLOSED) {
+    return 0;
+  }
+
+  uint32_t events = 0;
+  if (!write_queue.empty()) {
+    events |= EPOLLOUT;
+  }
+  if (wants_input()) {
+    events |= EPOLLIN;
+  }
+  return events;
+}
+
+uint64_t Connection::deadline_ms() const {
+  if (!write_queue.empty()) {
+    return last_active_ms + WRITE_STALL_TIMEOUT_MS;
+  }
+  if (cgi) {
+    return last_active_ms + CGI_OUTPUT_TIMEOUT_MS;
+  }
+  if (job) {
+    return last_active_ms + POOL_JOB_TIMEOUT_MS;
+  }
+  if (discarding_body) {
+    return last_active_ms + BODY_READ_TIMEOUT_MS;
+  }
+  if (read_buffer.empty() && requests_served > 0) {
+    return last_active_ms + static_cast<uint64_t>(g_keepalive_idle_timeout) * 1000;
+  }
+  return request_started_ms + HEADER_READ_TIMEOUT_MS;
+}
+
+/*
+ * Drain the socket into read_buffer until it would block or the
+ * buffer limit is reached. Returns false once the peer has closed
+ * its side of the connection.
+ */
+bool Connection::read_available() {
+  bool open = true;
+
+  // Received straight into the pooled buffer, which is given back below
+  // if nothing arrived
+  while (read_buffer.size() < MAX_READ_BUFFER) {
+    char* space = read_buffer.prepare(READ_CHUNK_SIZE);
+    ssize_t bytes_read = recv(fd, space, read_buffer.spare(), 0);
+
+    if (bytes_read > 0) {
+      last_active_ms = monotonic_ms();
+      if (read_buffer.empty() && !discarding_body) {
+        request_started_us = monotonic_us();
+        request_started_ms = request_started_us / 1000;
+      }
+      read_buffer.commit(static_cast<size_t>(bytes_read));
+      continue;
+    }
+    if (bytes_read == 0) {
+      open = false;
+      break;
+    }
+    if (errno == EINTR) {
+      continue;
+    }
+    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      break;
+    }
+
+    LOG_ERROR("[Error] recv() failed (fd={})", fd);
+    state = ConnState::CLOSED;
+    break;
+  }
+
+  read_buffer.release_if_empty();
+  return open;
+}
+
+/*
+ * Answer every complete request in read_buffer, in order. Parsing stops
+ * early once a response ends the connection or too much output is queued;
+ * the rest is picked up after the queue drains. Consumed bytes are
+ * dropped from the buffer once, at the end.
+ */
+void Connection::process_input() {
+  size_t consumed = 0;
+
+  while (!cgi && !job && !close_after_write && pending_bytes < MAX_PENDING_WRITE) {
+    const char* data = read_buffer.data() + consumed;
+    size_t length = read_buffer.size() - consumed;
+
+    if (discarding_body) {
+      size_t used = 0;
+      std::string_view payload;
+      ParseStatus status = body_decoder.decode(data, length, used, payload);
+      consumed += used;
+      if (status == ParseStatus::ERROR) {
+        // Framing is lost; nothing after this point can be trusted
+        keep_alive = false;
+        close_after_write = true;
+        consumed = read_buffer.size();
+        break;
+      }
+      if (status == ParseStatus::COMPLETE) {
+        discarding_body = false;
+      } else if (consumed == read_buffer.size()) {
+        break;
+      }
+      continue;
+    }
+
+    ParseStatus status = parser.parse(data, length, request);
+    if (status == ParseStatus::INCOMPLETE) {
+      if (length >= REQUEST_BUFFER_SIZE) {
+        keep_alive = false;
+        start_timing();
+        send_error_response(*this,
+                            431,
+                            "Request header exceeds limit",
+                            std::to_string(REQUEST_BUFFER_SIZE) + " bytes");
+        close_after_write = true;
+      }
+      break;
+    }
+
+    if (status == ParseStatus::ERROR) {
+      keep_alive = false;
+      start_timing();
+      send_error_response(*this,
+                          request.error_status,
+                          "Malformed request",
+                          "could not parse request head");
+      close_after_write = true;
+      break;
+    }
+
+    start_timing();
+    handle_http_request(*this, request);
+    consumed += request.header_length;
+    parser.reset();
+    request_started_us = monotonic_us();  // Any bytes left over begin the next request
+    request_started_ms = request_started_us / 1000;
+
+    if (request.has_body()) {
+      body_decoder.reset(request);
+      discarding_body = true;
+    }
+
+    if (!keep_alive) {
+      close_after_write = true;
+    }
+  }
+
+  read_buffer.consume(consumed);
+}
+
+/*
+ * Send as much of the pending-write queue as the socket will take.
+ * In-memory chunks go out together in one sendmsg(); a file range that
+ * follows is sent straight away with sendfile(), so the header corked
+ * with MSG_MORE is never left waiting. Stops at the first short write
+ * or after one sendfile() call. Once the queue is empty the connection
+ * either waits for its next request or closes.
+ */
+void Connection::flush_writes() {
+  bool sent_file = false;
+
+  while (!write_queue.empty() && !sent_file) {
+    sent_file = write_queue.front().is_file();
+
+    size_t attempted = 0;
+    ssize_t bytes_sent = sent_file ? send_file_chunk(attempted)
+                                   : send_memory_chunks(attempted);
+    if (bytes_sent < 0) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        LOG_ERROR("[Error] {}() failed (fd={})", sent_file ? "sendfile" : "sendmsg", fd);
+        state = ConnState::CLOSED;
+        return;
+      }
+      bytes_sent = 0;
+    }
+
+    complete_write(static_cast<size_t>(bytes_sent));
+    if (static_cast<size_t>(bytes_sent) < attempted) {
+      return;
+    }
+  }
+
+  update_state();
+}
+
+/*
+ * One sendmsg() over the in-memory chunks at the front of the queue,
+ * with MSG_MORE when a file range comes right after them
+ */
+ssize_t Connection::send_memory_chunks(size_t& attempted) {
+  struct iovec iov[IOV_MAX];
+  int iov_count = fill_write_iovecs(iov, IOV_MAX);
+  for (int i = 0; i < iov_count; ++i) {
+    attempted += iov[i].iov_len;
+  }
+
+  struct msghdr msg = {};
+  msg.msg_iov    = iov;
+  msg.msg_iovlen = static_cast<size_t>(iov_count);
+
+  int flags = MSG_NOSIGNAL;
+  if (static_cast<size_t>(iov_count) < write_queue.size() &&
+      write_queue[static_cast<size_t>(iov_count)].is_file()) {
+    flags |= MSG_MORE;
+  }
+
+  ssize_t bytes_sent;
+  do {
+    bytes_sent = sendmsg(fd, &msg, flags);
+  } while (bytes_sent < 0 && errno == EINTR);
+  return bytes_sent;
+}
+
+/*
+ * One sendfile() of at most SENDFILE_CHUNK_SIZE bytes from the file
+ * range at the front of the queue
+ */
+ssize_t Connection::send_file_chunk(size_t& attempted) {
+  const WriteChunk& chunk = write_queue.front();
+  off_t offset = chunk.file_offset + static_cast<off_t>(write_offset);
+  size_t length = chunk.file_length - write_offset;
+  if (length > SENDFILE_CHUNK_SIZE) {
+    length = SENDFILE_CHUNK_SIZE;
+  }
+  attempted = length;
+
+  ssize_t bytes_sent;
+  do {
+    bytes_sent = sendfile(fd, chunk.file->fd, &offset, length);
+  } while (bytes_sent < 0 && errno == EINTR);
+
+  // The file shrank underneath us; the promised Content-Length cannot be met
+  if (bytes_sent == 0) {
+    errno = EIO;
+    return -1;
+  }
+  return bytes_sent;
+}
+
+/*
+ * Derive the connection state from the queue and the close decision
+ */
+void Connection::update_state() {
+  if (state == ConnState::CLOSED) {
+    return;
+  }
+
+  if (timing_open && write_queue.empty() && !cgi && !job) {
+    finish_timing(monotonic_us());
+  }
+
+  if (!write_queue.empty()) {
+    state = ConnState::WRITING_RESPONSE;
+  } else if (cgi) {
+    state = ConnState::AWAITING_CGI;
+  } else if (job) {
+    state = ConnState::AWAITING_JOB;
+  } else if (close_after_write) {
+    state = ConnState::CLOSED;
+  } else {
+    state = ConnState::READING_REQUEST;
+  }
+}
+
+/*
+ * A request's header block is complete and it is about to be answered;
+ * whatever answers it sets the class and status
+ */
+void Connection::start_timing() {
+  uint64_t now_us = monotonic_us();
+  if (timing_open) {
+    finish_timing(now_us);
+  }
+  timing_started_us = request_started_us;
+  timing_parsed_us = now_us;
+  record_phase(RequestPhase::READ, timing_parsed_us - timing_started_us);
+
+  response_class = RequestClass::REJECTED;
+  response_status = 0;
+  timing_open = true;
+}
+
+/*
+ * Record the request being answered as done at now_us
+ */
+void Connection::finish_timing(uint64_t now_us) {
+  record_phase(RequestPhase::RESPOND, now_us - timing_parsed_us);
+  record_request(response_class, response_status, now_us - timing_started_us);
+  timing_open = false;
+}
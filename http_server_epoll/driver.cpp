@@ -1,16 +1,113 @@
 #include <iostream>
 #include <string>
+#include <memory>
+#include <thread>
+#include <vector>
 #include <unistd.h>
-#include <sys/epoll.h>
-#include <sys/socket.h>
+#include <pthread.h>
+#include <sched.h>
 #include <cstdlib>
+#include <csignal>
 
 #include "include/socket_utils.h"
-#include "include/request.h"
+#include "include/connection.h"
+#include "include/reactor.h"
+#include "include/thread_pool.h"
+#include "cgi_workers.h"
+#include "file_cache.h"
+#include "response_cache.h"
+#include "logger.h"
+#ifdef HAVE_IO_URING
+#include "include/uring_reactor.h"
+#endif
+
+/*
+ * Pin a thread to one CPU, wrapping around the available cores
+ */
+static void pin_thread_to_cpu(pthread_t thread, int index) {
+  unsigned int num_cpus = std::thread::hardware_concurrency();
+  if (num_cpus == 0) {
+    return;
+  }
+
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  CPU_SET(static_cast<unsigned int>(index) % num_cpus, &cpus);
+
+  if (pthread_setaffinity_np(thread, sizeof(cpus), &cpus) != 0) {
+    LOG_ERROR("[Error] Failed to pin reactor {} to a CPU", index);
+  }
+}
+
+/*
+ * Run one reactor per thread (the calling thread when there is only one)
+ */
+template <typename ReactorType>
+static void run_reactors(std::vector<std::unique_ptr<ReactorType>>& reactors, bool pin_cpus) {
+  if (reactors.size() == 1) {
+    if (pin_cpus) {
+      pin_thread_to_cpu(pthread_self(), 0);
+    }
+    reactors[0]->run();
+    return;
+  }
+
+  std::vector<std::thread> threads;
+  for (size_t id = 0; id < reactors.size(); ++id) {
+    threads.emplace_back(&ReactorType::run, reactors[id].get());
+    if (pin_cpus) {
+      pin_thread_to_cpu(threads.back().native_handle(), static_cast<int>(id));
+    }
+  }
+
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+}
+
+#ifdef HAVE_IO_URING
+/*
+ * Start the io_uring engine. Returns false if the kernel refuses
+ * io_uring, so the caller can fall back to epoll.
+ */
+static bool run_uring_reactors(int num_reactors, int port, bool reuse_port, bool pin_cpus) {
+  std::vector<std::unique_ptr<UringReactor>> reactors;
+  for (int id = 0; id < num_reactors; ++id) {
+    reactors.emplace_back(new UringReactor(id, port, reuse_port));
+
+    int rc = reactors.back()->init();
+    if (rc < 0) {
+      LOG_ERROR("[Error] io_uring unavailable (errno={})", -rc);
+      return false;
+    }
+  }
+  LOG_INFO("[Server] Listening on port {} with {} io_uring reactor(s)", port, num_reactors);
+
+  run_reactors(reactors, pin_cpus);
+  return true;
+}
+#endif
 
 /*
  * Usage:
- *   ./server [-d <basedir>] [-p <port>]
+ *   ./server [-d <basedir>] [-p <port>] [-k <max_requests>] [-i <idle_seconds>]
+ *            [-w <reactors>] [-a] [-e <epoll|uring|hybrid>] [-t <pool_threads>]
+ *            [-c <max_cached_file>] [-m <response_cache_bytes>]
+ *            [-W <cgi_path>]... [-n <cgi_workers>]
+ *
+ *   -k  Maximum requests served on one keep-alive connection
+ *   -i  Seconds an idle keep-alive connection is kept open
+ *   -w  Number of reactor threads, each with its own epoll loop
+ *   -a  Pin each reactor thread to its own CPU
+ *   -e  I/O engine: epoll (default), uring, or hybrid (epoll reactors that
+ *       hand blocking file work to a thread pool)
+ *   -t  Thread pool size for the hybrid engine
+ *   -c  Largest file (bytes) kept as a rendered response in memory; 0 disables
+ *   -m  Memory budget (bytes) of the rendered-response cache
+ *   -W  Run the CGI program at this URL path as persistent workers (repeatable)
+ *   -n  Workers started per -W program in each reactor
+ *   -L  Shed new connections with a 503 while event loop lag stays above
+ *       this many ms (0, the default, never sheds)
  */
 int main(int argc, char* argv[]) {
 
@@ -19,100 +116,151 @@ int main(int argc, char* argv[]) {
    * ---------------------------- */
   std::string base_directory = ".";
   int port = DEFAULT_PORT;
+  int num_reactors = 1;
+  bool pin_cpus = false;
+  std::string engine = "epoll";
+  size_t pool_threads = DEFAULT_POOL_THREADS;
+  size_t max_cached_file = DEFAULT_RESPONSE_CACHE_MAX_FILE;
+  size_t response_cache_bytes = DEFAULT_RESPONSE_CACHE_BUDGET;
 
   int option;
-  while ((option = getopt(argc, argv, "d:p:")) != -1) {
+  while ((option = getopt(argc, argv, "d:p:k:i:w:ae:t:c:m:W:n:L:")) != -1) {
     switch (option) {
       case 'd':
         base_directory = optarg;
-        std::cerr << "[Config] Base directory set to " << base_directory << std::endl;
+        LOG_INFO("[Config] Base directory set to {}", base_directory);
         break;
 
       case 'p':
         port = std::atoi(optarg);
-        std::cerr << "[Config] Port set to " << port << std::endl;
+        LOG_INFO("[Config] Port set to {}", port);
+        break;
+
+      case 'k':
+        g_keepalive_max_requests = static_cast<unsigned int>(std::strtoul(optarg, nullptr, 10));
+        LOG_INFO("[Config] Max requests per connection set to {}", g_keepalive_max_requests);
+        break;
+
+      case 'i':
+        g_keepalive_idle_timeout = std::atoi(optarg);
+        LOG_INFO("[Config] Keep-alive idle timeout set to {}s", g_keepalive_idle_timeout);
+        break;
+
+      case 'w':
+        num_reactors = std::atoi(optarg);
+        if (num_reactors < 1) {
+          num_reactors = 1;
+        }
+        LOG_INFO("[Config] Reactor threads set to {}", num_reactors);
+        break;
+
+      case 'a':
+        pin_cpus = true;
+        LOG_INFO("[Config] Pinning reactor threads to CPUs");
+        break;
+
+      case 'e':
+        engine = optarg;
+        if (engine != "epoll" && engine != "uring" && engine != "hybrid") {
+          LOG_ERROR("[Error] Unknown engine '{}' (use epoll, uring or hybrid)", engine);
+          std::exit(1);
+        }
+        LOG_INFO("[Config] I/O engine set to {}", engine);
+        break;
+
+      case 't':
+        pool_threads = std::strtoul(optarg, nullptr, 10);
+        if (pool_threads < 1) {
+          pool_threads = 1;
+        }
+        LOG_INFO("[Config] Thread pool size set to {}", pool_threads);
+        break;
+
+      case 'c':
+        max_cached_file = std::strtoul(optarg, nullptr, 10);
+        LOG_INFO("[Config] Response cache file size limit set to {} bytes", max_cached_file);
+        break;
+
+      case 'm':
+        response_cache_bytes = std::strtoul(optarg, nullptr, 10);
+        LOG_INFO("[Config] Response cache budget set to {} bytes", response_cache_bytes);
+        break;
+
+      case 'W':
+        g_cgi_workers.paths.push_back(optarg);
+        LOG_INFO("[Config] Running {} as persistent CGI workers", optarg);
+        break;
+
+      case 'n':
+        g_cgi_workers.workers_per_program = std::strtoul(optarg, nullptr, 10);
+        if (g_cgi_workers.workers_per_program < 1) {
+          g_cgi_workers.workers_per_program = 1;
+        }
+        LOG_INFO("[Config] CGI workers per program set to {}", g_cgi_workers.workers_per_program);
+        break;
+
+      case 'L':
+        g_shed_target_ms = static_cast<uint32_t>(std::strtoul(optarg, nullptr, 10));
+        LOG_INFO("[Config] Shedding load past {} ms of event loop lag", g_shed_target_ms);
         break;
 
       default:
-        std::cerr << "Usage: ./server [-d basedir] [-p port]\n";
+        std::cerr << "Usage: ./server [-d basedir] [-p port] [-k max_requests] [-i idle_seconds]"
+                     " [-w reactors] [-a] [-e epoll|uring|hybrid] [-t pool_threads] [-c max_cached_file]"
+                     " [-m response_cache_bytes] [-W cgi_path]... [-n cgi_workers] [-L shed_target_ms]\n";
         std::exit(1);
     }
   }
 
   chdir_or_die(base_directory.c_str());
 
-  /* ----------------------------
-   * Create listening socket
-   * ---------------------------- */
-  int listen_fd = open_listen_fd_or_die(port);
-  std::cout << "[Server] Listening on port " << port << std::endl;
+  // A peer that resets mid-write must not kill the server
+  signal(SIGPIPE, SIG_IGN);
+
+  // Paths are resolved against the document root from here on
+  g_file_cache.start();
+  g_response_cache.configure(max_cached_file, response_cache_bytes);
+
+  // With several reactors each one binds its own SO_REUSEPORT socket
+  bool reuse_port = num_reactors > 1;
 
   /* ----------------------------
-   * Initialize epoll
+   * io_uring engine
    * ---------------------------- */
-  int epoll_fd = epoll_create1(0);
-  if (epoll_fd == -1) {
-    std::cerr << "[Error] epoll_create1 failed\n";
-    std::exit(1);
+  if (engine == "uring") {
+#ifdef HAVE_IO_URING
+    if (run_uring_reactors(num_reactors, port, reuse_port, pin_cpus)) {
+      return 0;
+    }
+#else
+    LOG_ERROR("[Error] Built without io_uring support");
+#endif
+    LOG_WARN("[Server] Falling back to the epoll engine");
   }
 
-  struct epoll_event event {};
-  event.data.fd = listen_fd;
-  event.events = EPOLLIN;
-
-  if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &event) == -1) {
-    std::cerr << "[Error] epoll_ctl ADD listen_fd failed\n";
-    std::exit(1);
+  /* ----------------------------
+   * Hybrid engine: the reactors share one thread pool
+   * ---------------------------- */
+  std::unique_ptr<ThreadPool> pool;
+  if (engine == "hybrid") {
+    pool.reset(new ThreadPool(pool_threads));
   }
 
   /* ----------------------------
-   * Event loop
+   * Create one epoll reactor per worker
    * ---------------------------- */
-  struct epoll_event ready_events[MAX_EVENTS];
-
-  std::cout << "[Server] Entering event loop\n";
-
-  while (true) {
-    int num_ready = epoll_wait(epoll_fd, ready_events, MAX_EVENTS, -1);
-    if (num_ready == -1) {
-      std::cerr << "[Error] epoll_wait failed\n";
-      std::exit(1);
-    }
-
-    for (int i = 0; i < num_ready; ++i) {
-      int fd = ready_events[i].data.fd;
-
-      if (ready_events[i].events & EPOLLIN) {
-
-        /* ----------------------------
-         * New incoming connection
-         * ---------------------------- */
-        if (fd == listen_fd) {
-          int client_fd = accept_or_die(listen_fd);
-          std::cout << "[Server] Accepted new connection (fd=" << client_fd << ")\n";
-
-          struct epoll_event client_event {};
-          client_event.data.fd = client_fd;
-          client_event.events = EPOLLIN;
-
-          if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client_fd, &client_event) == -1) {
-            std::cerr << "[Error] epoll_ctl ADD client_fd failed\n";
-            close(client_fd);
-          }
-        }
-        /* ----------------------------
-         * Existing client request
-         * ---------------------------- */
-        else {
-          int client_fd = fd;
-          std::cout << "[Server] Handling request (fd=" << client_fd << ")\n";
-
-          handle_http_request(client_fd);
-          close(client_fd);
-        }
-      }
-    }
+  std::vector<std::unique_ptr<Reactor>> reactors;
+  for (int id = 0; id < num_reactors; ++id) {
+    reactors.emplace_back(new Reactor(id, port, reuse_port, pool.get()));
   }
+  if (pool) {
+    LOG_INFO("[Server] Listening on port {} with {} reactor(s) and {} pool thread(s)",
+             port, num_reactors, pool_threads);
+  } else {
+    LOG_INFO("[Server] Listening on port {} with {} reactor(s)", port, num_reactors);
+  }
+
+  run_reactors(reactors, pin_cpus);
 
   return 0;
 }
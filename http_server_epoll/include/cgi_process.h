@@ -0,0 +1,144 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <sys/types.h>
+
+#include "http_parser.h"
+
+struct Connection;
+struct CgiWorker;
+
+/*
+ * CGI constants
+ */
+constexpr size_t CGI_READ_CHUNK_SIZE = 16384;  // Pipe bytes read per read() call
+constexpr size_t CGI_MAX_HEADER = 8192;        // Largest header block a program may print
+constexpr int CGI_REAP_INTERVAL_MS = 100;      // Exit polling period without pidfd
+
+/*
+ * A running CGI program whose stdout is turned into an HTTP response.
+ *
+ * The child is started with posix_spawn() and writes into a
+ * non-blocking pipe. The event loop watches that pipe and calls
+ * read_output() when it is readable; nothing here ever blocks. Output is
+ * framed by the server: the program's header block is checked and
+ * completed with a status line, Date and Connection headers, and the
+ * body is sent as the program's own Content-Length allows, else with
+ * chunked transfer coding (HTTP/1.1) or delimited by closing the
+ * connection (HTTP/1.0). A 204 or 304 response has no body at all, and
+ * an interim (1xx) status is answered with 502 like any header block no
+ * response can be built from.
+ *
+ * The child is reaped through a pidfd that becomes readable when it
+ * exits. Kernels without pidfd_open() leave pidfd at -1, and the loop
+ * polls reap() instead.
+ *
+ * A program run by a persistent worker (see cgi_worker_pool.h) has no
+ * child or pipe of its own: attach() creates the response, and the
+ * worker pool hands it the program's output through relay() and
+ * end_output().
+ *
+ * The connection answers no further requests while its program runs,
+ * so pipelined responses stay in order. If the client goes away first,
+ * abandon() kills the child; the object lives on until it is reaped.
+ */
+struct CgiProcess {
+  Connection* conn;   // Client being answered; nullptr once abandoned
+  void* owner;        // Engine-specific handle for conn, set on adoption
+  pid_t pid;
+  int pidfd;          // Readable once the child exits; -1 if unsupported
+  int output_fd;      // Read end of the child's stdout; -1 once closed
+  bool exited;
+
+  // Engine bookkeeping: registered with epoll / poll in flight
+  bool adopted;
+  bool output_armed;
+  bool exit_armed;
+
+  // Set while a persistent worker runs the program
+  CgiWorker* worker;
+  uint16_t request_id;
+
+  /*
+   * Start `program` for conn with QUERY_STRING set to `query`.
+   * Returns nullptr (errno set) if the pipe or process cannot be created.
+   */
+  static CgiProcess* spawn(Connection& conn, const std::string& program,
+                           const std::string& query, bool allow_chunked);
+
+  /*
+   * A response for conn whose output will come from a worker
+   */
+  static CgiProcess* attach(Connection& conn, bool allow_chunked);
+
+  ~CgiProcess();
+
+  CgiProcess(const CgiProcess&) = delete;
+  CgiProcess& operator=(const CgiProcess&) = delete;
+
+  /*
+   * Move what the pipe holds into the connection's write queue, until it
+   * would block or the queue is full. Returns true once the output has
+   * ended; the response is then complete and conn->cgi is cleared.
+   */
+  bool read_output();
+
+  /*
+   * Output is pending and the client can take more of it
+   */
+  bool wants_output() const;
+
+  /*
+   * Turn a piece of program output into response bytes. Returns false
+   * if the output can never form a valid header block.
+   */
+  bool relay(const char* data, size_t length);
+
+  /*
+   * The output has ended: complete the response (or answer 502 if the
+   * program never sent a header block) and clear conn->cgi
+   */
+  void end_output();
+
+  /*
+   * Collect the child's exit status if it has exited
+   */
+  void reap();
+
+  /*
+   * The client is gone: stop relaying and kill the child
+   */
+  void abandon();
+
+  /*
+   * Close the pipe once the engine has stopped watching it. Closing is
+   * not enough to leave an epoll set: a child being spawned holds a copy
+   * of every descriptor until its exec completes.
+   */
+  void close_output();
+
+  /*
+   * Safe to delete: response ended, output closed and child reaped
+   */
+  bool finished() const { return !conn && output_fd < 0 && exited; }
+
+private:
+  enum class Framing {
+    LENGTH,   // Program sent Content-Length; copy the body as is
+    CHUNKED,  // Wrap each read in a chunk
+    CLOSE     // HTTP/1.0 client; the body ends when the connection does
+  };
+
+  CgiProcess(Connection& client, pid_t child, int pipe_fd, bool allow_chunked);
+
+  ParseStatus parse_header();
+  void queue_body(const char* data, size_t length);
+
+  std::string header_buffer;  // Program output up to the end of its header block
+  bool header_done;
+  bool chunked_allowed;
+  Framing framing;
+  uint64_t body_remaining;    // For Framing::LENGTH
+};
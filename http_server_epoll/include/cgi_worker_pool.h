@@ -0,0 +1,136 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "cgi_protocol.h"
+#include "cgi_workers.h"
+
+struct Connection;
+struct CgiProcess;
+
+/*
+ * A persistent worker for one CGI program, and the requests
+ * multiplexed over its socket
+ */
+struct CgiWorker {
+  std::string path;     // URL path the worker serves
+  std::string program;  // Executable, relative to the document root
+  CgiWorkerProcess process;
+
+  CgiFrameReader reader;
+  std::string outbound;      // Frames not yet written to the socket
+  size_t outbound_offset;
+  std::unordered_map<uint16_t, CgiProcess*> requests;  // In flight, by id
+  uint16_t next_request_id;
+
+  // Engine bookkeeping: events registered with epoll / polls in flight
+  uint32_t registered_events;
+  bool read_armed;
+  bool write_armed;
+
+  CgiWorker() : outbound_offset(0), next_request_id(1), registered_events(0),
+                read_armed(false), write_armed(false) {}
+
+  bool wants_write() const { return outbound_offset < outbound.size(); }
+
+  // False while a client of one of its requests has MAX_PENDING_WRITE queued
+  bool wants_read() const;
+};
+
+/*
+ * The persistent CGI workers of one reactor.
+ *
+ * Each reactor starts its own g_cgi_workers.workers_per_program workers
+ * for every configured program, so reactors share nothing. A request
+ * goes to the program's running worker with the fewest requests in
+ * flight; if none is running, the caller falls back to starting the
+ * program once for the request.
+ *
+ * The pool only moves bytes: the engine watches each worker's socket
+ * and calls read() and flush() when it is ready, and calls fail() when
+ * the socket hangs up or errs. A failed worker's requests end at once
+ * (502 if no header block had arrived) and the worker is restarted as
+ * CgiWorkerProcess's back-off allows, from restart_due().
+ *
+ * Requests of a multiplexed worker cannot be paused one at a time, so
+ * the whole worker is: while any of its clients is over the pending
+ * write limit, its socket is left unread and unwatched, and its output
+ * waits in the socket buffer as a per-request program's waits in its
+ * pipe.
+ */
+class CgiWorkerPool {
+public:
+  CgiWorkerPool() = default;
+  ~CgiWorkerPool();
+
+  CgiWorkerPool(const CgiWorkerPool&) = delete;
+  CgiWorkerPool& operator=(const CgiWorkerPool&) = delete;
+
+  /*
+   * The pool of the reactor running on this thread, for the request
+   * handler; nullptr if there is none
+   */
+  static CgiWorkerPool* for_this_thread();
+  void bind_to_this_thread();
+
+  /*
+   * Create and start the configured workers
+   */
+  void start();
+
+  /*
+   * Queue the request for a running worker serving `path`. Returns the
+   * response that will relay its output, or nullptr if no worker can
+   * take it.
+   */
+  CgiProcess* submit(Connection& conn, std::string_view path, const std::string& query,
+                     bool allow_chunked);
+
+  /*
+   * The worker's socket is readable: relay the frames it holds, a chunk
+   * at a time, until it is empty or wants_read() turns false. The
+   * connections that got output are appended to `touched`, once each.
+   * Returns false if the worker hung up or broke the protocol.
+   */
+  bool read(CgiWorker* worker, std::vector<Connection*>& touched);
+
+  /*
+   * Write queued frames. Returns false if the worker is gone.
+   */
+  bool flush(CgiWorker* worker);
+
+  /*
+   * The client is gone: forget its request (any later output for it is
+   * dropped) and delete the response
+   */
+  void cancel(CgiProcess* cgi);
+
+  /*
+   * End the worker's requests and stop it; the engine has already
+   * stopped watching its socket
+   */
+  void fail(CgiWorker* worker, std::vector<Connection*>& touched);
+
+  /*
+   * Restart the stopped workers whose back-off has passed, appending
+   * them to `restarted` so the engine can watch their sockets
+   */
+  void restart_due(uint64_t now_ms, std::vector<CgiWorker*>& restarted);
+
+  /*
+   * Milliseconds until the next restart is due, -1 if none is pending
+   */
+  int next_restart_ms(uint64_t now_ms) const;
+
+  std::vector<std::unique_ptr<CgiWorker>> workers;
+
+private:
+  CgiWorker* pick(std::string_view path);
+  bool relay_frames(CgiWorker* worker, std::vector<Connection*>& touched);
+};
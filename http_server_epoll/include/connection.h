@@ -0,0 +1,232 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <deque>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+#include <ctime>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include "file_cache.h"
+#include "http_parser.h"
+#include "timer_wheel.h"
+#include "memory_pool.h"
+#include "request_metrics.h"
+
+struct CgiProcess;
+struct PoolJob;
+
+/*
+ * Connection handling constants
+ */
+constexpr size_t READ_CHUNK_SIZE = 4096;
+constexpr size_t MAX_READ_BUFFER = 65536;       // Stop reading past this much unparsed input
+constexpr size_t MAX_PENDING_WRITE = 262144;    // Stop parsing past this much queued output
+constexpr size_t SENDFILE_CHUNK_SIZE = 1048576; // File bytes handed to one sendfile() call
+
+constexpr unsigned int DEFAULT_KEEPALIVE_MAX_REQUESTS = 1000;
+constexpr int DEFAULT_KEEPALIVE_IDLE_TIMEOUT = 15;  // seconds
+
+/*
+ * Per-connection deadlines, in milliseconds
+ */
+constexpr uint64_t HEADER_READ_TIMEOUT_MS  = 10000;  // First byte of a request to its blank line
+constexpr uint64_t BODY_READ_TIMEOUT_MS    = 10000;  // Between reads of a request body
+constexpr uint64_t WRITE_STALL_TIMEOUT_MS  = 30000;  // Between writes while output is queued
+constexpr uint64_t CGI_OUTPUT_TIMEOUT_MS   = 60000;  // Between reads of a CGI program's output
+constexpr uint64_t POOL_JOB_TIMEOUT_MS     = 30000;  // For blocking work on the thread pool
+
+/*
+ * Keep-alive limits, set once from the command line before the loop starts
+ */
+extern unsigned int g_keepalive_max_requests;
+extern int g_keepalive_idle_timeout;
+
+/*
+ * Event loop lag (ms) past which reactors shed new connections; 0 never
+ * sheds. Set once from the command line before the loop starts.
+ */
+extern uint32_t g_shed_target_ms;
+
+/*
+ * Parse state of a client connection
+ */
+enum class ConnState {
+  READING_REQUEST,   // Nothing queued; waiting for the next request
+  WRITING_RESPONSE,  // Draining the pending-write queue
+  AWAITING_CGI,      // Nothing queued; a CGI program is still producing output
+  AWAITING_JOB,      // Nothing queued; the thread pool is still working on the request
+  CLOSED             // Ready to be removed from epoll and destroyed
+};
+
+/*
+ * One entry of the pending-write queue: bytes copied into a pooled
+ * buffer, a shared cached response, or a byte range of a cached file,
+ * sent from the page cache with sendfile()
+ */
+struct WriteChunk {
+  IoBuffer copied;                                 // Set for queue_copy() bytes
+  std::shared_ptr<const std::string> shared_data;  // Set for cached responses
+  std::shared_ptr<const CachedFile> file;          // Set for file ranges
+  off_t file_offset;
+  size_t file_length;
+
+  WriteChunk() : file_offset(0), file_length(0) {}
+
+  explicit WriteChunk(std::shared_ptr<const std::string> bytes)
+    : shared_data(std::move(bytes)), file_offset(0), file_length(0) {}
+
+  WriteChunk(std::shared_ptr<const CachedFile> source, off_t offset, size_t length)
+    : file(std::move(source)), file_offset(offset), file_length(length) {}
+
+  bool is_file() const { return file != nullptr; }
+  bool is_copy() const { return !file && !shared_data; }
+  const char* bytes() const { return shared_data ? shared_data->data() : copied.data(); }
+  size_t size() const {
+    return is_file() ? file_length : shared_data ? shared_data->size() : copied.size();
+  }
+};
+
+/*
+ * Per-connection state for a non-blocking client socket.
+ *
+ * Received bytes and small response pieces live in buffers borrowed from
+ * the thread's BufferPool, held only while there is data in them, so an
+ * idle keep-alive connection holds no buffer memory.
+ *
+ * The event loop stores a pointer to this object in epoll_event.data.ptr
+ * and calls handle_events() as EPOLLIN / EPOLLOUT fire. Nothing blocks:
+ * partial requests stay in read_buffer until the header block is complete,
+ * and partial writes stay in write_queue until the socket drains. The
+ * parser resumes where it stopped, so a slowly arriving header block is
+ * scanned once; a request body, which no handler reads, is skipped by
+ * its Content-Length or chunked framing.
+ *
+ * Pipelined requests are answered in order. Every complete request in
+ * read_buffer is handled before anything is written, and the queued
+ * responses go out together in one sendmsg() per event. File bodies are
+ * queued as file ranges and go out with sendfile(); the header in front
+ * of one is sent with MSG_MORE so both leave in the same packets.
+ *
+ * Engines that do their own socket I/O (io_uring) skip handle_events()
+ * and drive the same state machine through consume_input(),
+ * consume_eof(), fill_write_iovecs(), complete_write() and resume_input().
+ */
+struct Connection {
+  int fd;
+  ConnState state;
+
+  // Bytes received but not yet consumed by the request handler
+  IoBuffer read_buffer;
+
+  // Request parsing; request's views point into read_buffer
+  HttpParser parser;
+  HttpRequest request;
+  BodyDecoder body_decoder;
+  bool discarding_body;  // Skipping the body of the last request
+
+  // CGI program answering the current request; no further requests are
+  // answered until it finishes (the event loop owns the object)
+  CgiProcess* cgi;
+
+  // Blocking work for the current request running on the thread pool;
+  // held back the same way (see OffloadQueue)
+  PoolJob* job;
+
+  // Response chunks waiting to be sent, oldest first
+  std::deque<WriteChunk> write_queue;
+  size_t write_offset;   // Bytes of write_queue.front() already sent
+  size_t pending_bytes;  // Unsent bytes across the whole queue
+
+  // Events currently registered with epoll for this fd
+  uint32_t registered_events;
+
+  // Keep-alive bookkeeping
+  bool keep_alive;                // Keep the socket open after this response
+  bool close_after_write;         // No more requests; close once the queue drains
+  unsigned int requests_served;   // Requests handled on this connection
+
+  // Timeouts; the owning event loop keeps timer armed at deadline_ms()
+  TimerNode timer;
+  uint64_t request_started_ms;    // First byte of the request head being read
+  uint64_t last_active_ms;        // Last time bytes moved in either direction
+
+  // Latency of the request being answered, recorded once its response
+  // has been sent. A pipelined request answered while the previous
+  // response is still queued ends that one's timing then instead.
+  uint64_t request_started_us;    // request_started_ms, in microseconds
+  uint64_t timing_started_us;     // request_started_us of the request being answered
+  uint64_t timing_parsed_us;      // Its header block was complete
+  RequestClass response_class;
+  int response_status;            // Set by whatever queues the response head
+  bool timing_open;               // Answered, not all sent yet
+
+  explicit Connection(int client_fd);
+  ~Connection();
+
+  Connection(const Connection&) = delete;
+  Connection& operator=(const Connection&) = delete;
+
+  /*
+   * Event handler driven by the epoll loop: read what is available,
+   * answer every complete request, then flush the queue once
+   */
+  void handle_events(uint32_t events);
+
+  /*
+   * Engine-neutral I/O: feed received bytes (or end of stream) into the
+   * request handler, and describe / retire the bytes waiting to be sent.
+   * fill_write_iovecs() stops at the first file range in the queue.
+   */
+  void consume_input(const char* data, size_t length);
+  void consume_eof();
+  int fill_write_iovecs(struct iovec* iov, int max_iov) const;
+  void complete_write(size_t bytes_sent);
+  void resume_input();  // Answer requests held back while the queue was full
+
+  /*
+   * Wants more request bytes (mirrors EPOLLIN in wanted_events()). Not
+   * while read_buffer is full: a level-triggered EPOLLIN would then fire
+   * on every wait and read nothing until a CGI program or pool job
+   * finishes and its requests are consumed.
+   */
+  bool wants_input() const;
+
+  /*
+   * Append response bytes (copied into the pooled buffer at the back of
+   * the queue while they fit), a shared cached response, or a range of
+   * an open file to the pending-write queue
+   */
+  void queue_copy(const char* data, size_t length);
+  void queue_copy(std::string_view data) { queue_copy(data.data(), data.size()); }
+  void queue_write(std::shared_ptr<const std::string> data);
+  void queue_file(std::shared_ptr<const CachedFile> file, off_t offset, size_t length);
+
+  /*
+   * Epoll interest set that matches the current parse state
+   */
+  uint32_t wanted_events() const;
+
+  /*
+   * When the connection times out in its current phase: a stalled write,
+   * a silent CGI program, a stuck pool job, a stalled body, an idle
+   * keep-alive wait, or a header block that has taken too long to arrive.
+   * The header deadline runs from the request's first byte and is not
+   * extended by later ones, so a client trickling bytes cannot hold the
+   * connection open.
+   */
+  uint64_t deadline_ms() const;
+
+private:
+  bool read_available();
+  void process_input();
+  void flush_writes();
+  ssize_t send_memory_chunks(size_t& attempted);
+  ssize_t send_file_chunk(size_t& attempted);
+  void update_state();
+  void start_timing();
+  void finish_timing(uint64_t now_us);
+};
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <linux/io_uring.h>
+
+/*
+ * Minimal io_uring submission/completion ring built on the raw
+ * io_uring_setup / io_uring_enter / io_uring_register system calls,
+ * so the server keeps its no-external-dependencies design.
+ *
+ * Not thread-safe: each UringReactor owns one ring.
+ */
+class IoUringRing {
+public:
+  IoUringRing();
+  ~IoUringRing();
+
+  IoUringRing(const IoUringRing&) = delete;
+  IoUringRing& operator=(const IoUringRing&) = delete;
+
+  /*
+   * Create the ring. Returns 0 on success or a negative errno
+   * (e.g. -ENOSYS when the kernel has no io_uring support).
+   */
+  int init(unsigned int entries);
+
+  /*
+   * Next free submission entry, zeroed. Flushes queued entries to the
+   * kernel first if the submission ring is full.
+   */
+  struct io_uring_sqe* get_sqe();
+
+  /*
+   * Make room for `count` consecutive entries, so a linked chain is
+   * never split across two submissions
+   */
+  void reserve(unsigned int count);
+
+  /*
+   * Hand all queued entries to the kernel and wait until at least
+   * min_complete completions are available. Returns the io_uring_enter()
+   * result, or a negative errno.
+   */
+  int submit_and_wait(unsigned int min_complete);
+
+  /*
+   * Iterate over available completions. Call cqe_advance() once done
+   * with the entry returned by peek_cqe().
+   */
+  struct io_uring_cqe* peek_cqe();
+  void cqe_advance();
+
+  /*
+   * Register a provided-buffer ring of `count` buffers (power of two)
+   * of `size` bytes each under buffer group `group_id`.
+   * Returns 0 on success or a negative errno.
+   */
+  int setup_buffer_ring(uint16_t group_id, unsigned int count, unsigned int size);
+
+  /*
+   * Buffer selected by the kernel for a completion, and returning it
+   * to the provided-buffer ring once its bytes have been consumed
+   */
+  char* buffer_address(uint16_t buffer_id) const;
+  void recycle_buffer(uint16_t buffer_id);
+
+private:
+  int ring_fd;
+
+  // Submission queue
+  void* sq_ring;
+  size_t sq_ring_size;
+  unsigned* sq_head;
+  unsigned* sq_tail;
+  unsigned* sq_mask;
+  unsigned* sq_array;
+  struct io_uring_sqe* sqes;
+  size_t sqes_size;
+  unsigned sqe_tail;  // Entries handed out by get_sqe()
+
+  // Completion queue
+  void* cq_ring;
+  size_t cq_ring_size;
+  unsigned* cq_head;
+  unsigned* cq_tail;
+  unsigned* cq_mask;
+  struct io_uring_cqe* cqes;
+
+  // Provided-buffer ring
+  struct io_uring_buf_ring* buf_ring;
+  size_t buf_ring_size;
+  char* buf_base;
+  unsigned int buf_count;
+  unsigned int buf_size;
+  uint16_t buf_tail;
+};
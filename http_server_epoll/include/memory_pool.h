@@ -0,0 +1,225 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include <utility>
+#include <vector>
+
+/*
+ * Memory pool constants
+ */
+constexpr size_t SLAB_OBJECTS = 64;                   // Objects carved from one slab
+constexpr size_t BUFFER_CLASS_MIN = 4096;             // Smallest buffer size class
+constexpr size_t BUFFER_CLASS_COUNT = 6;              // 4 KiB doubling up to 128 KiB
+constexpr size_t BUFFER_POOL_IDLE_BUDGET = 4194304;   // Idle bytes one pool keeps for reuse
+
+/*
+ * Which totals a pool's usage is counted in
+ */
+enum class PoolKind {
+  CONNECTIONS,  // Slabs of connection objects
+  BUFFERS       // Size-classed I/O buffers
+};
+
+/*
+ * Usage counters of one pool. Only the thread that owns the pool writes
+ * them, so they cost no contention; /metrics sums them over every live
+ * pool of a kind with relaxed loads.
+ */
+struct PoolUsage {
+  std::atomic<size_t> in_use;          // Objects or buffers handed out
+  std::atomic<size_t> in_use_bytes;
+  std::atomic<size_t> high_water_bytes;  // Most bytes handed out at once
+  std::atomic<size_t> reserved_bytes;  // Held from the allocator: handed out or idle
+
+  explicit PoolUsage(PoolKind kind);
+  ~PoolUsage();
+
+  PoolUsage(const PoolUsage&) = delete;
+  PoolUsage& operator=(const PoolUsage&) = delete;
+
+  void handed_out(size_t bytes);
+  void taken_back(size_t bytes);
+  void reserve(size_t bytes) { add(reserved_bytes, bytes); }
+  void unreserve(size_t bytes) { add(reserved_bytes, 0 - bytes); }
+
+private:
+  static void add(std::atomic<size_t>& counter, size_t delta) {
+    counter.store(counter.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+  }
+
+  PoolKind kind;
+};
+
+/*
+ * Sum of PoolUsage over every live pool of one kind. The high-water
+ * mark is the sum of each pool's own, an upper bound on the true peak.
+ */
+struct PoolTotals {
+  size_t in_use = 0;
+  size_t in_use_bytes = 0;
+  size_t high_water_bytes = 0;
+  size_t reserved_bytes = 0;
+};
+
+PoolTotals pool_totals(PoolKind kind);
+
+/*
+ * Fixed-size objects carved from slabs of SLAB_OBJECTS, recycled through
+ * a free list. Slabs are kept for the pool's lifetime, so connection
+ * churn costs no allocator calls once the pool has grown to the peak
+ * connection count, and memory stays flat at that peak.
+ *
+ * Not thread-safe: each event loop owns its own pool.
+ */
+template <typename T>
+class SlabPool {
+public:
+  SlabPool() : usage(PoolKind::CONNECTIONS), free_list(nullptr) {}
+
+  ~SlabPool() {
+    for (Slot* slab : slabs) {
+      ::operator delete(slab);
+    }
+  }
+
+  SlabPool(const SlabPool&) = delete;
+  SlabPool& operator=(const SlabPool&) = delete;
+
+  template <typename... Args>
+  T* create(Args&&... args) {
+    if (!free_list) {
+      grow();
+    }
+    Slot* slot = free_list;
+    free_list = slot->next;
+
+    T* object = new (slot->storage) T(std::forward<Args>(args)...);
+    usage.handed_out(sizeof(T));
+    return object;
+  }
+
+  void destroy(T* object) {
+    object->~T();
+    Slot* slot = reinterpret_cast<Slot*>(object);
+    slot->next = free_list;
+    free_list = slot;
+    usage.taken_back(sizeof(T));
+  }
+
+private:
+  // Aligned like `new T` would be: the engines keep tags in the low bits
+  // of connection pointers
+  union alignas(T) alignas(std::max_align_t) Slot {
+    Slot* next;
+    unsigned char storage[sizeof(T)];
+  };
+  static_assert(alignof(Slot) <= __STDCPP_DEFAULT_NEW_ALIGNMENT__,
+                "slabs come from plain operator new");
+
+  void grow() {
+    Slot* slab = static_cast<Slot*>(::operator new(sizeof(Slot) * SLAB_OBJECTS));
+    slabs.push_back(slab);
+    for (size_t i = SLAB_OBJECTS; i > 0; --i) {
+      slab[i - 1].next = free_list;
+      free_list = &slab[i - 1];
+    }
+    usage.reserve(sizeof(Slot) * SLAB_OBJECTS);
+  }
+
+  PoolUsage usage;
+  Slot* free_list;
+  std::vector<Slot*> slabs;
+};
+
+/*
+ * I/O buffers in power-of-two size classes from BUFFER_CLASS_MIN, one
+ * pool per thread. Returned buffers are kept for reuse up to
+ * BUFFER_POOL_IDLE_BUDGET bytes and freed past it, so a burst does not
+ * pin its peak memory. Requests above the largest class are allocated
+ * exactly and never kept.
+ *
+ * A buffer may be given back on another thread than the one it was
+ * lent on; it then joins that thread's pool.
+ */
+class BufferPool {
+public:
+  BufferPool();
+  ~BufferPool();
+
+  BufferPool(const BufferPool&) = delete;
+  BufferPool& operator=(const BufferPool&) = delete;
+
+  static BufferPool& for_this_thread();
+
+  /*
+   * A buffer of at least `size` bytes; its real size is stored in
+   * `capacity` and must be passed back to give_back()
+   */
+  char* lend(size_t size, size_t& capacity);
+  void give_back(char* buffer, size_t capacity);
+
+private:
+  static int class_of(size_t size);
+
+  PoolUsage usage;
+  std::vector<char*> idle[BUFFER_CLASS_COUNT];
+  size_t idle_bytes;
+};
+
+/*
+ * A byte queue whose storage is borrowed from the thread's BufferPool
+ * only while it holds data: it is lent on the first append and given
+ * back as soon as everything has been consumed. Bytes are appended at
+ * the back and consumed from the front; growing moves the contents to
+ * a buffer of the next size class.
+ */
+class IoBuffer {
+public:
+  IoBuffer() : storage(nullptr), capacity(0), start(0), end(0) {}
+  ~IoBuffer() { release(); }
+
+  IoBuffer(IoBuffer&& other) noexcept;
+  IoBuffer& operator=(IoBuffer&& other) noexcept;
+  IoBuffer(const IoBuffer&) = delete;
+  IoBuffer& operator=(const IoBuffer&) = delete;
+
+  const char* data() const { return storage + start; }
+  size_t size() const { return end - start; }
+  bool empty() const { return start == end; }
+
+  /*
+   * Room for at least `length` more bytes at the back (lending or
+   * growing the storage as needed); commit() what was written there
+   */
+  char* prepare(size_t length);
+  void commit(size_t length) { end += length; }
+
+  void append(const char* bytes, size_t length);
+
+  /*
+   * Bytes that fit at the back without moving the contents
+   */
+  size_t spare() const { return capacity - end; }
+
+  /*
+   * Drop bytes from the front; the storage goes back to the pool once
+   * the buffer is empty
+   */
+  void consume(size_t length);
+
+  /*
+   * Give the storage back if nothing is held (e.g. after a prepare()
+   * that read nothing)
+   */
+  void release_if_empty();
+
+private:
+  void release();
+
+  char* storage;
+  size_t capacity;
+  size_t start;  // First unconsumed byte
+  size_t end;    // One past the last byte
+};
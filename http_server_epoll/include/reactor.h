@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <unordered_set>
+#include <vector>
+
+#include "timer_wheel.h"
+#include "load_shedder.h"
+#include "cgi_worker_pool.h"
+#include "thread_pool.h"
+#include "memory_pool.h"
+#include "connection.h"
+
+struct CgiProcess;
+
+/*
+ * Upper bound on connections accepted per listening-socket wakeup,
+ * so a connection storm cannot starve already-connected clients
+ */
+constexpr int ACCEPT_BATCH_LIMIT = 64;
+
+/*
+ * A single-threaded epoll event loop.
+ *
+ * Each reactor owns its listening socket, its epoll instance and the
+ * connections it accepted, so several reactors can run side by side on
+ * different threads without sharing anything on the hot path. With
+ * SO_REUSEPORT the kernel spreads incoming connections across their
+ * listening sockets.
+ *
+ * Connection deadlines live in a timer wheel; epoll_wait sleeps until
+ * the earliest one, so timeouts cost nothing per idle connection.
+ *
+ * CGI programs started by a request are adopted by the reactor: their
+ * output pipe and pidfd join the epoll set next to the sockets, so a
+ * slow program delays only the client it is answering. Programs run as
+ * persistent workers are reached through the reactor's own
+ * CgiWorkerPool, whose sockets are watched the same way.
+ *
+ * In the hybrid engine the reactor also hands blocking work, such as
+ * opening and reading a file the caches do not hold, to a ThreadPool
+ * shared by all reactors. Finished jobs come back through an eventfd in
+ * the same epoll set; pool threads never touch a socket.
+ *
+ * With load shedding on (-L), the time the loop spends on each batch of
+ * events is the delay the LoadShedder watches: while it stands above
+ * the target, new connections get an immediate 503 instead of joining
+ * the backlog of work.
+ *
+ * Connections and CGI processes released while a batch of events is
+ * handled are freed after the batch, so a later event in the same
+ * batch never refers to freed memory.
+ */
+class Reactor {
+public:
+  Reactor(int id, int port, bool reuse_port, ThreadPool* pool = nullptr);
+  ~Reactor();
+
+  Reactor(const Reactor&) = delete;
+  Reactor& operator=(const Reactor&) = delete;
+
+  /*
+   * Run the event loop forever
+   */
+  void run();
+
+private:
+  void accept_connections();
+  void register_connection(int client_fd);
+  bool update_interest(Connection* conn);
+  void close_connection(Connection* conn);
+  void service_connection(Connection* conn);
+  void schedule_timeout(Connection* conn);
+  void close_expired_connections();
+
+  void adopt_cgi(Connection* conn);
+  void update_cgi_interest(CgiProcess* cgi);
+  void release_cgi_output(CgiProcess* cgi);
+  void handle_cgi_output(CgiProcess* cgi);
+  void handle_cgi_exit(CgiProcess* cgi);
+  void retire_cgi_if_finished(CgiProcess* cgi);
+  void reap_cgi_without_pidfd();
+
+  void update_worker_interest(CgiWorker* worker);
+  void handle_cgi_worker(CgiWorker* worker, uint32_t events);
+  void restart_cgi_workers();
+  void finish_offloaded_jobs();
+  void free_released();
+
+  int id;
+  int listen_fd;
+  int epoll_fd;
+  SlabPool<Connection> connection_pool;
+  std::unordered_set<Connection*> connections;
+  std::unordered_set<CgiProcess*> cgi_processes;
+  std::vector<CgiProcess*> unreaped;            // Children without a pidfd, polled for exit
+  std::vector<Connection*> closed_connections;  // Freed after the current batch
+  std::vector<CgiProcess*> retired_cgi;         // Freed after the current batch
+  TimerWheel timers;
+  CgiWorkerPool cgi_workers;
+  std::unique_ptr<OffloadQueue> offload;        // Hybrid engine only
+  LoadShedder shedder;
+};
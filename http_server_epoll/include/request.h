@@ -5,6 +5,10 @@
 #include <sys/wait.h>
 #include <sys/socket.h>
 #include <cassert>
+#include <string>
+
+struct Connection;
+struct HttpRequest;
 
 /*
  * Request handling constants
@@ -12,9 +16,23 @@
 constexpr size_t REQUEST_BUFFER_SIZE = 8192;
 
 /*
- * Entry point for handling a single HTTP request
+ * Entry point for handling a single parsed HTTP request.
+ * The response is appended to the connection's pending-write queue.
  */
-void handle_http_request(int client_fd);
+void handle_http_request(Connection& conn, const HttpRequest& request);
+
+/*
+ * Connection header matching the keep-alive decision for this request
+ */
+const char* connection_header(const Connection& conn);
+
+/*
+ * Queue an HTTP error response on the connection
+ */
+void send_error_response(Connection& conn,
+                         int status_code,
+                         const std::string& long_msg,
+                         const std::string& cause);
 
 /*
  * System-call wrappers that abort on failure
@@ -48,3 +66,9 @@ void handle_http_request(int client_fd);
 
 #define WAIT_OR_DIE(status) \
   ({ pid_t pid = wait(status); assert(pid >= 0); pid; })
+
+#define PIPE_OR_DIE(fds) \
+  ({ int rc = pipe(fds); assert(rc == 0); rc; })
+
+#define WAITPID_OR_DIE(pid, status, options) \
+  ({ pid_t rc = waitpid(pid, status, options); assert(rc >= 0); rc; })
@@ -1,56 +1,57 @@
+#pragma once
+
+#include <unistd.h>
+#include <fcntl.h>
 #include <sys/socket.h>
-#include <arpa/inet.h>
-#include <iostream>
-#include <strings.h>
+#include <netinet/in.h>
 #include <cassert>
 
-#include "include/socket_utils.h"
+/*
+ * Socket type aliases
+ */
+using sockaddr_t    = struct sockaddr;
+using sockaddr_in_t = struct sockaddr_in;
+
+/*
+ * Server configuration constants
+ */
+constexpr int DEFAULT_PORT   = 10000;
+constexpr int LISTEN_BACKLOG = 1024;
+constexpr int QUEUE_SIZE     = LISTEN_BACKLOG;
+constexpr int MAX_EVENTS     = 1024;
 
 /*
  * Create, bind, and listen on a TCP socket.
- * Returns the listening socket file descriptor.
+ * Both return the listening socket file descriptor, or -1 on failure.
+ * create_listening_socket() can also enable SO_REUSEPORT so that one
+ * socket per reactor thread can share the port.
+ */
+int create_listening_socket(int port, bool reuse_port = false);
+int open_listen_fd(int port);
+
+/*
+ * Put a file descriptor into non-blocking mode.
+ * Returns 0 on success, -1 on failure.
+ */
+int set_nonblocking(int fd);
+
+/*
+ * Convenience wrappers that abort on failure
  */
-int create_listening_socket(int port) {
-  int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
-  if (listen_fd < 0) {
-    std::cerr << "[Error] Failed to create socket\n";
-    return -1;
-  }
-
-  // Allow immediate reuse of the address after server restart
-  int reuse_addr = 1;
-  if (setsockopt(
-        listen_fd,
-        SOL_SOCKET,
-        SO_REUSEADDR,
-        &reuse_addr,
-        sizeof(reuse_addr)) < 0) {
-    std::cerr << "[Error] setsockopt(SO_REUSEADDR) failed\n";
-    return -1;
-  }
-
-  // Initialize server address structure
-  sockaddr_in_t server_addr;
-  bzero(&server_addr, sizeof(server_addr));
-
-  server_addr.sin_family      = AF_INET;
-  server_addr.sin_addr.s_addr = htonl(INADDR_ANY);
-  server_addr.sin_port        = htons(static_cast<unsigned short>(port));
-
-  // Bind socket to address and port
-  if (bind(
-        listen_fd,
-        reinterpret_cast<sockaddr_t*>(&server_addr),
-        sizeof(server_addr)) < 0) {
-    std::cerr << "[Error] bind() failed\n";
-    return -1;
-  }
-
-  // Start listening for incoming connections
-  if (listen(listen_fd, LISTEN_BACKLOG) < 0) {
-    std::cerr << "[Error] listen() failed\n";
-    return -1;
-  }
-
-  return listen_fd;
+inline int open_listen_fd_or_die(int port) {
+  int fd = open_listen_fd(port);
+  assert(fd >= 0);
+  return fd;
+}
+
+inline void chdir_or_die(const char* path) {
+  int rc = chdir(path);
+  assert(rc == 0);
+  (void)rc;
+}
+
+inline int accept_or_die(int listen_fd) {
+  int conn_fd = accept(listen_fd, nullptr, nullptr);
+  assert(conn_fd >= 0);
+  return conn_fd;
 }
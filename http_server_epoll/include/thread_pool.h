@@ -0,0 +1,106 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct Connection;
+class OffloadQueue;
+
+/*
+ * Thread pool constants
+ */
+constexpr size_t DEFAULT_POOL_THREADS = 4;
+
+/*
+ * Blocking work taken off an event loop for one request.
+ *
+ * work() runs on a pool thread and may only touch what it captured; it
+ * never sees the connection or its socket. finish() then runs back on
+ * the event loop, and only if the client is still connected.
+ */
+struct PoolJob {
+  Connection* conn;  // nullptr once the client is gone
+  OffloadQueue* origin;
+  std::function<void()> work;
+  std::function<void(Connection&)> finish;
+};
+
+/*
+ * Worker threads shared by every event loop of the hybrid engine. They
+ * run jobs in submission order and hand each one back to the loop that
+ * submitted it.
+ */
+class ThreadPool {
+public:
+  explicit ThreadPool(size_t num_threads);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  void submit(PoolJob* job);
+
+private:
+  void run();
+
+  std::vector<std::thread> threads;
+  std::mutex mutex;
+  std::condition_variable job_ready;
+  std::deque<PoolJob*> jobs;
+  bool stopping;
+};
+
+/*
+ * One event loop's side of the thread pool: jobs go out through
+ * submit(), and finished ones come back through an eventfd the loop
+ * watches, so pool threads never touch the loop's connections.
+ *
+ * A connection has at most one job in flight (Connection::job) and
+ * answers no further requests until it is back. A job whose client
+ * disconnects meanwhile is abandoned and freed when it returns.
+ */
+class OffloadQueue {
+public:
+  explicit OffloadQueue(ThreadPool& pool);
+  ~OffloadQueue();
+
+  OffloadQueue(const OffloadQueue&) = delete;
+  OffloadQueue& operator=(const OffloadQueue&) = delete;
+
+  /*
+   * The queue of the event loop running on this thread, for the request
+   * handler; nullptr if the engine does not offload
+   */
+  static OffloadQueue* for_this_thread();
+  void bind_to_this_thread();
+
+  /*
+   * Run `work` on the pool, then `finish` on this loop
+   */
+  void submit(Connection& conn, std::function<void()> work,
+              std::function<void(Connection&)> finish);
+
+  /*
+   * Called by a pool thread when a job is done; wakes the loop
+   */
+  void complete(PoolJob* job);
+
+  /*
+   * Take the finished jobs (the caller deletes them) and clear the
+   * eventfd
+   */
+  void drain(std::vector<PoolJob*>& finished);
+
+  int fd() const { return event_fd; }
+
+private:
+  ThreadPool& pool;
+  int event_fd;
+  std::mutex mutex;
+  std::vector<PoolJob*> done;
+};
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <ctime>
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <vector>
+#include <unordered_set>
+#include <linux/io_uring.h>
+
+#include "io_uring_ring.h"
+#include "timer_wheel.h"
+#include "cgi_worker_pool.h"
+#include "memory_pool.h"
+#include "load_shedder.h"
+
+struct CgiProcess;
+
+/*
+ * io_uring engine constants
+ */
+constexpr unsigned int URING_QUEUE_DEPTH    = 4096;
+constexpr unsigned int URING_BUFFER_COUNT   = 1024;  // Provided recv buffers (power of two)
+constexpr uint16_t     URING_BUFFER_GROUP   = 0;
+constexpr int          URING_MAX_SEND_IOVECS = 64;
+constexpr size_t       URING_FILE_CHUNK_SIZE = 65536;  // File bytes staged per read + send
+constexpr int          URING_MAX_TICK_MS    = 1000;    // Longest sleep of the timeout op
+
+/*
+ * An io_uring event loop, the alternative to the epoll Reactor.
+ *
+ * Accept, recv and send all go through one ring per reactor:
+ *   - a multishot accept keeps the listening socket armed,
+ *   - recv picks its buffer from a provided-buffer ring, so idle
+ *     connections pin no memory,
+ *   - a file body is read into a staging buffer, lent from the
+ *     thread's BufferPool while the send chain is in flight, and sent
+ *     by a read linked to a send, behind the header's sendmsg,
+ *   - a send that ends the connection is linked to a shutdown, so the
+ *     FIN follows the last byte without another round trip,
+ *   - a CGI program's output pipe and pidfd are watched with one-shot
+ *     poll operations, re-armed while the client can take more output,
+ *     and so are the sockets of persistent CGI workers.
+ *
+ * Requests are parsed and answered by the same Connection state machine
+ * and request handler as the epoll engine; only the socket I/O differs.
+ * Deadlines use the same timer wheel, driven by a timeout operation
+ * that sleeps until the earliest one (at most URING_MAX_TICK_MS, since
+ * a pending timeout is not moved when an earlier deadline appears).
+ */
+class UringReactor {
+public:
+  UringReactor(int id, int port, bool reuse_port);
+  ~UringReactor();
+
+  UringReactor(const UringReactor&) = delete;
+  UringReactor& operator=(const UringReactor&) = delete;
+
+  /*
+   * Set up the ring and buffers. Returns 0 or a negative errno,
+   * e.g. when the kernel lacks io_uring or blocks it.
+   */
+  int init();
+
+  /*
+   * Run the event loop forever
+   */
+  void run();
+
+private:
+  struct UringConnection;
+
+  void arm_accept();
+  void arm_timeout();
+  void arm_recv(UringConnection* uc);
+  void arm_send(UringConnection* uc);
+  void arm_poll(int fd, uint64_t user_data);
+  void arm_worker(CgiWorker* worker);
+
+  void handle_completion(uint64_t user_data, int32_t res, uint32_t flags);
+  void on_accept(int32_t res, uint32_t flags);
+  void on_recv(UringConnection* uc, int32_t res, uint32_t flags);
+  void on_read(UringConnection* uc, int32_t res);
+  void on_send(UringConnection* uc, int32_t res);
+  void on_shutdown(UringConnection* uc, int32_t res);
+  void on_cgi_output(CgiProcess* cgi);
+  void on_cgi_exit(CgiProcess* cgi);
+  void on_worker_ready(CgiWorker* worker, bool readable);
+
+  void adopt_cgi(UringConnection* uc);
+  void retire_cgi_if_finished(CgiProcess* cgi);
+  void reap_cgi_without_pidfd();
+  void restart_cgi_workers();
+
+  void service(UringConnection* uc);
+  void begin_close(UringConnection* uc);
+  void release_if_done(UringConnection* uc);
+  void retry_starved_recvs();
+  void close_expired_connections();
+
+  int id;
+  int listen_fd;
+  IoUringRing ring;
+  struct __kernel_timespec tick;
+  std::unique_ptr<SlabPool<UringConnection>> connection_pool;  // Type is private to the .cpp
+  std::unordered_set<UringConnection*> connections;
+  TimerWheel timers;
+  std::vector<UringConnection*> starved;  // recv hit ENOBUFS; retried next loop
+  std::unordered_set<CgiProcess*> cgi_processes;
+  std::vector<CgiProcess*> unreaped;      // Children without a pidfd, polled on each tick
+  CgiWorkerPool cgi_workers;
+  LoadShedder shedder;                    // Watches the time spent per batch of completions
+};
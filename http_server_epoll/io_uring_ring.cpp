@@ -0,0 +1,214 @@
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "include/io_uring_ring.h"
+
+/*
+ * Raw system-call wrappers (no liburing)
+ */
+static int sys_io_uring_setup(unsigned int entries, struct io_uring_params* params) {
+  return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+static int sys_io_uring_enter(int fd, unsigned int to_submit,
+                              unsigned int min_complete, unsigned int flags) {
+  return static_cast<int>(
+      syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0));
+}
+
+static int sys_io_uring_register(int fd, unsigned int opcode, void* arg, unsigned int nr_args) {
+  return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, nr_args));
+}
+
+/*
+ * Ring indices are shared with the kernel
+ */
+static inline unsigned load_acquire(const unsigned* p) {
+  return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+static inline void store_release(unsigned* p, unsigned v) {
+  __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+
+IoUringRing::IoUringRing()
+  : ring_fd(-1),
+    sq_ring(MAP_FAILED), sq_ring_size(0),
+    sq_head(nullptr), sq_tail(nullptr), sq_mask(nullptr), sq_array(nullptr),
+    sqes(static_cast<struct io_uring_sqe*>(MAP_FAILED)), sqes_size(0),
+    sqe_tail(0),
+    cq_ring(MAP_FAILED), cq_ring_size(0),
+    cq_head(nullptr), cq_tail(nullptr), cq_mask(nullptr), cqes(nullptr),
+    buf_ring(static_cast<struct io_uring_buf_ring*>(MAP_FAILED)), buf_ring_size(0),
+    buf_base(nullptr), buf_count(0), buf_size(0), buf_tail(0) {}
+
+IoUringRing::~IoUringRing() {
+  if (buf_ring != MAP_FAILED) {
+    munmap(buf_ring, buf_ring_size);
+  }
+  delete[] buf_base;
+  if (sqes != MAP_FAILED) {
+    munmap(sqes, sqes_size);
+  }
+  if (cq_ring != MAP_FAILED && cq_ring != sq_ring) {
+    munmap(cq_ring, cq_ring_size);
+  }
+  if (sq_ring != MAP_FAILED) {
+    munmap(sq_ring, sq_ring_size);
+  }
+  if (ring_fd >= 0) {
+    close(ring_fd);
+  }
+}
+
+int IoUringRing::init(unsigned int entries) {
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+
+  ring_fd = sys_io_uring_setup(entries, &params);
+  if (ring_fd < 0) {
+    return -errno;
+  }
+
+  // Map the submission and completion rings (one mapping on modern kernels)
+  sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+  if (single_mmap) {
+    sq_ring_size = cq_ring_size = (sq_ring_size > cq_ring_size) ? sq_ring_size : cq_ring_size;
+  }
+
+  sq_ring = mmap(nullptr, sq_ring_size, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+  if (sq_ring == MAP_FAILED) {
+    return -errno;
+  }
+
+  if (single_mmap) {
+    cq_ring = sq_ring;
+  } else {
+    cq_ring = mmap(nullptr, cq_ring_size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+    if (cq_ring == MAP_FAILED) {
+      return -errno;
+    }
+  }
+
+  sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+  void* sqes_ptr = mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+  if (sqes_ptr == MAP_FAILED) {
+    return -errno;
+  }
+  sqes = static_cast<struct io_uring_sqe*>(sqes_ptr);
+
+  char* sq = static_cast<char*>(sq_ring);
+  sq_head  = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+  sq_tail  = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+  sq_mask  = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+  sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+
+  char* cq = static_cast<char*>(cq_ring);
+  cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+  cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+  cq_mask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+  cqes    = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+
+  sqe_tail = *sq_tail;
+  return 0;
+}
+
+void IoUringRing::reserve(unsigned int count) {
+  unsigned entries = *sq_mask + 1;
+  while (sqe_tail - load_acquire(sq_head) + count > entries) {
+    submit_and_wait(0);
+  }
+}
+
+struct io_uring_sqe* IoUringRing::get_sqe() {
+  reserve(1);
+
+  unsigned index = sqe_tail & *sq_mask;
+  struct io_uring_sqe* sqe = &sqes[index];
+  memset(sqe, 0, sizeof(*sqe));
+  sq_array[index] = index;
+  sqe_tail++;
+  return sqe;
+}
+
+int IoUringRing::submit_and_wait(unsigned int min_complete) {
+  store_release(sq_tail, sqe_tail);
+
+  unsigned flags = min_complete > 0 ? IORING_ENTER_GETEVENTS : 0;
+  int rc;
+  do {
+    // Whatever the kernel has not consumed yet, including after EINTR
+    unsigned to_submit = sqe_tail - load_acquire(sq_head);
+    rc = sys_io_uring_enter(ring_fd, to_submit, min_complete, flags);
+  } while (rc < 0 && errno == EINTR);
+
+  return rc < 0 ? -errno : rc;
+}
+
+struct io_uring_cqe* IoUringRing::peek_cqe() {
+  unsigned head = *cq_head;
+  if (head == load_acquire(cq_tail)) {
+    return nullptr;
+  }
+  return &cqes[head & *cq_mask];
+}
+
+void IoUringRing::cqe_advance() {
+  store_release(cq_head, *cq_head + 1);
+}
+
+int IoUringRing::setup_buffer_ring(uint16_t group_id, unsigned int count, unsigned int size) {
+  buf_ring_size = count * sizeof(struct io_uring_buf);
+  void* ring_mem = mmap(nullptr, buf_ring_size, PROT_READ | PROT_WRITE,
+                        MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+  if (ring_mem == MAP_FAILED) {
+    return -errno;
+  }
+  buf_ring = static_cast<struct io_uring_buf_ring*>(ring_mem);
+
+  struct io_uring_buf_reg reg;
+  memset(&reg, 0, sizeof(reg));
+  reg.ring_addr    = reinterpret_cast<uint64_t>(buf_ring);
+  reg.ring_entries = count;
+  reg.bgid         = group_id;
+
+  if (sys_io_uring_register(ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+    return -errno;
+  }
+
+  buf_count = count;
+  buf_size  = size;
+  buf_base  = new char[static_cast<size_t>(count) * size];
+  buf_tail  = 0;
+
+  for (unsigned int id = 0; id < count; ++id) {
+    recycle_buffer(static_cast<uint16_t>(id));
+  }
+  return 0;
+}
+
+char* IoUringRing::buffer_address(uint16_t buffer_id) const {
+  return buf_base + static_cast<size_t>(buffer_id) * buf_size;
+}
+
+void IoUringRing::recycle_buffer(uint16_t buffer_id) {
+  // The entries start at offset 0, overlaying the tail. Older uapi headers
+  // declare bufs[] behind an empty struct, which C++ places at offset 8,
+  // so index from the ring base instead of using buf_ring->bufs.
+  struct io_uring_buf* entries = reinterpret_cast<struct io_uring_buf*>(buf_ring);
+  struct io_uring_buf* buf = &entries[buf_tail & (buf_count - 1)];
+  buf->addr = reinterpret_cast<uint64_t>(buffer_address(buffer_id));
+  buf->len  = buf_size;
+  buf->bid  = buffer_id;
+
+  buf_tail++;
+  __atomic_store_n(&buf_ring->tail, buf_tail, __ATOMIC_RELEASE);
+}
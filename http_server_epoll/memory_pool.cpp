@@ -0,0 +1,200 @@
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+
+#include "include/memory_pool.h"
+
+/*
+ * Every live pool's counters, by kind. Only touched when a pool is
+ * created or destroyed and when /metrics is scraped.
+ */
+static std::mutex& registry_mutex() {
+  static std::mutex mutex;
+  return mutex;
+}
+
+static std::vector<const PoolUsage*>& registry(PoolKind kind) {
+  static std::vector<const PoolUsage*> connections;
+  static std::vector<const PoolUsage*> buffers;
+  return kind == PoolKind::CONNECTIONS ? connections : buffers;
+}
+
+PoolUsage::PoolUsage(PoolKind pool_kind)
+  : in_use(0), in_use_bytes(0), high_water_bytes(0), reserved_bytes(0), kind(pool_kind) {
+  std::lock_guard<std::mutex> lock(registry_mutex());
+  registry(kind).push_back(this);
+}
+
+PoolUsage::~PoolUsage() {
+  std::lock_guard<std::mutex> lock(registry_mutex());
+  std::vector<const PoolUsage*>& pools = registry(kind);
+  pools.erase(std::find(pools.begin(), pools.end(), this));
+}
+
+void PoolUsage::handed_out(size_t bytes) {
+  add(in_use, 1);
+  add(in_use_bytes, bytes);
+  size_t now = in_use_bytes.load(std::memory_order_relaxed);
+  if (now > high_water_bytes.load(std::memory_order_relaxed)) {
+    high_water_bytes.store(now, std::memory_order_relaxed);
+  }
+}
+
+void PoolUsage::taken_back(size_t bytes) {
+  add(in_use, 0 - static_cast<size_t>(1));
+  add(in_use_bytes, 0 - bytes);
+}
+
+PoolTotals pool_totals(PoolKind kind) {
+  PoolTotals totals;
+  std::lock_guard<std::mutex> lock(registry_mutex());
+  for (const PoolUsage* usage : registry(kind)) {
+    totals.in_use           += usage->in_use.load(std::memory_order_relaxed);
+    totals.in_use_bytes     += usage->in_use_bytes.load(std::memory_order_relaxed);
+    totals.high_water_bytes += usage->high_water_bytes.load(std::memory_order_relaxed);
+    totals.reserved_bytes   += usage->reserved_bytes.load(std::memory_order_relaxed);
+  }
+  return totals;
+}
+
+/* ----------------------------
+ * BufferPool
+ * ---------------------------- */
+
+BufferPool::BufferPool() : usage(PoolKind::BUFFERS), idle_bytes(0) {}
+
+BufferPool::~BufferPool() {
+  for (std::vector<char*>& buffers : idle) {
+    for (char* buffer : buffers) {
+      delete[] buffer;
+    }
+  }
+}
+
+BufferPool& BufferPool::for_this_thread() {
+  thread_local BufferPool pool;
+  return pool;
+}
+
+/*
+ * Size class that fits `size`, or -1 if it is larger than all of them
+ */
+int BufferPool::class_of(size_t size) {
+  size_t class_size = BUFFER_CLASS_MIN;
+  for (size_t index = 0; index < BUFFER_CLASS_COUNT; ++index, class_size <<= 1) {
+    if (size <= class_size) {
+      return static_cast<int>(index);
+    }
+  }
+  return -1;
+}
+
+char* BufferPool::lend(size_t size, size_t& capacity) {
+  int index = class_of(size);
+  capacity = index < 0 ? size : BUFFER_CLASS_MIN << index;
+
+  char* buffer;
+  if (index >= 0 && !idle[index].empty()) {
+    buffer = idle[index].back();
+    idle[index].pop_back();
+    idle_bytes -= capacity;
+  } else {
+    buffer = new char[capacity];
+    usage.reserve(capacity);
+  }
+  usage.handed_out(capacity);
+  return buffer;
+}
+
+void BufferPool::give_back(char* buffer, size_t capacity) {
+  // A buffer lent by another thread's pool is adopted here; only the
+  // totals over all pools stay meaningful then
+  usage.taken_back(capacity);
+
+  int index = class_of(capacity);
+  bool keep = index >= 0 && (BUFFER_CLASS_MIN << index) == capacity &&
+              idle_bytes + capacity <= BUFFER_POOL_IDLE_BUDGET;
+  if (!keep) {
+    delete[] buffer;
+    usage.unreserve(capacity);
+    return;
+  }
+  idle[index].push_back(buffer);
+  idle_bytes += capacity;
+}
+
+/* ----------------------------
+ * IoBuffer
+ * ---------------------------- */
+
+IoBuffer::IoBuffer(IoBuffer&& other) noexcept
+  : storage(other.storage), capacity(other.capacity), start(other.start), end(other.end) {
+  other.storage = nullptr;
+  other.capacity = other.start = other.end = 0;
+}
+
+IoBuffer& IoBuffer::operator=(IoBuffer&& other) noexcept {
+  if (this != &other) {
+    release();
+    storage = other.storage;
+    capacity = other.capacity;
+    start = other.start;
+    end = other.end;
+    other.storage = nullptr;
+    other.capacity = other.start = other.end = 0;
+  }
+  return *this;
+}
+
+char* IoBuffer::prepare(size_t length) {
+  if (capacity - end >= length) {
+    return storage + end;
+  }
+
+  size_t held = end - start;
+  if (storage && capacity - held >= length) {
+    // Enough room once the consumed front is reclaimed
+    memmove(storage, storage + start, held);
+  } else {
+    size_t new_capacity;
+    char* grown = BufferPool::for_this_thread().lend(held + length, new_capacity);
+    if (storage) {
+      memcpy(grown, storage + start, held);
+      BufferPool::for_this_thread().give_back(storage, capacity);
+    }
+    storage = grown;
+    capacity = new_capacity;
+  }
+  start = 0;
+  end = held;
+  return storage + end;
+}
+
+void IoBuffer::append(const char* bytes, size_t length) {
+  if (length == 0) {
+    return;
+  }
+  memcpy(prepare(length), bytes, length);
+  commit(length);
+}
+
+void IoBuffer::consume(size_t length) {
+  start += length;
+  if (start == end) {
+    release();
+  }
+}
+
+void IoBuffer::release_if_empty() {
+  if (start == end) {
+    release();
+  }
+}
+
+void IoBuffer::release() {
+  if (storage) {
+    BufferPool::for_this_thread().give_back(storage, capacity);
+  }
+  storage = nullptr;
+  capacity = start = end = 0;
+}
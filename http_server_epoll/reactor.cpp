@@ -0,0 +1,597 @@
+#include <vector>
+#include <cerrno>
+#include <cstdlib>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+#include "include/reactor.h"
+#include "include/connection.h"
+#include "include/cgi_process.h"
+#include "include/cgi_worker_pool.h"
+#include "include/socket_utils.h"
+#include "logger.h"
+
+/*
+ * epoll_event.data.ptr is nullptr for the listening socket and the
+ * OffloadQueue for its eventfd, otherwise a Connection, CgiProcess or
+ * CgiWorker pointer with its kind in the low bits
+ */
+enum EventTag : uintptr_t {
+  TAG_CONNECTION = 0,
+  TAG_CGI_OUTPUT = 1,
+  TAG_CGI_EXIT   = 2,
+  TAG_CGI_WORKER = 3,
+};
+constexpr uintptr_t TAG_MASK = 0x3;
+
+static inline void* tag_pointer(void* ptr, EventTag tag) {
+  return reinterpret_cast<void*>(reinterpret_cast<uintptr_t>(ptr) | tag);
+}
+
+/*
+ * Create the listening socket and epoll instance for one reactor
+ */
+Reactor::Reactor(int reactor_id, int port, bool reuse_port, ThreadPool* pool)
+  : id(reactor_id) {
+  shedder.configure(g_shed_target_ms);
+
+  listen_fd = create_listening_socket(port, reuse_port);
+  if (listen_fd == -1) {
+    LOG_ERROR("[Error] Reactor {} could not listen on port {}", id, port);
+    std::exit(1);
+  }
+
+  // accept_connections() drains the backlog until EAGAIN
+  if (set_nonblocking(listen_fd) == -1) {
+    LOG_ERROR("[Error] fcntl(O_NONBLOCK) listen_fd failed");
+    std::exit(1);
+  }
+
+  epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  if (epoll_fd == -1) {
+    LOG_ERROR("[Error] epoll_create1 failed");
+    std::exit(1);
+  }
+
+  // The listening socket is the only registration without a Connection
+  struct epoll_event event {};
+  event.data.ptr = nullptr;
+  event.events = EPOLLIN;
+
+  if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &event) == -1) {
+    LOG_ERROR("[Error] epoll_ctl ADD listen_fd failed");
+    std::exit(1);
+  }
+
+  if (pool) {
+    offload.reset(new OffloadQueue(*pool));
+    event.data.ptr = offload.get();
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, offload->fd(), &event) == -1) {
+      LOG_ERROR("[Error] epoll_ctl ADD offload eventfd failed");
+      std::exit(1);
+    }
+  }
+}
+
+Reactor::~Reactor() {
+  for (Connection* conn : connections) {
+    connection_pool.destroy(conn);
+  }
+  for (CgiProcess* cgi : cgi_processes) {
+    delete cgi;
+  }
+  free_released();
+  close(epoll_fd);
+  close(listen_fd);
+}
+
+void Reactor::run() {
+  struct epoll_event ready_events[MAX_EVENTS];
+
+  LOG_INFO("[Reactor {}] Entering event loop", id);
+
+  // Workers are started from the reactor's own thread, which their
+  // requests come from
+  cgi_workers.bind_to_this_thread();
+  cgi_workers.start();
+  if (offload) {
+    offload->bind_to_this_thread();
+  }
+  for (std::unique_ptr<CgiWorker>& worker : cgi_workers.workers) {
+    update_worker_interest(worker.get());
+  }
+
+  while (true) {
+    // Sleep until the earliest connection deadline, or indefinitely
+    uint64_t now = monotonic_ms();
+    int timeout = timers.next_timeout_ms(now);
+    if (!unreaped.empty() && (timeout < 0 || timeout > CGI_REAP_INTERVAL_MS)) {
+      timeout = CGI_REAP_INTERVAL_MS;
+    }
+    int restart = cgi_workers.next_restart_ms(now);
+    if (restart >= 0 && (timeout < 0 || timeout > restart)) {
+      timeout = restart;
+    }
+
+    int num_ready = epoll_wait(epoll_fd, ready_events, MAX_EVENTS, timeout);
+    if (num_ready == -1 && errno != EINTR) {
+      LOG_ERROR("[Error] epoll_wait failed");
+      std::exit(1);
+    }
+    uint64_t batch_start = shedder.enabled() ? monotonic_us() : 0;
+
+    for (int i = 0; i < num_ready; ++i) {
+      void* data = ready_events[i].data.ptr;
+      uint32_t events = ready_events[i].events;
+
+      /* ----------------------------
+       * New incoming connection
+       * ---------------------------- */
+      if (data == nullptr) {
+        accept_connections();
+        continue;
+      }
+
+      /* ----------------------------
+       * Jobs back from the thread pool
+       * ---------------------------- */
+      if (data == offload.get()) {
+        finish_offloaded_jobs();
+        continue;
+      }
+
+      uintptr_t tag = reinterpret_cast<uintptr_t>(data) & TAG_MASK;
+      void* target = reinterpret_cast<void*>(reinterpret_cast<uintptr_t>(data) & ~TAG_MASK);
+
+      /* ----------------------------
+       * CGI output or exit
+       * ---------------------------- */
+      if (tag == TAG_CGI_OUTPUT) {
+        handle_cgi_output(static_cast<CgiProcess*>(target));
+        continue;
+      }
+      if (tag == TAG_CGI_EXIT) {
+        handle_cgi_exit(static_cast<CgiProcess*>(target));
+        continue;
+      }
+      if (tag == TAG_CGI_WORKER) {
+        handle_cgi_worker(static_cast<CgiWorker*>(target), events);
+        continue;
+      }
+
+      /* ----------------------------
+       * Existing client connection
+       * ---------------------------- */
+      Connection* conn = static_cast<Connection*>(target);
+      if (conn->state == ConnState::CLOSED) {
+        continue;  // Closed earlier in this batch
+      }
+
+      if (events & (EPOLLERR | EPOLLHUP)) {
+        conn->state = ConnState::CLOSED;
+      } else {
+        conn->handle_events(events);
+      }
+      service_connection(conn);
+    }
+
+    /* ----------------------------
+     * Header, body, idle and write deadlines
+     * ---------------------------- */
+    close_expired_connections();
+
+    reap_cgi_without_pidfd();
+    restart_cgi_workers();
+    free_released();
+
+    // Events that became ready meanwhile waited this long
+    if (shedder.enabled()) {
+      uint64_t now_us = monotonic_us();
+      shedder.record(now_us - batch_start, now_us);
+    }
+  }
+}
+
+/*
+ * Accept pending clients until the backlog is empty or the per-wakeup
+ * cap is reached. The listening socket is level-triggered, so anything
+ * left over is picked up on the next loop iteration after the other
+ * ready connections have had their turn.
+ */
+void Reactor::accept_connections() {
+  for (int accepted = 0; accepted < ACCEPT_BATCH_LIMIT; ++accepted) {
+    // Non-blocking and close-on-exec in one call, no fcntl() per socket
+    int client_fd = accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+    if (client_fd == -1) {
+      if (errno == EINTR || errno == ECONNABORTED) {
+        continue;
+      }
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        // Typically EMFILE/ENFILE: leave the rest in the backlog for now
+        LOG_ERROR("[Error] accept4() failed (errno={})", errno);
+      }
+      return;
+    }
+
+    if (shedder.overloaded()) {
+      LOG_DEBUG("[Reactor {}] Overloaded, shedding new connection (fd={})", id, client_fd);
+      record_connection_opened();
+      shed_connection(client_fd);
+      continue;
+    }
+
+    LOG_DEBUG("[Reactor {}] Accepted new connection (fd={})", id, client_fd);
+    register_connection(client_fd);
+  }
+}
+
+/*
+ * Wrap a freshly accepted client and register it for reading
+ */
+void Reactor::register_connection(int client_fd) {
+  Connection* conn = connection_pool.create(client_fd);
+
+  struct epoll_event client_event {};
+  client_event.data.ptr = conn;
+  client_event.events = conn->wanted_events();
+
+  if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client_fd, &client_event) == -1) {
+    LOG_ERROR("[Error] epoll_ctl ADD client_fd failed");
+    connection_pool.destroy(conn);
+    return;
+  }
+  conn->registered_events = client_event.events;
+  connections.insert(conn);
+  schedule_timeout(conn);
+}
+
+/*
+ * Bring the epoll registration of a connection in line with its state.
+ * Returns false if the connection should be torn down.
+ */
+bool Reactor::update_interest(Connection* conn) {
+  uint32_t wanted = conn->wanted_events();
+  if (wanted == conn->registered_events) {
+    return true;
+  }
+
+  struct epoll_event event {};
+  event.data.ptr = conn;
+  event.events = wanted;
+
+  if (epoll_ctl(epoll_fd, EPOLL_CTL_MOD, conn->fd, &event) == -1) {
+    LOG_ERROR("[Error] epoll_ctl MOD client_fd failed");
+    return false;
+  }
+  conn->registered_events = wanted;
+  return true;
+}
+
+/*
+ * Remove a connection from epoll and release it (closes the fd)
+ */
+void Reactor::close_connection(Connection* conn) {
+  epoll_ctl(epoll_fd, EPOLL_CTL_DEL, conn->fd, nullptr);
+  timers.cancel(&conn->timer);
+  connections.erase(conn);
+
+  // A pool job still running for this client is freed when it returns
+  if (conn->job) {
+    conn->job->conn = nullptr;
+    conn->job = nullptr;
+  }
+
+  // A program still answering this client is killed and left to be
+  // reaped; a worker's request is forgotten, which may let the worker
+  // be read again
+  if (conn->cgi && conn->cgi->worker) {
+    CgiProcess* cgi = conn->cgi;
+    CgiWorker* worker = cgi->worker;
+    conn->cgi = nullptr;
+    cgi->abandon();
+    cgi_workers.cancel(cgi);
+    update_worker_interest(worker);
+  } else if (conn->cgi) {
+    adopt_cgi(conn);
+    CgiProcess* cgi = conn->cgi;
+    conn->cgi = nullptr;
+    cgi->abandon();
+    release_cgi_output(cgi);
+    retire_cgi_if_finished(cgi);
+  }
+
+  conn->state = ConnState::CLOSED;
+  closed_connections.push_back(conn);
+  LOG_DEBUG("[Reactor {}] Closed connection (fd={})", id, conn->fd);
+}
+
+/*
+ * After a connection has run: close it, or bring its epoll interest,
+ * CGI program and deadline up to date
+ */
+void Reactor::service_connection(Connection* conn) {
+  if (conn->state == ConnState::CLOSED || !update_interest(conn)) {
+    close_connection(conn);
+    return;
+  }
+  if (conn->cgi && conn->cgi->worker) {
+    update_worker_interest(conn->cgi->worker);
+  } else if (conn->cgi) {
+    adopt_cgi(conn);
+    update_cgi_interest(conn->cgi);
+  }
+  schedule_timeout(conn);
+}
+
+/*
+ * Re-arm a connection's timer for the phase it is now in
+ */
+void Reactor::schedule_timeout(Connection* conn) {
+  timers.schedule(&conn->timer, conn->deadline_ms());
+}
+
+/*
+ * Close every connection whose deadline has passed
+ */
+void Reactor::close_expired_connections() {
+  std::vector<TimerNode*> expired;
+  timers.advance(monotonic_ms(), expired);
+
+  for (TimerNode* node : expired) {
+    Connection* conn = static_cast<Connection*>(node->owner);
+    LOG_DEBUG("[Reactor {}] Timed out connection (fd={})", id, conn->fd);
+    close_connection(conn);
+  }
+}
+
+/* ----------------------------
+ * CGI programs
+ * ---------------------------- */
+
+/*
+ * Take ownership of a program the request handler just started and
+ * watch for its exit
+ */
+void Reactor::adopt_cgi(Connection* conn) {
+  CgiProcess* cgi = conn->cgi;
+  if (cgi->adopted) {
+    return;
+  }
+  cgi->adopted = true;
+  cgi->owner = conn;
+  cgi_processes.insert(cgi);
+
+  if (cgi->pidfd >= 0) {
+    struct epoll_event event {};
+    event.data.ptr = tag_pointer(cgi, TAG_CGI_EXIT);
+    event.events = EPOLLIN;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, cgi->pidfd, &event) == 0) {
+      cgi->exit_armed = true;
+      return;
+    }
+  }
+  unreaped.push_back(cgi);
+}
+
+/*
+ * Watch the output pipe only while the client can take more output.
+ * A paused pipe is removed from the set rather than left with no events:
+ * epoll reports a hang-up even then, which would spin the loop.
+ */
+void Reactor::update_cgi_interest(CgiProcess* cgi) {
+  bool wanted = cgi->wants_output();
+  if (wanted == cgi->output_armed) {
+    return;
+  }
+
+  struct epoll_event event {};
+  event.data.ptr = tag_pointer(cgi, TAG_CGI_OUTPUT);
+  event.events = EPOLLIN;
+
+  int op = wanted ? EPOLL_CTL_ADD : EPOLL_CTL_DEL;
+  if (epoll_ctl(epoll_fd, op, cgi->output_fd, &event) == -1) {
+    LOG_ERROR("[Error] epoll_ctl on CGI output failed");
+  }
+  cgi->output_armed = wanted;
+}
+
+/*
+ * Stop watching a program's output and close the pipe
+ */
+void Reactor::release_cgi_output(CgiProcess* cgi) {
+  if (cgi->output_armed) {
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, cgi->output_fd, nullptr);
+    cgi->output_armed = false;
+  }
+  cgi->close_output();
+}
+
+/*
+ * Relay what the program wrote to its client, then let the client's
+ * connection move on: flush, and once the response is complete, answer
+ * the next pipelined request
+ */
+void Reactor::handle_cgi_output(CgiProcess* cgi) {
+  Connection* conn = cgi->conn;
+  if (!conn) {
+    return;  // Abandoned earlier in this batch
+  }
+
+  if (cgi->read_output()) {
+    release_cgi_output(cgi);
+    cgi->reap();
+    retire_cgi_if_finished(cgi);
+  }
+
+  conn->handle_events(EPOLLOUT);
+  service_connection(conn);
+}
+
+void Reactor::handle_cgi_exit(CgiProcess* cgi) {
+  if (!cgi->exit_armed) {
+    return;  // Already retired earlier in this batch
+  }
+  epoll_ctl(epoll_fd, EPOLL_CTL_DEL, cgi->pidfd, nullptr);
+  cgi->exit_armed = false;
+
+  cgi->reap();
+  if (!cgi->exited) {
+    unreaped.push_back(cgi);
+  }
+  retire_cgi_if_finished(cgi);
+}
+
+void Reactor::retire_cgi_if_finished(CgiProcess* cgi) {
+  if (!cgi->finished()) {
+    return;
+  }
+  if (cgi->exit_armed) {
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, cgi->pidfd, nullptr);
+    cgi->exit_armed = false;
+  }
+  if (cgi_processes.erase(cgi) > 0) {
+    retired_cgi.push_back(cgi);
+  }
+}
+
+/*
+ * Poll the children that have no pidfd
+ */
+void Reactor::reap_cgi_without_pidfd() {
+  for (size_t i = 0; i < unreaped.size();) {
+    CgiProcess* cgi = unreaped[i];
+    cgi->reap();
+    if (cgi->exited) {
+      unreaped[i] = unreaped.back();
+      unreaped.pop_back();
+      retire_cgi_if_finished(cgi);
+    } else {
+      ++i;
+    }
+  }
+}
+
+/* ----------------------------
+ * Persistent CGI workers
+ * ---------------------------- */
+
+/*
+ * Watch a worker's socket for output while its clients can take more,
+ * and for room to write while requests are queued for it. With neither,
+ * the socket is removed from the set, as a paused CGI pipe is.
+ */
+void Reactor::update_worker_interest(CgiWorker* worker) {
+  if (!worker->process.running()) {
+    return;
+  }
+  uint32_t wanted = 0;
+  if (worker->wants_read()) {
+    wanted |= EPOLLIN;
+  }
+  if (worker->wants_write()) {
+    wanted |= EPOLLOUT;
+  }
+  if (wanted == worker->registered_events) {
+    return;
+  }
+
+  if (wanted == 0) {
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, worker->process.fd(), nullptr);
+    worker->registered_events = 0;
+    return;
+  }
+
+  struct epoll_event event {};
+  event.data.ptr = tag_pointer(worker, TAG_CGI_WORKER);
+  event.events = wanted;
+
+  int op = worker->registered_events == 0 ? EPOLL_CTL_ADD : EPOLL_CTL_MOD;
+  if (epoll_ctl(epoll_fd, op, worker->process.fd(), &event) == -1) {
+    LOG_ERROR("[Error] epoll_ctl on CGI worker failed");
+    return;
+  }
+  worker->registered_events = wanted;
+}
+
+/*
+ * Move frames in both directions, then let every client that got
+ * output move on. A worker that hung up is failed and restarted later.
+ */
+void Reactor::handle_cgi_worker(CgiWorker* worker, uint32_t events) {
+  if (!worker->process.running()) {
+    return;  // Failed earlier in this batch
+  }
+
+  std::vector<Connection*> touched;
+  bool alive = !(events & EPOLLERR);
+  if (alive && (events & (EPOLLIN | EPOLLHUP))) {
+    alive = cgi_workers.read(worker, touched);
+  }
+  if (alive && (events & EPOLLOUT)) {
+    alive = cgi_workers.flush(worker);
+  }
+
+  if (alive) {
+    update_worker_interest(worker);
+  } else {
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, worker->process.fd(), nullptr);
+    worker->registered_events = 0;
+    cgi_workers.fail(worker, touched);
+  }
+
+  for (Connection* conn : touched) {
+    if (conn->state == ConnState::CLOSED) {
+      continue;  // Its request ended with a send failure
+    }
+    conn->handle_events(EPOLLOUT);
+    service_connection(conn);
+  }
+}
+
+void Reactor::restart_cgi_workers() {
+  std::vector<CgiWorker*> restarted;
+  cgi_workers.restart_due(monotonic_ms(), restarted);
+  for (CgiWorker* worker : restarted) {
+    update_worker_interest(worker);
+  }
+}
+
+/* ----------------------------
+ * Thread pool (hybrid engine)
+ * ---------------------------- */
+
+/*
+ * Answer the requests whose blocking work is done, then let each
+ * connection move on to its next pipelined request. A connection whose
+ * read_buffer filled up while its job ran stopped asking for EPOLLIN;
+ * service_connection() asks again once those requests are consumed.
+ */
+void Reactor::finish_offloaded_jobs() {
+  std::vector<PoolJob*> finished;
+  offload->drain(finished);
+
+  for (PoolJob* job : finished) {
+    Connection* conn = job->conn;
+    if (conn) {
+      conn->job = nullptr;
+      job->finish(*conn);
+      conn->handle_events(EPOLLOUT);
+      service_connection(conn);
+    }
+    delete job;
+  }
+}
+
+void Reactor::free_released() {
+  for (Connection* conn : closed_connections) {
+    connection_pool.destroy(conn);
+  }
+  closed_connections.clear();
+
+  for (CgiProcess* cgi : retired_cgi) {
+    delete cgi;
+  }
+  retired_cgi.clear();
+}
@@ -1,178 +1,384 @@
-#include <sstream>
-#include <iostream>
+#include <memory>
 #include <fcntl.h>
 #include <cstring>
+#include <strings.h>
+#include <cerrno>
 #include <sys/stat.h>
 
 #include "include/request.h"
+#include "include/connection.h"
+#include "include/cgi_process.h"
+#include "include/cgi_worker_pool.h"
+#include "include/thread_pool.h"
+#include "file_cache.h"
+#include "response_cache.h"
+#include "http_header.h"
+#include "http_parser.h"
+#include "routes.h"
+#include "load_shedder.h"
+#include "request_metrics.h"
+#include "logger.h"
+
+static const char* connection_header(bool keep_alive) {
+  return keep_alive ? "Connection: keep-alive\r\n" : "Connection: close\r\n";
+}
+
+const char* connection_header(const Connection& conn) {
+  return connection_header(conn.keep_alive);
+}
+
+/*
+ * What the handler needs to answer a request once its file is known.
+ * The views point into read_buffer, or into a pool job's own copies
+ * when the file was looked up on the thread pool.
+ */
+struct ResolvedRequest {
+  RouteKind kind;
+  std::string_view path;   // URL path
+  std::string_view query;
+  std::string filepath;    // File under the document root
+  bool allow_chunked;      // HTTP/1.1 client
+};
 
 /*
- * Determine MIME type based on file extension
+ * Decide whether the connection stays open after this request.
+ * HTTP/1.1 defaults to persistent connections, HTTP/1.0 only on request,
+ * and no connection outlives the configured request limit.
  */
-static std::string get_mime_type(const std::string& filename) {
-  if (filename.find(".html") != std::string::npos) return "text/html";
-  if (filename.find(".gif")  != std::string::npos) return "image/gif";
-  if (filename.find(".jpg")  != std::string::npos) return "image/jpeg";
-  return "text/plain";
+static bool wants_keep_alive(const HttpRequest& request) {
+  if (request.connection_close) {
+    return false;
+  }
+  return request.minor_version >= 1 || request.connection_keep_alive;
+}
+
+static bool is_servable_file(const CachedFile& file) {
+  return S_ISREG(file.mode) && (S_IRUSR & file.mode) && file.fd >= 0;
 }
 
 /*
- * Serve a static file to the client
+ * Header block of a 200 response for a static file
  */
-static void serve_static_file(int client_fd,
-                              const std::string& filepath,
-                              size_t file_size) {
-  std::string mime_type = get_mime_type(filepath);
+static void build_static_file_header(HeaderBuilder& header, const CachedFile& file,
+                                     bool keep_alive) {
+  header.add("Server", "WebServer")
+        .add_date()
+        .add_raw(connection_header(keep_alive))
+        .add("Content-Length", static_cast<size_t>(file.size))
+        .add("Content-Type", file.mime_type)
+        .finish();
+}
 
-  int file_fd = OPEN_OR_DIE(filepath.c_str(), O_RDONLY, 0);
-  void* file_data = MMAP_OR_DIE(nullptr, file_size, PROT_READ, MAP_PRIVATE, file_fd, 0);
-  CLOSE_OR_DIE(file_fd);
+/*
+ * Render a small file into the response cache; this reads the whole
+ * file. nullptr if it is too large or cannot be read.
+ */
+static std::shared_ptr<const std::string> render_static_file(const CachedFile& file,
+                                                             bool keep_alive) {
+  if (!g_response_cache.cacheable(file)) {
+    return nullptr;
+  }
+  // The rendering depends on the Connection header
+  HeaderBuilder header("HTTP/1.1", 200);
+  build_static_file_header(header, file, keep_alive);
+  return g_response_cache.store(file, keep_alive ? 1 : 0,
+                                std::string_view(header.data(), header.size()));
+}
 
-  std::ostringstream header;
-  header << "HTTP/1.0 200 OK\r\n"
-         << "Server: WebServer\r\n"
-         << "Content-Length: " << file_size << "\r\n"
-         << "Content-Type: " << mime_type << "\r\n\r\n";
+static std::shared_ptr<const std::string> cached_or_rendered(const CachedFile& file,
+                                                             bool keep_alive) {
+  std::shared_ptr<const std::string> response = g_response_cache.find(file, keep_alive ? 1 : 0);
+  return response ? response : render_static_file(file, keep_alive);
+}
 
-  std::string header_str = header.str();
-  SEND_OR_DIE(client_fd, header_str.c_str(), header_str.size(), 0);
-  SEND_OR_DIE(client_fd, file_data, file_size, 0);
+/*
+ * Serve a static file to the client.
+ * Small files arrive already rendered from the response cache and go
+ * out as one buffer. Otherwise the body is queued as a range of the
+ * cached descriptor and sent with sendfile(), so it never passes
+ * through user space.
+ */
+static void serve_static_file(Connection& conn,
+                              const std::shared_ptr<const CachedFile>& file,
+                              std::shared_ptr<const std::string> rendered) {
+  conn.response_status = 200;
+  if (rendered) {
+    conn.queue_write(std::move(rendered));
+    return;
+  }
 
-  MUNMAP_OR_DIE(file_data, file_size);
+  HeaderBuilder header("HTTP/1.1", 200);
+  build_static_file_header(header, *file, conn.keep_alive);
+  conn.queue_copy(header.data(), header.size());
+  conn.queue_file(file, 0, static_cast<size_t>(file->size));
 }
 
 /*
- * Serve a CGI (dynamic) request
+ * Share of cache lookups that hit
  */
-static void serve_dynamic_content(int client_fd,
-                                  const std::string& executable,
-                                  const std::string& cgi_args) {
-  const char response[] = "HTTP/1.0 200 OK\r\nServer: WebServer\r\n";
-  SEND_OR_DIE(client_fd, response, strlen(response), 0);
+static double hit_ratio(uint64_t hits, uint64_t misses) {
+  return hits + misses > 0 ? static_cast<double>(hits) / static_cast<double>(hits + misses) : 0.0;
+}
 
-  char* argv[] = { nullptr };
+/*
+ * Serve the built-in /metrics page, in Prometheus text format
+ */
+static void serve_metrics(Connection& conn) {
+  PoolTotals connection_pools = pool_totals(PoolKind::CONNECTIONS);
+  PoolTotals buffer_pools = pool_totals(PoolKind::BUFFERS);
 
-  if (FORK_OR_DIE() == 0) {
-    SETENV_OR_DIE("QUERY_STRING", cgi_args.c_str(), 1);
-    DUP2_OR_DIE(client_fd, STDOUT_FILENO);
+  const struct {
+    const char* name;
+    const char* type;
+    uint64_t value;
+  } metrics[] = {
+    { "file_cache_entries",       "gauge",   g_file_cache.size() },
+    { "file_cache_hits",          "counter", g_file_cache.hits() },
+    { "file_cache_misses",        "counter", g_file_cache.misses() },
+    { "file_cache_invalidations", "counter", g_file_cache.invalidations() },
+    { "file_cache_evictions",     "counter", g_file_cache.evictions() },
+    { "response_cache_bytes",     "gauge",   g_response_cache.bytes_used() },
+    { "response_cache_hits",      "counter", g_response_cache.hits() },
+    { "response_cache_misses",    "counter", g_response_cache.misses() },
+    { "response_cache_evictions", "counter", g_response_cache.evictions() },
+    { "connection_pool_in_use",           "gauge",   connection_pools.in_use },
+    { "connection_pool_bytes",            "gauge",   connection_pools.in_use_bytes },
+    { "connection_pool_high_water_bytes", "gauge",   connection_pools.high_water_bytes },
+    { "connection_pool_reserved_bytes",   "gauge",   connection_pools.reserved_bytes },
+    { "buffer_pool_lent",                 "gauge",   buffer_pools.in_use },
+    { "buffer_pool_lent_bytes",           "gauge",   buffer_pools.in_use_bytes },
+    { "buffer_pool_high_water_bytes",     "gauge",   buffer_pools.high_water_bytes },
+    { "buffer_pool_reserved_bytes",       "gauge",   buffer_pools.reserved_bytes },
+    { "log_records_dropped",              "counter", Logger::dropped() },
+    { "connections_shed_total",           "counter", connections_shed() },
+  };
 
-    extern char** environ;
-    EXECVE_OR_DIE(executable.c_str(), argv, environ);
-  } else {
-    WAIT_OR_DIE(nullptr);
+  std::string body;
+  for (const auto& metric : metrics) {
+    append_metric(body, metric.name, metric.type, metric.value);
   }
+  append_metric(body, "file_cache_hit_ratio", "gauge",
+                hit_ratio(g_file_cache.hits(), g_file_cache.misses()));
+  append_metric(body, "response_cache_hit_ratio", "gauge",
+                hit_ratio(g_response_cache.hits(), g_response_cache.misses()));
+  append_request_metrics(body);
+
+  conn.response_status = 200;
+  HeaderBuilder header("HTTP/1.1", 200);
+  header.add_date()
+        .add_raw(connection_header(conn))
+        .add("Content-Type", "text/plain; version=0.0.4")
+        .add("Content-Length", body.size())
+        .finish();
+
+  // Copied into one pooled buffer, so header and body leave in the same write
+  conn.queue_copy(header.data(), header.size());
+  conn.queue_copy(body);
 }
 
 /*
- * Send an HTTP error response
+ * Serve a CGI (dynamic) request.
+ * The program is only started here, or the request handed to one of
+ * its persistent workers; the event loop relays the output as it
+ * arrives, so the loop never waits for it.
  */
-static void send_error_response(int client_fd,
-                                const std::string& status_code,
-                                const std::string& short_msg,
-                                const std::string& long_msg,
-                                const std::string& cause) {
-  std::ostringstream body;
-  body << "<!doctype html>\r\n"
-       << "<head><title>WebServer Error</title></head>\r\n"
-       << "<body>\r\n"
-       << "<h2>" << status_code << ": " << short_msg << "</h2>\r\n"
-       << "<p>" << long_msg << ": " << cause << "</p>\r\n"
-       << "</body>\r\n</html>\r\n";
-
-  std::string body_str = body.str();
-
-  std::ostringstream header;
-  header << "HTTP/1.0 " << status_code << " " << short_msg << "\r\n"
-         << "Content-Type: text/html\r\n"
-         << "Content-Length: " << body_str.size() << "\r\n\r\n";
-
-  std::string header_str = header.str();
-  SEND_OR_DIE(client_fd, header_str.c_str(), header_str.size(), 0);
-  SEND_OR_DIE(client_fd, body_str.c_str(), body_str.size(), 0);
+static void serve_dynamic_content(Connection& conn, const ResolvedRequest& target) {
+  std::string cgi_args(target.query);
+
+  CgiProcess* cgi = nullptr;
+  CgiWorkerPool* workers = CgiWorkerPool::for_this_thread();
+  if (workers && g_cgi_workers.serves(target.path)) {
+    cgi = workers->submit(conn, target.path, cgi_args, target.allow_chunked);
+  }
+  if (!cgi) {
+    cgi = CgiProcess::spawn(conn, target.filepath, cgi_args, target.allow_chunked);
+  }
+  if (!cgi) {
+    send_error_response(conn,
+                        500,
+                        "Could not start CGI program",
+                        target.filepath);
+    return;
+  }
+  conn.cgi = cgi;
 }
 
 /*
- * Parse URI and determine whether request is static or dynamic
+ * Send an HTTP error response
  */
-static bool parse_request_uri(const std::string& uri,
-                              std::string& resolved_path,
-                              std::string& cgi_args) {
-  if (uri.find("cgi") == std::string::npos) {
-    cgi_args.clear();
-    resolved_path = "." + uri;
-    if (uri.back() == '/') {
-      resolved_path += "index.html";
-    }
-    return true;
-  }
+void send_error_response(Connection& conn,
+                         int status_code,
+                         const std::string& long_msg,
+                         const std::string& cause) {
+  const char* short_msg = status_reason(status_code);
+
+  std::string body;
+  body.reserve(256 + long_msg.size() + cause.size());
+  body += "<!doctype html>\r\n"
+          "<head><title>WebServer Error</title></head>\r\n"
+          "<body>\r\n"
+          "<h2>";
+  append_number(body, static_cast<uint64_t>(status_code));
+  body.append(": ").append(short_msg).append("</h2>\r\n");
+  body.append("<p>").append(long_msg).append(": ").append(cause).append("</p>\r\n");
+  body += "</body>\r\n</html>\r\n";
+
+  conn.response_status = status_code;
+  HeaderBuilder header("HTTP/1.1", status_code);
+  header.add_date()
+        .add_raw(connection_header(conn))
+        .add("Content-Type", "text/html")
+        .add("Content-Length", body.size())
+        .finish();
 
-  size_t query_pos = uri.find('?');
-  cgi_args = (query_pos == std::string::npos) ? "" : uri.substr(query_pos + 1);
-  resolved_path = "." + uri;
-  return false;
+  conn.queue_copy(header.data(), header.size());
+  conn.queue_copy(body);
 }
 
 /*
- * Main request handler
+ * File a request path maps to under the document root
  */
-void handle_http_request(int client_fd) {
-  char buffer[REQUEST_BUFFER_SIZE];
-  ssize_t bytes_read = recv(client_fd, buffer, REQUEST_BUFFER_SIZE - 1, 0);
+static std::string resolve_path(std::string_view path) {
+  std::string resolved = ".";
+  resolved.append(path.data(), path.size());
+  if (path.empty() || path.back() == '/') {
+    resolved += "index.html";
+  }
+  return resolved;
+}
 
-  if (bytes_read <= 0) {
-    std::cerr << "[Error] recv() failed\n";
+/*
+ * Answer a request once its file is known: refuse it, serve the static
+ * file (`rendered` holds the whole response if it was cached) or start
+ * the CGI program
+ */
+static void serve_resolved(Connection& conn,
+                           const ResolvedRequest& target,
+                           const std::shared_ptr<const CachedFile>& file,
+                           std::shared_ptr<const std::string> rendered) {
+  if (!file) {
+    send_error_response(conn,
+                        404,
+                        "File not found",
+                        target.filepath);
     return;
   }
 
-  buffer[bytes_read] = '\0';
-  std::istringstream request_stream(buffer);
+  if (target.kind == RouteKind::STATIC) {
+    if (!is_servable_file(*file)) {
+      send_error_response(conn,
+                          403,
+                          "Access denied",
+                          target.filepath);
+      return;
+    }
+    serve_static_file(conn, file, std::move(rendered));
+  } else {
+    if (!S_ISREG(file->mode) || !(S_IXUSR & file->mode)) {
+      send_error_response(conn,
+                          403,
+                          "CGI execution denied",
+                          target.filepath);
+      return;
+    }
+    serve_dynamic_content(conn, target);
+  }
+}
+
+/*
+ * Look up (and for a small static file, render) the file on the thread
+ * pool, then answer the request back on the event loop. `file` is set
+ * if the lookup already hit and only the rendering is missing.
+ */
+static void offload_request(OffloadQueue& offload,
+                            Connection& conn,
+                            const ResolvedRequest& target,
+                            std::shared_ptr<const CachedFile> file) {
+  struct Loaded {
+    std::shared_ptr<const CachedFile> file;
+    std::shared_ptr<const std::string> rendered;
+  };
+  std::shared_ptr<Loaded> loaded = std::make_shared<Loaded>();
+  loaded->file = std::move(file);
+
+  RouteKind kind = target.kind;
+  bool keep_alive = conn.keep_alive;
+  std::string filepath = target.filepath;
+  auto work = [loaded, kind, keep_alive, filepath]() {
+    if (loaded->file) {
+      loaded->rendered = render_static_file(*loaded->file, keep_alive);
+      return;
+    }
+    loaded->file = g_file_cache.lookup(filepath);
+    if (loaded->file && kind == RouteKind::STATIC && is_servable_file(*loaded->file)) {
+      loaded->rendered = cached_or_rendered(*loaded->file, keep_alive);
+    }
+  };
+
+  // The request's views into read_buffer do not outlive this call
+  std::string path(target.path), query(target.query);
+  bool allow_chunked = target.allow_chunked;
+  auto finish = [loaded, kind, filepath, path, query, allow_chunked](Connection& client) {
+    ResolvedRequest resolved{ kind, path, query, filepath, allow_chunked };
+    serve_resolved(client, resolved, loaded->file, std::move(loaded->rendered));
+  };
 
-  std::string method, uri, version;
-  request_stream >> method >> uri >> version;
+  offload.submit(conn, std::move(work), std::move(finish));
+}
+
+/*
+ * Main request handler
+ */
+void handle_http_request(Connection& conn, const HttpRequest& request) {
+  LOG_DEBUG("[Request] {} {} {}", request.method, request.target, request.version);
 
-  std::cout << "[Request] " << method << " " << uri << " " << version << std::endl;
+  conn.requests_served++;
+  conn.keep_alive = wants_keep_alive(request) &&
+                    conn.requests_served < g_keepalive_max_requests;
 
-  if (method != "GET") {
-    send_error_response(client_fd,
-                        "501",
-                        "Not Implemented",
+  if (request.method != "GET") {
+    send_error_response(conn,
+                        501,
                         "Only GET method is supported",
-                        method);
+                        std::string(request.method));
     return;
   }
 
-  std::string filepath, cgi_args;
-  bool is_static = parse_request_uri(uri, filepath, cgi_args);
+  Route route = route_request(request.target);
+  conn.response_class = request_class(route.kind);
+  if (route.kind == RouteKind::METRICS) {
+    serve_metrics(conn);
+    return;
+  }
 
-  struct stat file_stat;
-  if (stat(filepath.c_str(), &file_stat) < 0) {
-    send_error_response(client_fd,
-                        "404",
-                        "Not Found",
-                        "File not found",
-                        filepath);
+  ResolvedRequest target{ route.kind, route.path, route.query, resolve_path(route.path),
+                          request.minor_version >= 1 };
+
+  OffloadQueue* offload = OffloadQueue::for_this_thread();
+  if (!offload) {
+    std::shared_ptr<const CachedFile> file = g_file_cache.lookup(target.filepath);
+    std::shared_ptr<const std::string> rendered;
+    if (file && target.kind == RouteKind::STATIC && is_servable_file(*file)) {
+      rendered = cached_or_rendered(*file, conn.keep_alive);
+    }
+    serve_resolved(conn, target, file, std::move(rendered));
     return;
   }
 
-  if (is_static) {
-    if (!S_ISREG(file_stat.st_mode) || !(S_IRUSR & file_stat.st_mode)) {
-      send_error_response(client_fd,
-                          "403",
-                          "Forbidden",
-                          "Access denied",
-                          filepath);
+  // Hybrid engine: answer on the loop when every byte is already in
+  // memory, otherwise open, stat and read the file on the thread pool
+  std::shared_ptr<const CachedFile> file = g_file_cache.find(target.filepath);
+  if (file) {
+    if (target.kind != RouteKind::STATIC || !is_servable_file(*file) ||
+        !g_response_cache.cacheable(*file)) {
+      serve_resolved(conn, target, file, nullptr);
       return;
     }
-    serve_static_file(client_fd, filepath, file_stat.st_size);
-  } else {
-    if (!S_ISREG(file_stat.st_mode) || !(S_IXUSR & file_stat.st_mode)) {
-      send_error_response(client_fd,
-                          "403",
-                          "Forbidden",
-                          "CGI execution denied",
-                          filepath);
+    std::shared_ptr<const std::string> rendered = g_response_cache.find(*file, conn.keep_alive ? 1 : 0);
+    if (rendered) {
+      serve_resolved(conn, target, file, std::move(rendered));
       return;
     }
-    serve_dynamic_content(client_fd, filepath, cgi_args);
   }
+  offload_request(*offload, conn, target, std::move(file));
 }
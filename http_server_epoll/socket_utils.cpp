@@ -1,16 +1,18 @@
 #include <sys/socket.h>
 #include <arpa/inet.h>
-#include <iostream>
 #include <strings.h>
 #include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include "include/socket_utils.h"
+#include "logger.h"
 
 // Set up a socket to listen for incoming connections
 int open_listen_fd(int port){
 
   int sockfd;
   if ((sockfd = socket(AF_INET, SOCK_STREAM, 0)) < 0){
-    std::cerr << "socket fail" << std::endl;
+    LOG_ERROR("socket fail");
     return -1;
   }
 
@@ -24,7 +26,7 @@ int open_listen_fd(int port){
   // Eliminates "Address already in use" error from bind
   int optval = 1;
   if (setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, (const void *) &optval, sizeof(int)) < 0) {
-    std::cerr << "setsockopt fail" << std::endl;
+    LOG_ERROR("setsockopt fail");
     return -1;
   }
 
@@ -37,15 +39,93 @@ int open_listen_fd(int port){
   // server_addr is loaded up with IP address and port to bind to
 
   if (bind(sockfd, (sockaddr_t *) &server_addr, sizeof(server_addr)) < 0){
-    std::cerr << "bind failed" << std::endl;
+    LOG_ERROR("bind failed");
     return -1;
   }
 
   // Listen for incoming connections
   if (listen(sockfd, QUEUE_SIZE) < 0) {
-    std::cerr << "listen failed" << std::endl;
+    LOG_ERROR("listen failed");
     return -1;
   }
 
   return sockfd;
-}
\ No newline at end of file
+}
+
+/*
+ * Create, bind, and listen on a TCP socket.
+ * With reuse_port set, several sockets can bind the same port and the
+ * kernel load-balances new connections between them.
+ * Returns the listening socket file descriptor.
+ */
+int create_listening_socket(int port, bool reuse_port) {
+  // Close-on-exec, so CGI children never inherit the listening socket
+  int listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (listen_fd < 0) {
+    LOG_ERROR("[Error] Failed to create socket");
+    return -1;
+  }
+
+  // Allow immediate reuse of the address after server restart
+  int reuse_addr = 1;
+  if (setsockopt(
+        listen_fd,
+        SOL_SOCKET,
+        SO_REUSEADDR,
+        &reuse_addr,
+        sizeof(reuse_addr)) < 0) {
+    LOG_ERROR("[Error] setsockopt(SO_REUSEADDR) failed");
+    close(listen_fd);
+    return -1;
+  }
+
+  if (reuse_port &&
+      setsockopt(
+        listen_fd,
+        SOL_SOCKET,
+        SO_REUSEPORT,
+        &reuse_addr,
+        sizeof(reuse_addr)) < 0) {
+    LOG_ERROR("[Error] setsockopt(SO_REUSEPORT) failed");
+    close(listen_fd);
+    return -1;
+  }
+
+  // Initialize server address structure
+  sockaddr_in_t server_addr;
+  bzero(&server_addr, sizeof(server_addr));
+
+  server_addr.sin_family      = AF_INET;
+  server_addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  server_addr.sin_port        = htons(static_cast<unsigned short>(port));
+
+  // Bind socket to address and port
+  if (bind(
+        listen_fd,
+        reinterpret_cast<sockaddr_t*>(&server_addr),
+        sizeof(server_addr)) < 0) {
+    LOG_ERROR("[Error] bind() failed");
+    close(listen_fd);
+    return -1;
+  }
+
+  // Start listening for incoming connections
+  if (listen(listen_fd, LISTEN_BACKLOG) < 0) {
+    LOG_ERROR("[Error] listen() failed");
+    close(listen_fd);
+    return -1;
+  }
+
+  return listen_fd;
+}
+
+/*
+ * Put a file descriptor into non-blocking mode
+ */
+int set_nonblocking(int fd) {
+  int flags = fcntl(fd, F_GETFL, 0);
+  if (flags == -1) {
+    return -1;
+  }
+  return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
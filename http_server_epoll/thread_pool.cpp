@@ -0,0 +1,111 @@
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include "include/thread_pool.h"
+#include "include/connection.h"
+#include "logger.h"
+
+static thread_local OffloadQueue* t_queue = nullptr;
+
+ThreadPool::ThreadPool(size_t num_threads) : stopping(false) {
+  for (size_t i = 0; i < num_threads; ++i) {
+    threads.emplace_back(&ThreadPool::run, this);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  job_ready.notify_all();
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+}
+
+void ThreadPool::submit(PoolJob* job) {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    jobs.push_back(job);
+  }
+  job_ready.notify_one();
+}
+
+void ThreadPool::run() {
+  while (true) {
+    PoolJob* job;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      job_ready.wait(lock, [this] { return stopping || !jobs.empty(); });
+      if (jobs.empty()) {
+        return;
+      }
+      job = jobs.front();
+      jobs.pop_front();
+    }
+
+    job->work();
+    job->origin->complete(job);
+  }
+}
+
+OffloadQueue::OffloadQueue(ThreadPool& thread_pool) : pool(thread_pool) {
+  event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (event_fd == -1) {
+    LOG_ERROR("[Error] eventfd failed");
+    std::exit(1);
+  }
+}
+
+OffloadQueue::~OffloadQueue() {
+  for (PoolJob* job : done) {
+    delete job;
+  }
+  if (t_queue == this) {
+    t_queue = nullptr;
+  }
+  close(event_fd);
+}
+
+OffloadQueue* OffloadQueue::for_this_thread() {
+  return t_queue;
+}
+
+void OffloadQueue::bind_to_this_thread() {
+  t_queue = this;
+}
+
+void OffloadQueue::submit(Connection& conn, std::function<void()> work,
+                          std::function<void(Connection&)> finish) {
+  PoolJob* job = new PoolJob{ &conn, this, std::move(work), std::move(finish) };
+  conn.job = job;
+  pool.submit(job);
+}
+
+void OffloadQueue::complete(PoolJob* job) {
+  bool wake;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    wake = done.empty();  // Otherwise the loop has a wakeup coming already
+    done.push_back(job);
+  }
+  if (wake) {
+    uint64_t one = 1;
+    while (write(event_fd, &one, sizeof(one)) < 0 && errno == EINTR) {
+    }
+  }
+}
+
+void OffloadQueue::drain(std::vector<PoolJob*>& finished) {
+  // Clear the counter first: a job completed after this wakes the loop again
+  uint64_t count;
+  while (read(event_fd, &count, sizeof(count)) < 0 && errno == EINTR) {
+  }
+
+  std::lock_guard<std::mutex> lock(mutex);
+  finished.swap(done);
+}
@@ -0,0 +1,788 @@
+#include <memory>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "include/uring_reactor.h"
+#include "include/connection.h"
+#include "include/cgi_process.h"
+#include "include/cgi_worker_pool.h"
+#include "include/socket_utils.h"
+#include "logger.h"
+
+/*
+ * Operation tags packed into the low bits of sqe->user_data.
+ * Connection-less operations use the bare tag.
+ */
+enum UringOp : uint64_t {
+  OP_ACCEPT       = 0,
+  OP_TIMEOUT      = 1,
+  OP_RECV         = 2,
+  OP_SEND         = 3,
+  OP_SHUTDOWN     = 4,
+  OP_READ         = 5,
+  OP_CGI_OUTPUT   = 6,  // These two carry a CgiProcess, not a connection
+  OP_CGI_EXIT     = 7,
+  OP_WORKER_READ  = 8,  // These two carry a CgiWorker
+  OP_WORKER_WRITE = 9,
+};
+constexpr uint64_t OP_MASK = 0xf;
+
+// Every tagged object comes from operator new or a SlabPool, which
+// aligns its slots at least as strictly
+static_assert(__STDCPP_DEFAULT_NEW_ALIGNMENT__ > OP_MASK, "operation tags need aligned pointers");
+static_assert(alignof(std::max_align_t) > OP_MASK, "operation tags need aligned pointers");
+
+/*
+ * Connection plus the io_uring bookkeeping that must stay alive
+ * while its operations are in flight
+ */
+struct UringReactor::UringConnection {
+  Connection conn;
+
+  struct msghdr msg;
+  struct iovec iov[URING_MAX_SEND_IOVECS];
+  char* file_buffer;                    // Staging for file bodies, lent while a chain is in flight
+  size_t file_buffer_capacity;
+  size_t file_read_length;              // Bytes the in-flight file read asked for
+
+  int inflight;           // Submitted operations not yet completed
+  int send_ops;           // Operations of the current send chain still in flight
+  bool recv_armed;
+  bool recv_starved;      // Waiting in the starved list for a buffer
+  bool shutdown_pending;  // Linked shutdown submitted behind the last send
+  bool shutdown_done;
+  bool closing;
+
+  explicit UringConnection(int fd)
+    : conn(fd), file_buffer(nullptr), file_buffer_capacity(0), file_read_length(0),
+      inflight(0), send_ops(0), recv_armed(false), recv_starved(false),
+      shutdown_pending(false), shutdown_done(false), closing(false) {
+    memset(&msg, 0, sizeof(msg));
+    conn.timer.owner = this;  // Expired timers hand back the UringConnection
+  }
+
+  ~UringConnection() {
+    release_file_buffer();
+  }
+
+  void release_file_buffer() {
+    if (file_buffer) {
+      BufferPool::for_this_thread().give_back(file_buffer, file_buffer_capacity);
+      file_buffer = nullptr;
+    }
+  }
+};
+
+static inline uint64_t pack(void* ptr, UringOp op) {
+  return reinterpret_cast<uint64_t>(ptr) | op;
+}
+
+UringReactor::UringReactor(int reactor_id, int port, bool reuse_port)
+  : id(reactor_id), connection_pool(new SlabPool<UringConnection>()) {
+  shedder.configure(g_shed_target_ms);
+
+  listen_fd = create_listening_socket(port, reuse_port);
+  if (listen_fd == -1) {
+    LOG_ERROR("[Error] Reactor {} could not listen on port {}", id, port);
+    std::exit(1);
+  }
+
+  tick.tv_sec  = 1;
+  tick.tv_nsec = 0;
+}
+
+UringReactor::~UringReactor() {
+  for (UringConnection* uc : connections) {
+    connection_pool->destroy(uc);
+  }
+  for (CgiProcess* cgi : cgi_processes) {
+    delete cgi;
+  }
+  close(listen_fd);
+}
+
+int UringReactor::init() {
+  int rc = ring.init(URING_QUEUE_DEPTH);
+  if (rc < 0) {
+    return rc;
+  }
+  return ring.setup_buffer_ring(URING_BUFFER_GROUP, URING_BUFFER_COUNT, READ_CHUNK_SIZE);
+}
+
+void UringReactor::run() {
+  LOG_INFO("[Reactor {}] Entering io_uring event loop", id);
+
+  // Workers are started from the reactor's own thread, which their
+  // requests come from
+  cgi_workers.bind_to_this_thread();
+  cgi_workers.start();
+  for (std::unique_ptr<CgiWorker>& worker : cgi_workers.workers) {
+    arm_worker(worker.get());
+  }
+
+  arm_accept();
+  arm_timeout();
+
+  while (true) {
+    int rc = ring.submit_and_wait(1);
+    if (rc < 0 && rc != -EBUSY) {
+      LOG_ERROR("[Error] io_uring_enter failed (errno={})", -rc);
+      std::exit(1);
+    }
+
+    uint64_t batch_start = shedder.enabled() ? monotonic_us() : 0;
+
+    struct io_uring_cqe* cqe;
+    while ((cqe = ring.peek_cqe()) != nullptr) {
+      uint64_t user_data = cqe->user_data;
+      int32_t res = cqe->res;
+      uint32_t flags = cqe->flags;
+      ring.cqe_advance();
+
+      handle_completion(user_data, res, flags);
+    }
+
+    retry_starved_recvs();
+
+    if (shedder.enabled()) {
+      uint64_t now_us = monotonic_us();
+      shedder.record(now_us - batch_start, now_us);
+    }
+  }
+}
+
+/* ----------------------------
+ * Submissions
+ * ---------------------------- */
+
+/*
+ * One multishot accept keeps producing a completion per new client
+ */
+void UringReactor::arm_accept() {
+  struct io_uring_sqe* sqe = ring.get_sqe();
+  sqe->opcode       = IORING_OP_ACCEPT;
+  sqe->fd           = listen_fd;
+  sqe->ioprio       = IORING_ACCEPT_MULTISHOT;
+  sqe->accept_flags = SOCK_CLOEXEC;
+  sqe->user_data    = OP_ACCEPT;
+}
+
+/*
+ * Wake up for the earliest connection deadline, or after
+ * URING_MAX_TICK_MS if that comes first. The kernel copies the
+ * timespec when the operation is submitted.
+ */
+void UringReactor::arm_timeout() {
+  int wait_ms = timers.next_timeout_ms(monotonic_ms());
+  int longest = unreaped.empty() ? URING_MAX_TICK_MS : CGI_REAP_INTERVAL_MS;
+  if (wait_ms < 0 || wait_ms > longest) {
+    wait_ms = longest;
+  }
+  int restart_ms = cgi_workers.next_restart_ms(monotonic_ms());
+  if (restart_ms >= 0 && wait_ms > restart_ms) {
+    wait_ms = restart_ms;
+  }
+  if (wait_ms < static_cast<int>(TIMER_TICK_MS)) {
+    wait_ms = static_cast<int>(TIMER_TICK_MS);
+  }
+  tick.tv_sec  = wait_ms / 1000;
+  tick.tv_nsec = static_cast<long long>(wait_ms % 1000) * 1000000;
+
+  struct io_uring_sqe* sqe = ring.get_sqe();
+  sqe->opcode    = IORING_OP_TIMEOUT;
+  sqe->fd        = -1;
+  sqe->addr      = reinterpret_cast<uint64_t>(&tick);
+  sqe->len       = 1;
+  sqe->user_data = OP_TIMEOUT;
+}
+
+/*
+ * Receive into whichever provided buffer the kernel picks
+ */
+void UringReactor::arm_recv(UringConnection* uc) {
+  struct io_uring_sqe* sqe = ring.get_sqe();
+  sqe->opcode    = IORING_OP_RECV;
+  sqe->fd        = uc->conn.fd;
+  sqe->len       = READ_CHUNK_SIZE;
+  sqe->flags     = IOSQE_BUFFER_SELECT;
+  sqe->buf_group = URING_BUFFER_GROUP;
+  sqe->user_data = pack(uc, OP_RECV);
+
+  uc->recv_armed = true;
+  uc->inflight++;
+}
+
+/*
+ * Send what is queued on the connection as one linked chain:
+ *   - the in-memory chunks at the front of the queue in one sendmsg,
+ *   - then, if a file range follows, a read of up to
+ *     URING_FILE_CHUNK_SIZE bytes into the staging buffer and a send
+ *     of that buffer,
+ *   - then, if this is the final response, a shutdown.
+ * MSG_WAITALL makes a short send break the link instead of letting the
+ * next operation run early; the rest is resent once the chain is done.
+ */
+void UringReactor::arm_send(UringConnection* uc) {
+  Connection& conn = uc->conn;
+
+  int iov_count = conn.fill_write_iovecs(uc->iov, URING_MAX_SEND_IOVECS);
+  size_t covered = static_cast<size_t>(iov_count);
+
+  const WriteChunk* file_chunk = nullptr;
+  off_t file_offset = 0;
+  size_t file_length = 0;
+  if (covered < conn.write_queue.size() && conn.write_queue[covered].is_file()) {
+    file_chunk = &conn.write_queue[covered];
+    size_t already_sent = (covered == 0) ? conn.write_offset : 0;
+    file_offset = file_chunk->file_offset + static_cast<off_t>(already_sent);
+    file_length = file_chunk->file_length - already_sent;
+    if (file_length > URING_FILE_CHUNK_SIZE) {
+      file_length = URING_FILE_CHUNK_SIZE;
+    } else {
+      covered++;
+    }
+  }
+
+  bool last_send = conn.close_after_write && covered == conn.write_queue.size();
+
+  ring.reserve((iov_count > 0 ? 1 : 0) + (file_chunk ? 2 : 0) + (last_send ? 1 : 0));
+
+  struct io_uring_sqe* prev = nullptr;
+
+  if (iov_count > 0) {
+    uc->msg.msg_iov    = uc->iov;
+    uc->msg.msg_iovlen = static_cast<size_t>(iov_count);
+
+    struct io_uring_sqe* sqe = ring.get_sqe();
+    sqe->opcode    = IORING_OP_SENDMSG;
+    sqe->fd        = conn.fd;
+    sqe->addr      = reinterpret_cast<uint64_t>(&uc->msg);
+    sqe->len       = 1;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    if (file_chunk || last_send) {
+      sqe->msg_flags |= MSG_WAITALL;
+    }
+    if (file_chunk) {
+      sqe->msg_flags |= MSG_MORE;
+    }
+    sqe->user_data = pack(uc, OP_SEND);
+    prev = sqe;
+    uc->send_ops++;
+    uc->inflight++;
+  }
+
+  if (file_chunk) {
+    if (!uc->file_buffer) {
+      uc->file_buffer = BufferPool::for_this_thread().lend(URING_FILE_CHUNK_SIZE,
+                                                           uc->file_buffer_capacity);
+    }
+    if (prev) {
+      prev->flags |= IOSQE_IO_LINK;
+    }
+
+    struct io_uring_sqe* read = ring.get_sqe();
+    read->opcode    = IORING_OP_READ;
+    read->fd        = file_chunk->file->fd;
+    read->addr      = reinterpret_cast<uint64_t>(uc->file_buffer);
+    read->len       = static_cast<uint32_t>(file_length);
+    read->off       = static_cast<uint64_t>(file_offset);
+    read->flags    |= IOSQE_IO_LINK;
+    read->user_data = pack(uc, OP_READ);
+    uc->file_read_length = file_length;
+
+    struct io_uring_sqe* send = ring.get_sqe();
+    send->opcode    = IORING_OP_SEND;
+    send->fd        = conn.fd;
+    send->addr      = reinterpret_cast<uint64_t>(uc->file_buffer);
+    send->len       = static_cast<uint32_t>(file_length);
+    send->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+    send->user_data = pack(uc, OP_SEND);
+    prev = send;
+
+    uc->send_ops += 2;
+    uc->inflight += 2;
+  }
+
+  if (last_send) {
+    prev->flags |= IOSQE_IO_LINK;
+
+    struct io_uring_sqe* shut = ring.get_sqe();
+    shut->opcode    = IORING_OP_SHUTDOWN;
+    shut->fd        = conn.fd;
+    shut->len       = SHUT_RDWR;
+    shut->user_data = pack(uc, OP_SHUTDOWN);
+    uc->shutdown_pending = true;
+    uc->inflight++;
+  }
+}
+
+/*
+ * Wait once for fd to become readable. A poll holds its own reference
+ * to the file, so it stays pending even if fd is closed meanwhile.
+ */
+void UringReactor::arm_poll(int fd, uint64_t user_data) {
+  struct io_uring_sqe* sqe = ring.get_sqe();
+  sqe->opcode        = IORING_OP_POLL_ADD;
+  sqe->fd            = fd;
+  sqe->poll32_events = POLLIN;
+  sqe->user_data     = user_data;
+}
+
+/*
+ * Keep a read poll on every running worker whose clients can take more
+ * output, and a write poll while frames are queued for it
+ */
+void UringReactor::arm_worker(CgiWorker* worker) {
+  if (!worker->process.running()) {
+    return;
+  }
+  if (!worker->read_armed && worker->wants_read()) {
+    struct io_uring_sqe* sqe = ring.get_sqe();
+    sqe->opcode        = IORING_OP_POLL_ADD;
+    sqe->fd            = worker->process.fd();
+    sqe->poll32_events = POLLIN;
+    sqe->user_data     = pack(worker, OP_WORKER_READ);
+    worker->read_armed = true;
+  }
+  if (!worker->write_armed && worker->wants_write()) {
+    struct io_uring_sqe* sqe = ring.get_sqe();
+    sqe->opcode        = IORING_OP_POLL_ADD;
+    sqe->fd            = worker->process.fd();
+    sqe->poll32_events = POLLOUT;
+    sqe->user_data     = pack(worker, OP_WORKER_WRITE);
+    worker->write_armed = true;
+  }
+}
+
+/* ----------------------------
+ * Completions
+ * ---------------------------- */
+
+void UringReactor::handle_completion(uint64_t user_data, int32_t res, uint32_t flags) {
+  UringOp op = static_cast<UringOp>(user_data & OP_MASK);
+  UringConnection* uc = reinterpret_cast<UringConnection*>(user_data & ~OP_MASK);
+
+  switch (op) {
+    case OP_ACCEPT:
+      on_accept(res, flags);
+      break;
+
+    case OP_TIMEOUT:
+      close_expired_connections();
+      reap_cgi_without_pidfd();
+      restart_cgi_workers();
+      arm_timeout();
+      break;
+
+    case OP_RECV:
+      on_recv(uc, res, flags);
+      break;
+
+    case OP_READ:
+      on_read(uc, res);
+      break;
+
+    case OP_SEND:
+      on_send(uc, res);
+      break;
+
+    case OP_SHUTDOWN:
+      on_shutdown(uc, res);
+      break;
+
+    case OP_CGI_OUTPUT:
+      on_cgi_output(reinterpret_cast<CgiProcess*>(user_data & ~OP_MASK));
+      break;
+
+    case OP_CGI_EXIT:
+      on_cgi_exit(reinterpret_cast<CgiProcess*>(user_data & ~OP_MASK));
+      break;
+
+    case OP_WORKER_READ:
+    case OP_WORKER_WRITE:
+      on_worker_ready(reinterpret_cast<CgiWorker*>(user_data & ~OP_MASK), op == OP_WORKER_READ);
+      break;
+  }
+}
+
+void UringReactor::on_accept(int32_t res, uint32_t flags) {
+  // The multishot accept ends on error or when the kernel drops it
+  if (!(flags & IORING_CQE_F_MORE)) {
+    arm_accept();
+  }
+
+  if (res < 0) {
+    if (res != -EAGAIN && res != -EINTR && res != -ECONNABORTED) {
+      LOG_ERROR("[Error] io_uring accept failed (errno={})", -res);
+    }
+    return;
+  }
+
+  if (shedder.overloaded()) {
+    LOG_DEBUG("[Reactor {}] Overloaded, shedding new connection (fd={})", id, res);
+    record_connection_opened();
+    shed_connection(res);
+    return;
+  }
+
+  LOG_DEBUG("[Reactor {}] Accepted new connection (fd={})", id, res);
+
+  UringConnection* uc = connection_pool->create(res);
+  connections.insert(uc);
+  arm_recv(uc);
+  timers.schedule(&uc->conn.timer, uc->conn.deadline_ms());
+}
+
+void UringReactor::on_recv(UringConnection* uc, int32_t res, uint32_t flags) {
+  uc->recv_armed = false;
+  uc->inflight--;
+
+  bool has_buffer = flags & IORING_CQE_F_BUFFER;
+  uint16_t buffer_id = static_cast<uint16_t>(flags >> IORING_CQE_BUFFER_SHIFT);
+
+  if (uc->closing) {
+    if (has_buffer) {
+      ring.recycle_buffer(buffer_id);
+    }
+    release_if_done(uc);
+    return;
+  }
+
+  if (res == -ENOBUFS) {
+    uc->recv_starved = true;
+    starved.push_back(uc);
+    return;
+  }
+  if (res < 0) {
+    begin_close(uc);
+    return;
+  }
+
+  if (res == 0) {
+    uc->conn.consume_eof();
+  } else {
+    uc->conn.consume_input(ring.buffer_address(buffer_id), static_cast<size_t>(res));
+  }
+  if (has_buffer) {
+    ring.recycle_buffer(buffer_id);
+  }
+
+  service(uc);
+}
+
+/*
+ * The file read staged in a send chain. A short read means the file
+ * shrank, so the promised Content-Length can no longer be met.
+ */
+void UringReactor::on_read(UringConnection* uc, int32_t res) {
+  uc->send_ops--;
+  uc->inflight--;
+
+  if (uc->closing) {
+    release_if_done(uc);
+    return;
+  }
+  if (res == -ECANCELED) {
+    return;  // An earlier send in the chain came up short
+  }
+  if (res < 0 || static_cast<size_t>(res) != uc->file_read_length) {
+    LOG_ERROR("[Error] io_uring file read failed (fd={})", uc->conn.fd);
+    begin_close(uc);
+  }
+}
+
+void UringReactor::on_send(UringConnection* uc, int32_t res) {
+  uc->send_ops--;
+  uc->inflight--;
+
+  if (uc->closing) {
+    release_if_done(uc);
+    return;
+  }
+  if (res < 0 && res != -ECANCELED) {
+    begin_close(uc);
+    return;
+  }
+
+  if (res > 0) {
+    uc->conn.complete_write(static_cast<size_t>(res));
+  }
+  if (uc->send_ops == 0) {
+    uc->release_file_buffer();  // The next chain borrows it again if needed
+    uc->conn.resume_input();
+    service(uc);
+  }
+}
+
+void UringReactor::on_shutdown(UringConnection* uc, int32_t res) {
+  uc->shutdown_pending = false;
+  uc->inflight--;
+
+  // A broken link (-ECANCELED) means the send failed; close normally
+  if (res == 0) {
+    uc->shutdown_done = true;
+  } else if (uc->closing && !uc->shutdown_done) {
+    shutdown(uc->conn.fd, SHUT_RDWR);
+    uc->shutdown_done = true;
+  }
+
+  if (uc->closing) {
+    release_if_done(uc);
+  }
+}
+
+/*
+ * The program's pipe is readable, or hung up. Relay what it wrote;
+ * once the response is complete, answer the next pipelined request.
+ */
+void UringReactor::on_cgi_output(CgiProcess* cgi) {
+  cgi->output_armed = false;
+
+  UringConnection* uc = static_cast<UringConnection*>(cgi->owner);
+  if (!uc) {
+    cgi->close_output();  // Abandoned while the poll was in flight
+    retire_cgi_if_finished(cgi);
+    return;
+  }
+
+  if (cgi->read_output()) {
+    cgi->close_output();
+    cgi->reap();
+    retire_cgi_if_finished(cgi);
+    if (uc->send_ops == 0) {
+      uc->conn.resume_input();
+    }
+  }
+  service(uc);
+}
+
+void UringReactor::on_cgi_exit(CgiProcess* cgi) {
+  cgi->exit_armed = false;
+  cgi->reap();
+  if (!cgi->exited) {
+    unreaped.push_back(cgi);
+  }
+  retire_cgi_if_finished(cgi);
+}
+
+/*
+ * A worker's socket is ready. A poll can outlive the socket it was
+ * armed on (it holds its own reference), so the worker may have been
+ * restarted since; reading or writing then just finds nothing to do.
+ */
+void UringReactor::on_worker_ready(CgiWorker* worker, bool readable) {
+  if (readable) {
+    worker->read_armed = false;
+  } else {
+    worker->write_armed = false;
+  }
+  if (!worker->process.running()) {
+    return;
+  }
+
+  std::vector<Connection*> touched;
+  bool alive = readable ? cgi_workers.read(worker, touched) : cgi_workers.flush(worker);
+  if (alive) {
+    arm_worker(worker);
+  } else {
+    cgi_workers.fail(worker, touched);
+  }
+
+  for (Connection* conn : touched) {
+    UringConnection* uc = static_cast<UringConnection*>(conn->timer.owner);
+    if (uc->closing) {
+      continue;
+    }
+    if (uc->send_ops == 0) {
+      uc->conn.resume_input();
+    }
+    service(uc);
+  }
+}
+
+void UringReactor::restart_cgi_workers() {
+  std::vector<CgiWorker*> restarted;
+  cgi_workers.restart_due(monotonic_ms(), restarted);
+  for (CgiWorker* worker : restarted) {
+    arm_worker(worker);
+  }
+}
+
+/* ----------------------------
+ * CGI programs
+ * ---------------------------- */
+
+/*
+ * Take ownership of a program the request handler just started and
+ * watch for its exit
+ */
+void UringReactor::adopt_cgi(UringConnection* uc) {
+  CgiProcess* cgi = uc->conn.cgi;
+  if (cgi->adopted) {
+    return;
+  }
+  cgi->adopted = true;
+  cgi->owner = uc;
+  cgi_processes.insert(cgi);
+
+  if (cgi->pidfd >= 0) {
+    arm_poll(cgi->pidfd, pack(cgi, OP_CGI_EXIT));
+    cgi->exit_armed = true;
+  } else {
+    unreaped.push_back(cgi);
+  }
+}
+
+/*
+ * Free a program once it is reaped, its pipe closed and no poll on it
+ * is still in flight
+ */
+void UringReactor::retire_cgi_if_finished(CgiProcess* cgi) {
+  if (!cgi->finished() || cgi->output_armed || cgi->exit_armed) {
+    return;
+  }
+  if (cgi_processes.erase(cgi) > 0) {
+    delete cgi;
+  }
+}
+
+/*
+ * Poll the children that have no pidfd
+ */
+void UringReactor::reap_cgi_without_pidfd() {
+  for (size_t i = 0; i < unreaped.size();) {
+    CgiProcess* cgi = unreaped[i];
+    cgi->reap();
+    if (cgi->exited) {
+      unreaped[i] = unreaped.back();
+      unreaped.pop_back();
+      retire_cgi_if_finished(cgi);
+    } else {
+      ++i;
+    }
+  }
+}
+
+/* ----------------------------
+ * Connection lifecycle
+ * ---------------------------- */
+
+/*
+ * Submit whatever the connection's state machine asks for next
+ */
+void UringReactor::service(UringConnection* uc) {
+  if (uc->closing) {
+    return;
+  }
+
+  Connection& conn = uc->conn;
+  if (conn.state == ConnState::CLOSED) {
+    begin_close(uc);
+    return;
+  }
+
+  if (uc->send_ops == 0 && !conn.write_queue.empty()) {
+    arm_send(uc);
+  }
+  if (!uc->recv_armed && !uc->recv_starved && conn.wants_input()) {
+    arm_recv(uc);
+  }
+  if (conn.cgi && conn.cgi->worker) {
+    arm_worker(conn.cgi->worker);
+  } else if (conn.cgi) {
+    adopt_cgi(uc);
+    if (!conn.cgi->output_armed && conn.cgi->wants_output()) {
+      arm_poll(conn.cgi->output_fd, pack(conn.cgi, OP_CGI_OUTPUT));
+      conn.cgi->output_armed = true;
+    }
+  }
+  timers.schedule(&conn.timer, conn.deadline_ms());
+}
+
+/*
+ * Shut the socket down so any in-flight recv completes, then free the
+ * connection once the kernel holds no more references to it
+ */
+void UringReactor::begin_close(UringConnection* uc) {
+  if (uc->closing) {
+    return;
+  }
+  uc->closing = true;
+  uc->conn.state = ConnState::CLOSED;
+  timers.cancel(&uc->conn.timer);
+
+  // A program still answering this client is killed and left to be
+  // reaped; an in-flight poll on its pipe ends with the hang-up. A
+  // worker's request is forgotten, which may let the worker be read again.
+  if (uc->conn.cgi && uc->conn.cgi->worker) {
+    CgiProcess* cgi = uc->conn.cgi;
+    CgiWorker* worker = cgi->worker;
+    uc->conn.cgi = nullptr;
+    cgi->abandon();
+    cgi_workers.cancel(cgi);
+    arm_worker(worker);
+  } else if (uc->conn.cgi) {
+    adopt_cgi(uc);
+    CgiProcess* cgi = uc->conn.cgi;
+    uc->conn.cgi = nullptr;
+    cgi->abandon();
+    if (!cgi->output_armed) {
+      cgi->close_output();
+    }
+    retire_cgi_if_finished(cgi);
+  }
+
+  if (!uc->shutdown_pending && !uc->shutdown_done) {
+    shutdown(uc->conn.fd, SHUT_RDWR);
+    uc->shutdown_done = true;
+  }
+  release_if_done(uc);
+}
+
+void UringReactor::release_if_done(UringConnection* uc) {
+  if (uc->inflight > 0 || uc->recv_starved) {
+    return;
+  }
+  connections.erase(uc);
+  LOG_DEBUG("[Reactor {}] Closed connection (fd={})", id, uc->conn.fd);
+  connection_pool->destroy(uc);
+}
+
+/*
+ * Re-arm receives that found the provided-buffer ring empty
+ */
+void UringReactor::retry_starved_recvs() {
+  if (starved.empty()) {
+    return;
+  }
+
+  std::vector<UringConnection*> waiting;
+  waiting.swap(starved);
+
+  for (UringConnection* uc : waiting) {
+    uc->recv_starved = false;
+    if (uc->closing) {
+      release_if_done(uc);
+    } else {
+      service(uc);
+    }
+  }
+}
+
+/*
+ * Close every connection whose deadline has passed
+ */
+void UringReactor::close_expired_connections() {
+  std::vector<TimerNode*> expired;
+  timers.advance(monotonic_ms(), expired);
+
+  for (TimerNode* node : expired) {
+    UringConnection* uc = static_cast<UringConnection*>(node->owner);
+    LOG_DEBUG("[Reactor {}] Timed out connection (fd={})", id, uc->conn.fd);
+    begin_close(uc);
+  }
+}
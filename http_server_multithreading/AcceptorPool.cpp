@@ -0,0 +1,101 @@
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include "include/AcceptorPool.h"
+#include "include/SocketUtils.h"
+#include "include/request.h"
+#include "logger.h"
+#include "request_metrics.h"
+
+using namespace std;
+
+AcceptorPool* g_acceptors = nullptr;
+
+// Open every listener before starting a thread, so a bind failure stops the server at once
+AcceptorPool::AcceptorPool(size_t count, int port, ThreadPool* overflow)
+    : pool(overflow)
+{
+    vector<int> listenFds;
+    for (size_t i = 0; i < count; ++i) {
+        int listenFd = open_listen_fd(port, true);
+        if (listenFd < 0) {
+            LOG_ERROR("[Error] Acceptor {} could not listen on port {}", i, port);
+            exit(1);
+        }
+        // Non-blocking, so an acceptor can tell when its accept queue is empty
+        fcntl(listenFd, F_SETFL, fcntl(listenFd, F_GETFL) | O_NONBLOCK);
+        listenFds.push_back(listenFd);
+    }
+
+    for (int listenFd : listenFds) {
+        acceptors.emplace_back(&AcceptorPool::acceptLoop, this, listenFd);
+        LOG_INFO("[Init] Acceptor created: {}", acceptors.back().native_handle());
+    }
+}
+
+void AcceptorPool::join() {
+    for (auto& acceptor : acceptors) {
+        if (acceptor.joinable())
+            acceptor.join();
+    }
+}
+
+// Acceptor thread loop: take a connection, overflow the rest, serve it here if it has a request
+void AcceptorPool::acceptLoop(int listenFd) {
+    struct pollfd pending = { listenFd, POLLIN, 0 };
+
+    while (true) {
+        // Accepted sockets do not inherit O_NONBLOCK, so requests still block as usual
+        int connFd = accept(listenFd, nullptr, nullptr);
+        if (connFd < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                poll(&pending, 1, -1);
+                continue;
+            }
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            LOG_ERROR("[Error] accept failed on listener {}: {}", listenFd, strerror(errno));
+            exit(1);
+        }
+        record_connection_opened();
+
+        // Connections already waiting would sit behind this one: let the pool have them
+        int extraFd;
+        while ((extraFd = accept(listenFd, nullptr, nullptr)) >= 0) {
+            record_connection_opened();
+            overflowJobs++;
+            pool->queueJob(extraFd);
+        }
+
+        // A client that has sent nothing yet must not hold the acceptor: the pool waits for it
+        struct pollfd request = { connFd, POLLIN, 0 };
+        if (poll(&request, 1, 0) <= 0) {
+            overflowJobs++;
+            if (pool->keepsAlive())
+                pool->releaseConnection(connFd, true);
+            else
+                pool->queueJob(connFd);
+            continue;
+        }
+
+        LOG_DEBUG("[Acceptor {}] serving FD={}", pthread_self(), connFd);
+        string partial;
+        bool keepAlive = handle_request(connFd, partial);
+        inlineRequests++;
+        pool->releaseConnection(connFd, keepAlive, move(partial));
+    }
+}
+
+// Metrics accessors
+size_t AcceptorPool::getAcceptors() {
+    return acceptors.size();
+}
+
+size_t AcceptorPool::getInlineRequests() {
+    return inlineRequests.load();
+}
+
+size_t AcceptorPool::getOverflowJobs() {
+    return overflowJobs.load();
+}
@@ -0,0 +1,185 @@
+#include <cerrno>
+#include <chrono>
+#include <unistd.h>
+#include <sys/socket.h>
+#include "include/CgiWorkerPool.h"
+#include "cgi_protocol.h"
+#include "timer_wheel.h"
+#include "logger.h"
+
+using namespace std;
+
+CgiWorkerPool* g_cgiWorkers = nullptr;
+
+// ---- CgiReply ----
+bool CgiReply::next(string& chunk) {
+    unique_lock<mutex> lock(replyMutex);
+    changed.wait(lock, [this] { return !chunks.empty() || done; });
+    if (chunks.empty())
+        return false;
+
+    chunk = move(chunks.front());
+    chunks.pop_front();
+    return true;
+}
+
+bool CgiReply::failed() {
+    lock_guard<mutex> lock(replyMutex);
+    return workerFailed;
+}
+
+// ---- Start every configured worker ----
+void CgiWorkerPool::start() {
+    uint64_t now = monotonic_ms();
+    for (const string& path : g_cgi_workers.paths) {
+        for (size_t i = 0; i < g_cgi_workers.workers_per_program; ++i) {
+            unique_ptr<CgiWorker> worker(new CgiWorker());
+            worker->path = path;
+            worker->program = "." + path;
+            if (!worker->process.start(worker->program, false, now))
+                LOG_ERROR("[Error] Could not start CGI worker {}", worker->program);
+            workers.push_back(move(worker));
+        }
+    }
+
+    for (unique_ptr<CgiWorker>& worker : workers)
+        readers.emplace_back(&CgiWorkerPool::readerLoop, this, worker.get());
+}
+
+// ---- Send a request to the least busy running worker ----
+shared_ptr<CgiReply> CgiWorkerPool::submit(string_view path, const string& query) {
+    CgiWorker* best = nullptr;
+    size_t bestLoad = 0;
+    for (unique_ptr<CgiWorker>& worker : workers) {
+        if (worker->path != path)
+            continue;
+        lock_guard<mutex> lock(worker->workerMutex);
+        if (worker->process.running() && (!best || worker->replies.size() < bestLoad)) {
+            best = worker.get();
+            bestLoad = worker->replies.size();
+        }
+    }
+    if (!best)
+        return nullptr;
+
+    lock_guard<mutex> lock(best->workerMutex);
+    if (!best->process.running() || best->replies.size() >= UINT16_MAX)
+        return nullptr;
+
+    // Ids wrap; 0 is never used and ids still in flight are skipped
+    uint16_t id = best->nextId;
+    while (id == 0 || best->replies.count(id) > 0)
+        id++;
+    best->nextId = static_cast<uint16_t>(id + 1);
+
+    string frames;
+    append_cgi_frame(frames, CgiFrameType::BEGIN, id, query.data(), query.size());
+    size_t sent = 0;
+    while (sent < frames.size()) {
+        ssize_t rc = send(best->process.fd(), frames.data() + sent, frames.size() - sent, MSG_NOSIGNAL);
+        if (rc < 0 && errno == EINTR)
+            continue;
+        if (rc <= 0)
+            return nullptr; // The reader thread sees the hang-up and restarts it
+        sent += static_cast<size_t>(rc);
+    }
+
+    shared_ptr<CgiReply> reply = make_shared<CgiReply>();
+    reply->worker = best;
+    reply->id = id;
+    best->replies[id] = reply;
+    return reply;
+}
+
+// ---- Forget a reply; later output for it is dropped ----
+void CgiWorkerPool::finish(const shared_ptr<CgiReply>& reply) {
+    lock_guard<mutex> lock(reply->worker->workerMutex);
+    auto it = reply->worker->replies.find(reply->id);
+    if (it != reply->worker->replies.end() && it->second == reply)
+        reply->worker->replies.erase(it);
+}
+
+// ---- Reader thread: relay frames, restart the worker when it dies ----
+void CgiWorkerPool::readerLoop(CgiWorker* worker) {
+    while (true) {
+        uint64_t waitMs = 0;
+        {
+            lock_guard<mutex> lock(worker->workerMutex);
+            uint64_t now = monotonic_ms();
+            if (worker->process.restart_due(now))
+                worker->process.start(worker->program, false, now);
+            if (!worker->process.running())
+                waitMs = worker->process.restart_at() > now ? worker->process.restart_at() - now : 1;
+        }
+
+        if (waitMs > 0) {
+            this_thread::sleep_for(chrono::milliseconds(waitMs));
+            continue;
+        }
+
+        relayFrames(worker);
+        failWorker(worker);
+    }
+}
+
+void CgiWorkerPool::relayFrames(CgiWorker* worker) {
+    int fd;
+    {
+        lock_guard<mutex> lock(worker->workerMutex);
+        fd = worker->process.fd(); // Only this thread stops the worker
+    }
+
+    CgiFrameReader reader;
+    CgiFrame frame;
+    char buf[16384];
+
+    while (true) {
+        ssize_t bytes = read(fd, buf, sizeof(buf));
+        if (bytes < 0 && errno == EINTR)
+            continue;
+        if (bytes <= 0)
+            return;
+
+        reader.append(buf, static_cast<size_t>(bytes));
+        while (reader.next(frame)) {
+            if (frame.type == CgiFrameType::BEGIN)
+                return; // Only the server starts requests
+
+            shared_ptr<CgiReply> reply;
+            {
+                lock_guard<mutex> lock(worker->workerMutex);
+                auto it = worker->replies.find(frame.request_id);
+                if (it == worker->replies.end())
+                    continue; // Its client is gone
+                reply = it->second;
+                if (frame.type == CgiFrameType::END)
+                    worker->replies.erase(it);
+            }
+
+            lock_guard<mutex> lock(reply->replyMutex);
+            if (frame.type == CgiFrameType::STDOUT)
+                reply->chunks.push_back(move(frame.payload));
+            else
+                reply->done = true;
+            reply->changed.notify_one();
+        }
+        if (reader.failed())
+            return;
+    }
+}
+
+void CgiWorkerPool::failWorker(CgiWorker* worker) {
+    lock_guard<mutex> lock(worker->workerMutex);
+    LOG_ERROR("[Error] CGI worker {} (pid {}) failed; restarting",
+              worker->program, worker->process.pid());
+
+    for (auto& entry : worker->replies) {
+        CgiReply& reply = *entry.second;
+        lock_guard<mutex> replyLock(reply.replyMutex);
+        reply.done = true;
+        reply.workerFailed = true;
+        reply.changed.notify_one();
+    }
+    worker->replies.clear();
+    worker->process.stop(monotonic_ms());
+}
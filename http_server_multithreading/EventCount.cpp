@@ -0,0 +1,106 @@
+#include "include/EventCount.h"
+
+#include <climits>
+#include <ctime>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+using namespace std;
+
+static_assert(sizeof(atomic<uint32_t>) == sizeof(uint32_t) &&
+              atomic<uint32_t>::is_always_lock_free,
+              "futex words are plain 32-bit integers");
+
+// ---- futex helpers ----
+
+// Sleep while `word` still holds `expected`, or until `timeout` (nullptr: forever)
+static void futexWait(atomic<uint32_t>& word, uint32_t expected, const timespec* timeout) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT_PRIVATE,
+            expected, timeout, nullptr, 0);
+}
+
+static void futexWake(atomic<uint32_t>& word, int count) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE_PRIVATE,
+            count, nullptr, nullptr, 0);
+}
+
+// ---- state: waiters in the low half, wake-ups not yet taken in the high half ----
+constexpr uint64_t ONE_WAITER = 1;
+constexpr uint64_t ONE_SIGNAL = uint64_t(1) << 32;
+
+static uint32_t waitersOf(uint64_t state) { return static_cast<uint32_t>(state); }
+static uint32_t signalsOf(uint64_t state) { return static_cast<uint32_t>(state >> 32); }
+
+/*
+  The waiter raises the waiter count and then re-checks its condition; the
+  notifier changes the condition and then reads the count. The fences keep
+  either from reading before its own write is visible, so at least one of
+  them sees the other: a change is never missed by every waiter.
+*/
+uint32_t EventCount::prepareWait() {
+    uint32_t key = epoch.load(memory_order_acquire);
+    state.fetch_add(ONE_WAITER);
+    atomic_thread_fence(memory_order_seq_cst);
+    return key;
+}
+
+void EventCount::cancelWait() {
+    leave();
+}
+
+void EventCount::wait(uint32_t key) {
+    futexWait(epoch, key, nullptr);
+    leave();
+}
+
+void EventCount::waitFor(uint32_t key, chrono::nanoseconds timeout) {
+    auto nanos = timeout.count() > 0 ? timeout.count() : 0;
+    timespec wait = { static_cast<time_t>(nanos / 1000000000),
+                      static_cast<long>(nanos % 1000000000) };
+    futexWait(epoch, key, &wait);
+    leave();
+}
+
+/*
+  A woken waiter stays counted until it runs. Without the signal count,
+  every notify in that window would make another wake-up system call for
+  the same sleeper, more than one per job in a burst. A notify that finds
+  a wake-up on its way to every waiter does nothing. Any waiter that
+  returns takes one: all of them re-check their condition, so which one
+  does not matter.
+*/
+void EventCount::notifyOne() {
+    atomic_thread_fence(memory_order_seq_cst);
+    uint64_t current = state.load(memory_order_relaxed);
+    do {
+        if (waitersOf(current) <= signalsOf(current))
+            return;
+    } while (!state.compare_exchange_weak(current, current + ONE_SIGNAL, memory_order_relaxed));
+
+    epoch.fetch_add(1, memory_order_release);
+    futexWake(epoch, 1);
+}
+
+// As notifyOne(), but a wake-up goes to every waiter that has none on its way
+void EventCount::notifyAll() {
+    atomic_thread_fence(memory_order_seq_cst);
+    uint64_t current = state.load(memory_order_relaxed);
+    do {
+        if (waitersOf(current) <= signalsOf(current))
+            return;
+    } while (!state.compare_exchange_weak(current, waitersOf(current) * (ONE_SIGNAL + ONE_WAITER),
+                                          memory_order_relaxed));
+
+    epoch.fetch_add(1, memory_order_release);
+    futexWake(epoch, INT_MAX);
+}
+
+// Stop counting as a waiter, taking a pending wake-up along if there is one
+void EventCount::leave() {
+    uint64_t current = state.load(memory_order_relaxed);
+    uint64_t next;
+    do {
+        next = current - ONE_WAITER - (signalsOf(current) > 0 ? ONE_SIGNAL : 0);
+    } while (!state.compare_exchange_weak(current, next, memory_order_relaxed));
+}
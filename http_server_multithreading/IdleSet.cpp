@@ -0,0 +1,164 @@
+#include <cerrno>
+#include <cstring>
+#include <sys/epoll.h>
+#include <unistd.h>
+#include "include/IdleSet.h"
+#include "include/WorkerPool.h"
+#include "logger.h"
+#include "request_metrics.h"
+
+using namespace std;
+
+// Readiness events handled per epoll_wait()
+constexpr int IDLE_MAX_EVENTS = 64;
+
+IdleSet::IdleSet(ThreadPool* owner, chrono::seconds idleTimeout)
+    : pool(owner),
+      timeout(idleTimeout),
+      epollFd(epoll_create1(EPOLL_CLOEXEC))
+{
+    if (epollFd < 0) {
+        LOG_ERROR("[Error] epoll_create1 failed: {}", strerror(errno));
+        exit(1);
+    }
+    poller = thread(&IdleSet::pollLoop, this);
+}
+
+// Stop the poller, then close whatever is still parked
+IdleSet::~IdleSet() {
+    stopping = true;
+    poller.join();
+
+    lock_guard<mutex> lock(parkedMutex);
+    for (auto& entry : parked) {
+        if (entry && entry->timer.pending()) {
+            wheel.cancel(&entry->timer);
+            close(entry->fd);
+            record_connection_closed();
+        }
+    }
+    for (int fd : ready) {
+        close(fd);
+        record_connection_closed();
+    }
+    close(epollFd);
+}
+
+// Register under the lock, so the poller cannot time the socket out before it is watched
+void IdleSet::park(int fd, string partial) {
+    lock_guard<mutex> lock(parkedMutex);
+
+    if (static_cast<size_t>(fd) >= parked.size())
+        parked.resize(static_cast<size_t>(fd) + 1);
+    if (!parked[fd])
+        parked[fd] = make_unique<Parked>(fd);
+    parked[fd]->partial = move(partial);
+
+    struct epoll_event event = {};
+    event.events = EPOLLIN | EPOLLONESHOT;
+    event.data.fd = fd;
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) < 0) {
+        LOG_ERROR("[Error] Could not park FD={}: {}", fd, strerror(errno));
+        parked[fd]->partial.clear();
+        close(fd);
+        record_connection_closed();
+        return;
+    }
+
+    wheel.schedule(&parked[fd]->timer, monotonic_ms() + static_cast<uint64_t>(timeout.count()));
+    parkedCount++;
+    LOG_DEBUG("[Idle] Parked FD={}", fd);
+}
+
+string IdleSet::takePartial(int fd) {
+    lock_guard<mutex> lock(parkedMutex);
+    if (static_cast<size_t>(fd) >= parked.size() || !parked[fd])
+        return string();
+    string partial;
+    partial.swap(parked[fd]->partial);
+    return partial;
+}
+
+void IdleSet::unpark(int fd) {
+    lock_guard<mutex> lock(parkedMutex);
+    wheel.cancel(&parked[fd]->timer);
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+    parkedCount--;
+}
+
+// Poller thread loop: requeue sockets that have a request, close those idle too long
+void IdleSet::pollLoop() {
+    struct epoll_event events[IDLE_MAX_EVENTS];
+    vector<TimerNode*> expired;
+
+    while (!stopping.load()) {
+        // Sockets still waiting for queue room go first, in order
+        vector<int> retry;
+        retry.swap(ready);
+        for (int fd : retry) {
+            queueReady(fd);
+        }
+
+        int waitMs;
+        {
+            lock_guard<mutex> lock(parkedMutex);
+            waitMs = wheel.next_timeout_ms(monotonic_ms());
+        }
+        if (waitMs < 0 || waitMs > IDLE_POLL_MS)
+            waitMs = IDLE_POLL_MS;
+        if (!ready.empty() && waitMs > IDLE_RETRY_MS)
+            waitMs = IDLE_RETRY_MS;
+
+        int readyCount = epoll_wait(epollFd, events, IDLE_MAX_EVENTS, waitMs);
+        if (readyCount < 0) {
+            if (errno == EINTR)
+                continue;
+            LOG_ERROR("[Error] epoll_wait failed: {}", strerror(errno));
+            exit(1);
+        }
+
+        for (int i = 0; i < readyCount; ++i) {
+            int fd = events[i].data.fd;
+            unpark(fd);
+            if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                takePartial(fd);
+                close(fd);
+                record_connection_closed();
+                continue;
+            }
+            LOG_DEBUG("[Idle] FD={} readable, queuing", fd);
+            queueReady(fd);
+        }
+
+        // Sockets that became readable above are no longer on the wheel
+        expired.clear();
+        lock_guard<mutex> lock(parkedMutex);
+        wheel.advance(monotonic_ms(), expired);
+        for (TimerNode* node : expired) {
+            Parked* entry = static_cast<Parked*>(node->owner);
+            epoll_ctl(epollFd, EPOLL_CTL_DEL, entry->fd, nullptr);
+            entry->partial.clear();
+            close(entry->fd);
+            record_connection_closed();
+            LOG_DEBUG("[Idle] Closed FD={} after {} s idle", entry->fd, timeout.count() / 1000);
+        }
+        parkedCount -= expired.size();
+        timeouts += expired.size();
+    }
+}
+
+// Never blocks the poller: a socket that finds the queue full waits in `ready`
+void IdleSet::queueReady(int fd) {
+    if (!ready.empty() || !pool->tryQueueJob(fd)) {
+        ready.push_back(fd);
+    }
+}
+
+// Metrics accessors
+size_t IdleSet::getParked() {
+    return parkedCount.load();
+}
+
+size_t IdleSet::getTimeouts() {
+    return timeouts.load();
+}
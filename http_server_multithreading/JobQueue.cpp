@@ -0,0 +1,56 @@
+#include "include/JobQueue.h"
+
+using namespace std;
+
+JobQueue::JobQueue(size_t capacity) : ring(capacity) {}
+
+void JobQueue::push(int fd) {
+    QueuedJob job = { fd, chrono::steady_clock::now() };
+
+    while (!ring.tryPush(job)) {
+        uint32_t key = spaceFreed.prepareWait();
+        if (ring.tryPush(job)) {
+            spaceFreed.cancelWait();
+            break;
+        }
+        spaceFreed.wait(key);
+    }
+    jobPosted.notifyOne();
+}
+
+bool JobQueue::tryPush(int fd) {
+    if (!ring.tryPush(QueuedJob{ fd, chrono::steady_clock::now() })) {
+        return false;
+    }
+    jobPosted.notifyOne();
+    return true;
+}
+
+bool JobQueue::pop(int& fd, chrono::milliseconds timeout) {
+    chrono::nanoseconds waited;
+    return pop(fd, timeout, waited);
+}
+
+bool JobQueue::pop(int& fd, chrono::milliseconds timeout, chrono::nanoseconds& waited) {
+    auto deadline = chrono::steady_clock::now() + timeout;
+    QueuedJob job;
+
+    while (!ring.tryPop(job)) {
+        auto left = deadline - chrono::steady_clock::now();
+        if (left <= chrono::steady_clock::duration::zero()) {
+            return false;
+        }
+
+        uint32_t key = jobPosted.prepareWait();
+        if (ring.tryPop(job)) {
+            jobPosted.cancelWait();
+            break;
+        }
+        jobPosted.waitFor(key, left);
+    }
+    spaceFreed.notifyOne();
+
+    fd = job.fd;
+    waited = chrono::steady_clock::now() - job.queuedAt;
+    return true;
+}
@@ -6,20 +6,28 @@
 // for memset
 #include <cstring>      
 
+#include "logger.h"
+
 // Set up a socket to listen for incoming connections
-int open_listen_fd(int port) {
+int open_listen_fd(int port, bool reusePort) {
 
     // Create socket
     int listen_fd = ::socket(AF_INET, SOCK_STREAM, 0);
     if (listen_fd < 0) {
-        std::cerr << "socket failed" << std::endl;
+        LOG_ERROR("socket failed");
         return -1;
     }
 
     // Eliminates "Address already in use" error from bind
     int optval = 1;
     if (::setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &optval, sizeof(optval)) < 0) {
-        std::cerr << "setsockopt failed" << std::endl;
+        LOG_ERROR("setsockopt failed");
+        return -1;
+    }
+
+    if (reusePort &&
+        ::setsockopt(listen_fd, SOL_SOCKET, SO_REUSEPORT, &optval, sizeof(optval)) < 0) {
+        LOG_ERROR("setsockopt(SO_REUSEPORT) failed");
         return -1;
     }
 
@@ -32,13 +40,13 @@ int open_listen_fd(int port) {
 
     // Bind the socket
     if (::bind(listen_fd, reinterpret_cast<sockaddr_t*>(&server_addr), sizeof(server_addr)) < 0) {
-        std::cerr << "bind failed" << std::endl;
+        LOG_ERROR("bind failed");
         return -1;
     }
 
     // Listen for incoming connections
     if (::listen(listen_fd, QUEUE_SIZE) < 0) {
-        std::cerr << "listen failed" << std::endl;
+        LOG_ERROR("listen failed");
         return -1;
     }
 
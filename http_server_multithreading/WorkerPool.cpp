@@ -1,131 +1,433 @@
 #include "include/WorkerPool.h"
-#include "include/ThreadSafeCout.h"
 #include "include/request.h"
 #include "include/SocketUtils.h"
+#include "logger.h"
+#include "request_metrics.h"
 
+#include <algorithm>
 #include <chrono>
+#include <cstdlib>
 
 using namespace std;
 
+// The calling thread's deque in work-stealing mode
+struct LocalSource {
+    ThreadPool* pool = nullptr;
+    WorkSource* source = nullptr;
+    bool isWorker = false;
+};
+
+static thread_local LocalSource t_local;
+
 // Constructor: initialize the thread pool
 ThreadPool::ThreadPool(size_t initialThreads,
-                       size_t bufferSize,
+                       size_t bufSize,
                        size_t minThr,
-                       size_t maxThr)
-    : queueSize(bufferSize),
-      minThreads(minThr),
-      maxThreads(maxThr)
+                       size_t maxThr,
+                       Scheduling mode)
+    : jobs(bufSize),
+      bufferSize(bufSize),
+      minThreads(max<size_t>(minThr, 1)),
+      maxThreads(max(maxThr, max<size_t>(minThr, 1))),
+      scheduling(mode)
 {
-    for (size_t i = 0; i < initialThreads; ++i) {
-        threads.emplace_back(&ThreadPool::threadLoop, this);
-        liveThreads++;
-        ThreadSafeCout() << "[Init] Thread created: "
-                     << threads.back().get_id() << endl;
+    if (scheduling == Scheduling::WORK_STEALING) {
+        sourceSlots = initialThreads + MAX_WORK_SOURCES;
+        sources.reset(new atomic<WorkSource*>[sourceSlots]());
+
+        for (size_t i = 0; i < initialThreads; ++i) {
+            auto worker = make_unique<Worker>();
+            worker->handle = thread(&ThreadPool::stealLoop, this, addSource());
+            liveThreads++;
+            LOG_INFO("[Init] Thread created: {}", worker->handle.native_handle());
+            workers.push_back(move(worker));
+        }
+        return;
     }
+
+    size_t initial = min(max(initialThreads, minThreads), maxThreads);
+    for (size_t i = 0; i < initial; ++i) {
+        spawnWorker();
+        LOG_INFO("[Init] Thread created: {}", workers.back()->handle.native_handle());
+    }
+    scaler = thread(&ThreadPool::scaleLoop, this);
 }
 
 // Worker thread loop: fetch and process jobs
-void ThreadPool::threadLoop() {
-    while (true) {
+void ThreadPool::threadLoop(Worker* self) {
+    while (!claimRetirement()) {
         int fd = -1;
+        chrono::nanoseconds waited;
 
-        {
-            unique_lock<mutex> lock(queueMutex);
-
-            // Wait for a job or timeout
-            if (!jobAvailable.wait_for(
-                    lock,
-                    chrono::seconds(10),
-                    [this] { return !jobs.empty(); })) {
-
-                // Exit idle threads above minimum
-                if (liveThreads.load() > minThreads) {
-                    liveThreads--;
-                    ThreadSafeCout() << "[Thread "
-                                 << this_thread::get_id()
-                                 << "] idle timeout → exiting"
-                                 << endl;
-                    return;
-                }
-                continue;
-            }
+        // Wait for a job, waking now and then to see if this thread is retired
+        if (!jobs.pop(fd, RETIRE_CHECK_INTERVAL, waited)) {
+            continue;
+        }
+        queueWaitNanos += static_cast<uint64_t>(waited.count());
+        queueWaits++;
 
-            // Pop a job from the queue
-            fd = jobs.front();
-            jobs.pop();
-            spaceAvailable.notify_one();
+        // Waited too long to be worth serving: answer 503 and move on
+        uint64_t waitedUs = static_cast<uint64_t>(waited.count()) / 1000;
+        shedder.record(waitedUs, monotonic_us());
+        if (shedder.too_late(waitedUs)) {
+            LOG_DEBUG("[Thread {}] shedding FD={} after {} us in the queue", pthread_self(), fd, waitedUs);
+            shed_connection(fd);
+            continue;
         }
 
         // Process the job
+        record_phase(RequestPhase::QUEUE, waitedUs);
         activeThreads++;
-        processJob(fd);
+        processJob(fd, waitedUs);
         activeThreads--;
         totalRequests++;
     }
+
+    LOG_INFO("[Thread {}] retired → exiting", pthread_self());
+    self->exited.store(true, memory_order_release);
+    scaleNeeded.notifyOne();
 }
 
 // Add a job to the queue
 void ThreadPool::queueJob(int fd) {
-    unique_lock<mutex> lock(queueMutex);
+    if (scheduling == Scheduling::WORK_STEALING) {
+        queueLocal(fd);
+        return;
+    }
+
+    // Checked first, as push() may block on a full queue
+    wakeScalerIfShort();
+
+    if (shedder.enabled()) {
+        if (!jobs.tryPush(fd)) {
+            LOG_DEBUG("[Main] Queue full, shedding FD={}", fd);
+            shed_connection(fd);
+            return;
+        }
+    } else {
+        // Waits if the queue is full
+        jobs.push(fd);
+    }
+
+    LOG_DEBUG("[Main] Added FD={} to queue, size={}", fd, jobs.size());
+}
+
+bool ThreadPool::tryQueueJob(int fd) {
+    if (scheduling == Scheduling::WORK_STEALING) {
+        if (!localSource()->deque.push(fd, monotonic_us())) {
+            return false;
+        }
+        workPosted.notifyOne();
+        return true;
+    }
+
+    wakeScalerIfShort();
+    if (!jobs.tryPush(fd)) {
+        return false;
+    }
+    LOG_DEBUG("[Main] Added FD={} to queue, size={}", fd, jobs.size());
+    return true;
+}
+
+// Wake the scaler early if one more job eats into the spare threads
+void ThreadPool::wakeScalerIfShort() {
+    size_t live = liveThreads.load(memory_order_relaxed);
+    size_t idle = live - min(live, activeThreads.load(memory_order_relaxed));
+    if (live < maxThreads && idle < jobs.size() + 1 + SPARE_THREADS) {
+        scaleNeeded.notifyOne();
+    }
+}
+
+// Execute a single job; handle_request() times each request it answers
+void ThreadPool::processJob(int fd, uint64_t waitedUs) {
+    string partial = idle ? idle->takePartial(fd) : string();
+    bool keepAlive = handle_request(fd, partial, waitedUs);
+    releaseConnection(fd, keepAlive, move(partial));
+
+    LOG_DEBUG("[Thread {}] completed FD={}", pthread_self(), fd);
+}
+
+void ThreadPool::releaseConnection(int fd, bool keepAlive, string partial) {
+    if (keepAlive && idle) {
+        idle->park(fd, move(partial));
+    } else {
+        close(fd);
+        record_connection_closed();
+    }
+}
+
+// ---- Work-stealing mode ----
+
+// Give the calling thread a deque of its own; workers and sources alike
+WorkSource* ThreadPool::addSource() {
+    size_t index = sourceCount.fetch_add(1);
+    if (index >= sourceSlots) {
+        LOG_ERROR("[Error] More than {} threads queue jobs", sourceSlots);
+        exit(1);
+    }
+    WorkSource* source = new WorkSource(bufferSize);
+    sources[index].store(source, memory_order_release);
+    return source;
+}
+
+WorkSource* ThreadPool::localSource() {
+    if (t_local.pool != this) {
+        t_local = { this, addSource(), false };
+    }
+    return t_local.source;
+}
+
+void ThreadPool::queueLocal(int fd) {
+    WorkSource* own = localSource();
+    uint64_t queuedUs = monotonic_us();
+
+    while (!own->deque.push(fd, queuedUs)) {
+        if (t_local.isWorker) {
+            // A worker never waits on its own deque: nobody else might be free
+            activeThreads++;
+            processJob(fd);
+            activeThreads--;
+            totalRequests++;
+            return;
+        }
+
+        if (shedder.enabled()) {
+            LOG_DEBUG("[Main] Deque full, shedding FD={}", fd);
+            shed_connection(fd);
+            return;
+        }
+
+        // Wait for a thief to make room
+        uint32_t key = own->spaceFreed.prepareWait();
+        if (own->deque.push(fd, queuedUs)) {
+            own->spaceFreed.cancelWait();
+            break;
+        }
+        own->spaceFreed.wait(key);
+    }
+
+    LOG_DEBUG("[Main] Added FD={} to local deque, size={}", fd, own->deque.size());
+    workPosted.notifyOne();
+}
+
+bool ThreadPool::findJob(WorkSource* own, int& fd, uint64_t& queuedUs) {
+    if (own->deque.pop(fd, queuedUs)) {
+        return true;
+    }
 
-    // Wait if the queue is full
-    spaceAvailable.wait(lock, [this] {
-        return jobs.size() < queueSize;
-    });
+    // Visit every other deque once, starting at a random victim
+    thread_local unsigned int seed = static_cast<unsigned int>(pthread_self());
+    size_t count = min(sourceCount.load(memory_order_acquire), sourceSlots);
+    size_t start = static_cast<size_t>(rand_r(&seed)) % count;
 
-    jobs.push(fd);
+    for (size_t i = 0; i < count; ++i) {
+        WorkSource* victim = sources[(start + i) % count].load(memory_order_acquire);
+        if (victim == nullptr || victim == own) {
+            continue;
+        }
+        if (victim->deque.steal(fd, queuedUs)) {
+            victim->spaceFreed.notifyOne();
+            return true;
+        }
+    }
+    return false;
+}
 
-    ThreadSafeCout() << "[Main] Added FD=" << fd
-                 << " to queue, size=" << jobs.size()
-                 << endl;
+// Worker loop in work-stealing mode; these workers exit only when the pool is destroyed
+void ThreadPool::stealLoop(WorkSource* own) {
+    t_local = { this, own, true };
 
-    jobAvailable.notify_one();
+    while (!stopping.load()) {
+        int fd = -1;
+        uint64_t queuedUs = 0;
 
-    // Dynamic scaling: spawn a new thread if needed
-    if (liveThreads.load() < maxThreads &&
-        jobs.size() > liveThreads.load()) {
+        if (!findJob(own, fd, queuedUs)) {
+            // Park until a job is posted, unless one turned up meanwhile
+            uint32_t key = workPosted.prepareWait();
+            if (stopping.load()) {
+                workPosted.cancelWait();
+                break;
+            }
+            if (!findJob(own, fd, queuedUs)) {
+                workPosted.wait(key);
+                continue;
+            }
+            workPosted.cancelWait();
+        }
 
-        threads.emplace_back(&ThreadPool::threadLoop, this);
-        liveThreads++;
+        // Waited too long in a deque to be worth serving: answer 503 and move on
+        uint64_t nowUs = monotonic_us();
+        uint64_t waitedUs = nowUs - min(nowUs, queuedUs);
+        shedder.record(waitedUs, nowUs);
+        if (shedder.too_late(waitedUs)) {
+            LOG_DEBUG("[Thread {}] shedding FD={} after {} us in a deque", pthread_self(), fd, waitedUs);
+            shed_connection(fd);
+            continue;
+        }
 
-        ThreadSafeCout() << "[Scale] Spawned thread "
-                     << threads.back().get_id()
-                     << " due to load"
-                     << endl;
+        record_phase(RequestPhase::QUEUE, waitedUs);
+        activeThreads++;
+        processJob(fd, waitedUs);
+        activeThreads--;
+        totalRequests++;
+    }
+}
+
+void ThreadPool::enableShedding(uint32_t targetMs) {
+    shedder.configure(targetMs);
+}
+
+void ThreadPool::enableKeepAlive(chrono::seconds idleTimeout) {
+    idle = make_unique<IdleSet>(this, idleTimeout);
+}
+
+// ---- Scaling ----
+
+void ThreadPool::spawnWorker() {
+    auto worker = make_unique<Worker>();
+    liveThreads++;
+    worker->handle = thread(&ThreadPool::threadLoop, this, worker.get());
+    workers.push_back(move(worker));
+}
+
+bool ThreadPool::claimRetirement() {
+    size_t pending = retireRequests.load();
+    while (pending > 0) {
+        if (retireRequests.compare_exchange_weak(pending, pending - 1)) {
+            liveThreads--;
+            return true;
+        }
     }
+    return false;
 }
 
-// Execute a single job
-void ThreadPool::processJob(int fd) {
-    auto start = chrono::high_resolution_clock::now();
+void ThreadPool::reapWorkers() {
+    auto exited = [](const unique_ptr<Worker>& worker) {
+        if (!worker->exited.load(memory_order_acquire)) {
+            return false;
+        }
+        worker->handle.join();
+        return true;
+    };
+    workers.erase(remove_if(workers.begin(), workers.end(), exited), workers.end());
+}
+
+/*
+  Scaler thread: every SCALE_INTERVAL, or sooner when queueJob() sees the
+  spare threads running out, it looks at
+
+  - the mean time jobs waited in the queue since the last look, and
+  - utilization: the share of live threads busy, smoothed over ticks.
 
-    handle_request(fd); // Call existing request handler
+  It grows the pool at once, by half its size, when jobs waited longer
+  than SCALE_UP_WAIT or queued up with every thread busy, and tops it up
+  so SPARE_THREADS stay idle beyond the queued jobs: a burst then finds
+  threads already waiting instead of waiting for them to start. It
+  shrinks only after SCALE_DOWN_TICKS ticks in a row of low utilization
+  with more than the spare threads idle, and then one thread at a time,
+  each asked to exit once the previous one has; the gap between the two
+  conditions keeps it from flapping.
+*/
+void ThreadPool::scaleLoop() {
+    double utilization = 0.0;
+    int calmTicks = 0;
+    uint64_t lastWaitNanos = 0;
+    uint64_t lastWaits = 0;
+    auto nextTick = chrono::steady_clock::now() + SCALE_INTERVAL;
 
-    auto end = chrono::high_resolution_clock::now();
-    auto duration = chrono::duration_cast<chrono::milliseconds>(
-        end - start).count();
+    while (!stopping.load()) {
+        reapWorkers();
 
-    ThreadSafeCout() << "[Thread "
-                 << this_thread::get_id()
-                 << "] completed FD=" << fd
-                 << " in " << duration << " ms"
-                 << endl;
+        size_t live = liveThreads.load();
+        size_t busy = min(activeThreads.load(), live);
+        size_t idle = live - busy;
+        size_t queued = jobs.size();
+
+        uint64_t waitNanos = queueWaitNanos.load();
+        uint64_t waits = queueWaits.load();
+        chrono::nanoseconds meanWait(waits > lastWaits
+            ? (waitNanos - lastWaitNanos) / (waits - lastWaits) : 0);
+
+        // Ticks move the averages; early wake-ups from queueJob() only act
+        bool tick = chrono::steady_clock::now() >= nextTick;
+        if (tick) {
+            lastWaitNanos = waitNanos;
+            lastWaits = waits;
+            utilization = 0.8 * utilization + 0.2 * (live ? double(busy) / double(live) : 1.0);
+            nextTick = chrono::steady_clock::now() + SCALE_INTERVAL;
+        }
+
+        size_t wanted = live;
+        if (meanWait > SCALE_UP_WAIT || (queued > 0 && idle == 0)) {
+            wanted = live + max<size_t>(1, live / 2);
+        }
+        wanted = max(wanted, busy + queued + SPARE_THREADS);
+        wanted = min(max(wanted, minThreads), maxThreads);
+
+        if (wanted > live) {
+            for (size_t i = live; i < wanted; ++i) {
+                spawnWorker();
+            }
+            LOG_INFO("[Scale] {} → {} threads (queued {}, mean wait {} us)",
+                     live, wanted, queued,
+                     chrono::duration_cast<chrono::microseconds>(meanWait).count());
+            calmTicks = 0;
+        } else if (tick && utilization < SCALE_DOWN_UTILIZATION &&
+                   idle > SPARE_THREADS && live > minThreads &&
+                   retireRequests.load() == 0) {
+            if (++calmTicks >= SCALE_DOWN_TICKS) {
+                retireRequests++;
+                LOG_INFO("[Scale] Retiring a thread of {} (utilization {}%)",
+                         live, static_cast<int>(utilization * 100));
+                calmTicks = SCALE_DOWN_TICKS - 1;   // Next retirement one tick later
+            }
+        } else if (tick) {
+            calmTicks = 0;
+        }
 
-    // Close the file descriptor
-    // close_or_die(fd);  // Uncomment if needed
+        uint32_t key = scaleNeeded.prepareWait();
+        if (stopping.load()) {
+            scaleNeeded.cancelWait();
+            break;
+        }
+        scaleNeeded.waitFor(key, max(nextTick - chrono::steady_clock::now(),
+                                     chrono::steady_clock::duration::zero()));
+    }
 }
 
 // Destructor: join all threads
 ThreadPool::~ThreadPool() {
-    for (auto& t : threads) {
-        if (t.joinable())
-            t.join();
+    idle.reset();   // Its poller queues jobs; stop it first
+
+    stopping = true;
+    workPosted.notifyAll();   // Parked work-stealing workers
+    if (scaler.joinable()) {
+        scaleNeeded.notifyOne();
+        scaler.join();
+        retireRequests += liveThreads.load();   // Idle workers notice within RETIRE_CHECK_INTERVAL
+    }
+    for (auto& worker : workers) {
+        if (worker->handle.joinable())
+            worker->handle.join();
+    }
+    for (size_t i = 0; i < min(sourceCount.load(), sourceSlots); ++i) {
+        delete sources[i].load();
     }
 }
 
 // Metrics accessors
 size_t ThreadPool::getQueueSize() {
-    lock_guard<mutex> lock(queueMutex);
+    if (scheduling == Scheduling::WORK_STEALING) {
+        size_t queued = 0;
+        size_t count = min(sourceCount.load(memory_order_acquire), sourceSlots);
+        for (size_t i = 0; i < count; ++i) {
+            WorkSource* source = sources[i].load(memory_order_acquire);
+            if (source != nullptr) {
+                queued += source->deque.size();
+            }
+        }
+        return queued;
+    }
     return jobs.size();
 }
 
@@ -140,3 +442,11 @@ size_t ThreadPool::getTotalRequests() {
 size_t ThreadPool::getLiveThreads() {
     return liveThreads.load();
 }
+
+size_t ThreadPool::getIdleConnections() {
+    return idle ? idle->getParked() : 0;
+}
+
+size_t ThreadPool::getIdleTimeouts() {
+    return idle ? idle->getTimeouts() : 0;
+}
@@ -0,0 +1,171 @@
+#include "JobQueue.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using namespace std;
+
+/*
+  Hand-off latency of the worker pool's job queue.
+
+  Usage: ./queue_bench [-n <jobs>] [-c <consumers>] [-b <capacity>]
+
+  Compares JobQueue against the queue the pool used before it: a
+  std::queue behind one mutex and two condition variables. Latency is
+  measured from just before push() to just after pop() returns the job.
+
+    ping-pong  one job at a time, the next only once the last was taken:
+               every hand-off has to wake a parked consumer
+    burst      the producer pushes as fast as the queue takes jobs:
+               consumers mostly find work waiting
+*/
+
+// ---- The pool's previous queue, kept for comparison ----
+class LockedJobQueue {
+public:
+    explicit LockedJobQueue(size_t capacity) : queueSize(capacity) {}
+
+    void push(int fd) {
+        unique_lock<mutex> lock(queueMutex);
+        spaceAvailable.wait(lock, [this] { return jobs.size() < queueSize; });
+        jobs.push(fd);
+        jobAvailable.notify_one();
+    }
+
+    bool pop(int& fd, chrono::milliseconds timeout) {
+        unique_lock<mutex> lock(queueMutex);
+        if (!jobAvailable.wait_for(lock, timeout, [this] { return !jobs.empty(); })) {
+            return false;
+        }
+        fd = jobs.front();
+        jobs.pop();
+        spaceAvailable.notify_one();
+        return true;
+    }
+
+private:
+    queue<int> jobs;
+    mutex queueMutex;
+    condition_variable jobAvailable;
+    condition_variable spaceAvailable;
+    size_t queueSize;
+};
+
+static int64_t nowNanos() {
+    return chrono::duration_cast<chrono::nanoseconds>(
+        chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct Result {
+    double jobsPerSecond;
+    int64_t p50;
+    int64_t p99;
+    int64_t max;
+};
+
+/*
+  Hand `jobs` job ids to `consumers` threads. With `pingPong`, the
+  producer waits until each job has been taken before sending the next.
+*/
+template <typename Queue>
+static Result run(size_t jobs, size_t consumers, size_t capacity, bool pingPong) {
+    Queue queue(capacity);
+    vector<int64_t> sentAt(jobs);
+    vector<int64_t> latency(jobs);
+    atomic<size_t> taken{0};
+
+    vector<thread> threads;
+    for (size_t i = 0; i < consumers; ++i) {
+        threads.emplace_back([&] {
+            int id;
+            while (true) {
+                if (!queue.pop(id, chrono::milliseconds(1000))) {
+                    continue;
+                }
+                if (id < 0) {
+                    return;
+                }
+                latency[id] = nowNanos() - sentAt[id];
+                taken.fetch_add(1, memory_order_release);
+            }
+        });
+    }
+
+    // Let the consumers reach their wait before the first job
+    this_thread::sleep_for(chrono::milliseconds(50));
+
+    int64_t start = nowNanos();
+    for (size_t id = 0; id < jobs; ++id) {
+        sentAt[id] = nowNanos();
+        queue.push(static_cast<int>(id));
+        if (pingPong) {
+            while (taken.load(memory_order_acquire) <= id) {
+            }
+        }
+    }
+    while (taken.load(memory_order_acquire) < jobs) {
+    }
+    int64_t elapsed = nowNanos() - start;
+
+    for (size_t i = 0; i < consumers; ++i) {
+        queue.push(-1);
+    }
+    for (thread& t : threads) {
+        t.join();
+    }
+
+    sort(latency.begin(), latency.end());
+    return Result{
+        jobs * 1e9 / static_cast<double>(elapsed),
+        latency[jobs / 2],
+        latency[jobs * 99 / 100],
+        latency.back()
+    };
+}
+
+static void report(const char* scenario, const char* queue, const Result& result) {
+    printf("%-10s %-8s %12.0f %10lld %10lld %12lld\n", scenario, queue,
+           result.jobsPerSecond, static_cast<long long>(result.p50),
+           static_cast<long long>(result.p99), static_cast<long long>(result.max));
+}
+
+int main(int argc, char* argv[]) {
+    size_t jobs = 200000;
+    size_t consumers = 4;
+    size_t capacity = 64;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:c:b:")) != -1) {
+        switch (opt) {
+            case 'n': jobs = max<size_t>(1, strtoul(optarg, nullptr, 10)); break;
+            case 'c': consumers = max<size_t>(1, strtoul(optarg, nullptr, 10)); break;
+            case 'b': capacity = max<size_t>(1, strtoul(optarg, nullptr, 10)); break;
+            default:
+                fprintf(stderr, "[Usage] ./queue_bench [-n <jobs>] [-c <consumers>] [-b <capacity>]\n");
+                return 1;
+        }
+    }
+
+    printf("%zu jobs, %zu consumers, capacity %zu\n\n", jobs, consumers, capacity);
+    printf("%-10s %-8s %12s %10s %10s %12s\n",
+           "scenario", "queue", "jobs/s", "p50 ns", "p99 ns", "max ns");
+
+    // Ping-pong waits on every job, so it gets fewer of them
+    size_t pingPongJobs = max<size_t>(1, jobs / 10);
+    report("ping-pong", "locked", run<LockedJobQueue>(pingPongJobs, consumers, capacity, true));
+    report("ping-pong", "lockfree", run<JobQueue>(pingPongJobs, consumers, capacity, true));
+    report("burst", "locked", run<LockedJobQueue>(jobs, consumers, capacity, false));
+    report("burst", "lockfree", run<JobQueue>(jobs, consumers, capacity, false));
+
+    return 0;
+}
@@ -1,7 +1,14 @@
+#include <csignal>
 #include "include/SocketUtils.h"
 #include "include/request.h"
 #include "include/WorkerPool.h"
-#include "include/ThreadSafeCout.h"
+#include "include/CgiWorkerPool.h"
+#include "include/AcceptorPool.h"
+#include "cgi_workers.h"
+#include "file_cache.h"
+#include "response_cache.h"
+#include "logger.h"
+#include "request_metrics.h"
 
 using namespace std;
 
@@ -9,12 +16,32 @@ using namespace std;
   WebServer main entry point
 
   Usage: ./server [-d <basedir>] [-p <port>] [-t <num_threads>] [-b <buffer_size>]
+                  [-l <min_threads>] [-u <max_threads>]
+                  [-c <max_cached_file>] [-m <response_cache_bytes>]
+                  [-W <cgi_path>]... [-n <cgi_workers>] [-s <shared|steal>]
+                  [-L <shed_target_ms>] [-r <acceptors>] [-i <idle_seconds>]
 
   Options:
     -d  Root directory for serving files
     -p  Port number (default: 10000)
-    -t  Number of threads in the pool
+    -t  Number of threads the pool starts with
     -b  Size of the job buffer
+    -l  Fewest threads the pool shrinks to (default: 1)
+    -u  Most threads the pool grows to (default: 16)
+    -c  Largest file (bytes) kept as a rendered response in memory; 0 disables
+    -m  Memory budget (bytes) of the rendered-response cache
+    -W  Run the CGI program at this URL path (e.g. /spin.cgi) as persistent
+        workers instead of once per request; may be repeated
+    -n  Workers per -W program (default: 4)
+    -L  Shed load with a 503 once jobs stand in the queue longer than this
+        many ms, and whenever the queue is full (0, the default, never sheds)
+    -s  How jobs reach the workers: "shared" (default) for one shared queue,
+        "steal" for a deque per queuing thread with idle workers stealing
+    -r  Accept on this many threads, each with its own SO_REUSEPORT listener,
+        serving connections themselves; the pool only takes the overflow
+        (0, the default, accepts on the main thread and queues every connection)
+    -i  Seconds an idle keep-alive connection is kept open, parked off the
+        workers (default: 15; 0 closes every connection after its response)
 */
 
 // Global thread pool pointer
@@ -26,33 +53,101 @@ int main(int argc, char* argv[]) {
     int port = DEFAULT_PORT;
     size_t numThreads = 1;
     size_t bufferSize = 3;
+    size_t minThreads = 1;
+    size_t maxThreads = 16;
+    size_t maxCachedFile = DEFAULT_RESPONSE_CACHE_MAX_FILE;
+    size_t responseCacheBytes = DEFAULT_RESPONSE_CACHE_BUDGET;
+    Scheduling scheduling = Scheduling::SHARED_QUEUE;
+    uint32_t shedTargetMs = 0;
+    size_t numAcceptors = 0;
+    long idleSeconds = 15;
 
     // ---- Parse command-line arguments ----
     int opt;
-    while ((opt = getopt(argc, argv, "d:p:t:b:")) != -1) {
+    while ((opt = getopt(argc, argv, "d:p:t:b:l:u:c:m:W:n:s:L:r:i:")) != -1) {
         switch (opt) {
             case 'd':
                 rootDir = optarg;
-                ThreadSafeCout() << "[Config] Changed root directory to: " << rootDir << endl;
+                LOG_INFO("[Config] Changed root directory to: {}", rootDir);
                 break;
 
             case 'p':
                 port = atoi(optarg);
-                ThreadSafeCout() << "[Config] Changed port to: " << port << endl;
+                LOG_INFO("[Config] Changed port to: {}", port);
                 break;
 
             case 't':
                 numThreads = strtoul(optarg, nullptr, 10);
-                ThreadSafeCout() << "[Config] Using " << numThreads << " threads" << endl;
+                LOG_INFO("[Config] Using {} threads", numThreads);
                 break;
 
             case 'b':
                 bufferSize = strtoul(optarg, nullptr, 10);
-                ThreadSafeCout() << "[Config] Using buffer size: " << bufferSize << endl;
+                LOG_INFO("[Config] Using buffer size: {}", bufferSize);
+                break;
+
+            case 'l':
+                minThreads = max<size_t>(1, strtoul(optarg, nullptr, 10));
+                LOG_INFO("[Config] Pool shrinks to no fewer than {} threads", minThreads);
+                break;
+
+            case 'u':
+                maxThreads = max<size_t>(1, strtoul(optarg, nullptr, 10));
+                LOG_INFO("[Config] Pool grows to at most {} threads", maxThreads);
+                break;
+
+            case 'c':
+                maxCachedFile = strtoul(optarg, nullptr, 10);
+                LOG_INFO("[Config] Response cache file size limit: {} bytes", maxCachedFile);
+                break;
+
+            case 'm':
+                responseCacheBytes = strtoul(optarg, nullptr, 10);
+                LOG_INFO("[Config] Response cache budget: {} bytes", responseCacheBytes);
+                break;
+
+            case 'W':
+                g_cgi_workers.paths.push_back(optarg);
+                LOG_INFO("[Config] Running {} as persistent CGI workers", optarg);
+                break;
+
+            case 'n':
+                g_cgi_workers.workers_per_program = max<size_t>(1, strtoul(optarg, nullptr, 10));
+                LOG_INFO("[Config] CGI workers per program set to {}",
+                         g_cgi_workers.workers_per_program);
+                break;
+
+            case 's':
+                if (string(optarg) == "steal") {
+                    scheduling = Scheduling::WORK_STEALING;
+                } else if (string(optarg) != "shared") {
+                    LOG_ERROR("[Error] Unknown scheduling mode '{}' (use shared or steal)", optarg);
+                    exit(1);
+                }
+                LOG_INFO("[Config] Scheduling mode: {}", optarg);
+                break;
+
+            case 'L':
+                shedTargetMs = static_cast<uint32_t>(strtoul(optarg, nullptr, 10));
+                LOG_INFO("[Config] Shedding load past {} ms of queue wait", shedTargetMs);
+                break;
+
+            case 'r':
+                numAcceptors = strtoul(optarg, nullptr, 10);
+                LOG_INFO("[Config] Accepting on {} SO_REUSEPORT acceptor threads", numAcceptors);
+                break;
+
+            case 'i':
+                idleSeconds = strtol(optarg, nullptr, 10);
+                LOG_INFO("[Config] Keep-alive idle timeout set to {}s", idleSeconds);
                 break;
 
             default:
-                ThreadSafeCout() << "[Usage] ./server [-d basedir] [-p <port>] [-t <num_threads>] [-b <buffer_size>]" << endl;
+                cerr << "[Usage] ./server [-d basedir] [-p <port>] [-t <num_threads>] [-b <buffer_size>]"
+                     << " [-l <min_threads>] [-u <max_threads>]"
+                     << " [-c <max_cached_file>] [-m <response_cache_bytes>]"
+                     << " [-W <cgi_path>]... [-n <cgi_workers>] [-s <shared|steal>]"
+                     << " [-L <shed_target_ms>] [-r <acceptors>] [-i <idle_seconds>]" << endl;
                 exit(1);
         }
     }
@@ -60,21 +155,49 @@ int main(int argc, char* argv[]) {
     // ---- Change working directory ----
     chdir_or_die(rootDir.c_str());
 
+    // ---- A client that resets mid-response must not kill the server ----
+    signal(SIGPIPE, SIG_IGN);
+
+    // ---- Start watching the document root for the file cache ----
+    g_file_cache.start();
+    g_response_cache.configure(maxCachedFile, responseCacheBytes);
+
+    // ---- Start the persistent CGI workers (relative to the document root) ----
+    if (!g_cgi_workers.paths.empty()) {
+        g_cgiWorkers = new CgiWorkerPool();
+        g_cgiWorkers->start();
+    }
+
+    // ---- Initialize thread pool ----
+    g_threadpool = new ThreadPool(numThreads, bufferSize, minThreads, maxThreads, scheduling);
+    if (shedTargetMs > 0) {
+        g_threadpool->enableShedding(shedTargetMs);
+    }
+    if (idleSeconds > 0) {
+        g_threadpool->enableKeepAlive(chrono::seconds(idleSeconds));
+    }
+
+    // ---- Acceptor threads: each listens, accepts and serves on its own ----
+    if (numAcceptors > 0) {
+        g_acceptors = new AcceptorPool(numAcceptors, port, g_threadpool);
+        LOG_INFO("[Server] Listening on port {} with {} acceptors...", port, numAcceptors);
+        g_acceptors->join();
+        return 0;
+    }
+
     // ---- Create listening socket ----
     int listenFd = open_listen_fd_or_die(port);
 
     sockaddr_in_t clientAddr;
     socklen_t clientLen = sizeof(clientAddr);
 
-    // ---- Initialize thread pool ----
-    g_threadpool = new ThreadPool(numThreads, bufferSize);
-
-    ThreadSafeCout() << "[Server] Listening on port " << port << "..." << endl;
+    LOG_INFO("[Server] Listening on port {}...", port);
 
     // ---- Main accept loop ----
     while (true) {
         // Accept next incoming connection
         int connFd = accept_or_die(listenFd, (sockaddr_t*)&clientAddr, &clientLen);
+        record_connection_opened();
 
         // Queue the job in the thread pool
         g_threadpool->queueJob(connFd);
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+#include "WorkerPool.h"
+
+using namespace std;
+
+/*
+  AcceptorPool: acceptor threads that each own a listening socket and
+  serve what they accept themselves (the -r mode).
+
+  - Every acceptor opens its own SO_REUSEPORT listener on the port, so
+    the kernel spreads new connections across them and no single thread
+    or accept queue serializes intake.
+  - An acceptor serves one connection at a time on its own thread, with
+    no hand-off. Connections already waiting in its accept queue when it
+    picks one up are overflow: they go to the ThreadPool, so they do not
+    wait behind a slow request.
+  - Only a connection whose request has already arrived is served inline.
+    One that is still silent is parked in the pool's IdleSet (or queued,
+    without keep-alive), so a client that never sends cannot stall the
+    acceptor and everything behind it in its accept queue.
+  - A keep-alive connection is parked in the pool's IdleSet after its
+    first request, so its later requests are served by the pool too.
+*/
+class AcceptorPool {
+public:
+    AcceptorPool(size_t acceptors, int port, ThreadPool* overflow);
+
+    AcceptorPool(const AcceptorPool&) = delete;
+    AcceptorPool& operator=(const AcceptorPool&) = delete;
+
+    // Wait for the acceptor threads; they run until the process exits
+    void join();
+
+    // ---- Metrics accessors ----
+    size_t getAcceptors();           // Acceptor threads
+    size_t getInlineRequests();      // Connections served by the acceptor that took them
+    size_t getOverflowJobs();        // Connections handed to the ThreadPool
+
+private:
+    void acceptLoop(int listenFd);   // Acceptor thread main loop
+
+    vector<thread> acceptors;
+    ThreadPool* pool;
+
+    atomic<size_t> inlineRequests{0};
+    atomic<size_t> overflowJobs{0};
+};
+
+// Global acceptor pool; nullptr unless -r is given
+extern AcceptorPool* g_acceptors;
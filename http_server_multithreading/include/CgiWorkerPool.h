@@ -0,0 +1,93 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "cgi_workers.h"
+
+using namespace std;
+
+struct CgiWorker;
+
+/*
+  CgiReply: the output of one request in flight on a worker.
+
+  - Filled by the worker's reader thread, drained by the request thread.
+  - next() blocks until a chunk arrives or the reply ends.
+*/
+class CgiReply {
+public:
+    // Wait for the next piece of output; false once the reply has ended
+    bool next(string& chunk);
+
+    // True if the worker died before the reply ended
+    bool failed();
+
+private:
+    friend class CgiWorkerPool;
+
+    CgiWorker* worker = nullptr;
+    uint16_t id = 0;
+
+    mutex replyMutex;
+    condition_variable changed;
+    deque<string> chunks;
+    bool done = false;
+    bool workerFailed = false;
+};
+
+// One persistent worker process
+struct CgiWorker {
+    string path;                 // URL path the worker serves
+    string program;              // Executable, relative to the document root
+    CgiWorkerProcess process;
+
+    // Guards process, replies and nextId, and serializes writes to the socket.
+    // Only the reader thread reads from the socket.
+    mutex workerMutex;
+    unordered_map<uint16_t, shared_ptr<CgiReply>> replies;
+    uint16_t nextId = 1;
+};
+
+/*
+  CgiWorkerPool: persistent workers for the CGI programs named with -W.
+
+  - Each program gets g_cgi_workers.workers_per_program processes, started
+    with the shared CgiWorkerProcess and spoken to over the framed protocol
+    in cgi_protocol.h.
+  - Requests are multiplexed: a request thread sends BEGIN to the worker
+    with the fewest requests in flight, and the worker's reader thread
+    routes its STDOUT and END frames to the matching CgiReply.
+  - When a worker hangs up, its reader thread fails the pending replies,
+    then restarts it as CgiWorkerProcess's back-off allows.
+*/
+class CgiWorkerPool {
+public:
+    // Start the configured workers and one reader thread per worker
+    void start();
+
+    // Run the request on a worker serving `path`; nullptr if none is running
+    shared_ptr<CgiReply> submit(string_view path, const string& query);
+
+    // The request thread is done with the reply
+    void finish(const shared_ptr<CgiReply>& reply);
+
+private:
+    void readerLoop(CgiWorker* worker);      // Reader thread main loop
+    void relayFrames(CgiWorker* worker);     // Route frames until the worker hangs up
+    void failWorker(CgiWorker* worker);      // End pending replies and stop the worker
+
+    vector<unique_ptr<CgiWorker>> workers;
+    vector<thread> readers;
+};
+
+// Global worker pool; nullptr when no program runs as a worker
+extern CgiWorkerPool* g_cgiWorkers;
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+using namespace std;
+
+/*
+  EventCount: lets threads sleep until some lock-free condition may have
+  changed, without a mutex.
+
+  - A waiter calls prepareWait(), checks its condition once more, and then
+    either cancelWait()s or wait()s with the key it got.
+  - A notifier changes the state first and then calls notifyOne(). That
+    makes a system call only while a waiter has no wake-up on its way
+    already, and a waiter that is notified between its check and its
+    wait() does not sleep.
+  - Waits sleep on a futex; spurious wake-ups are possible, so callers
+    check their condition in a loop.
+*/
+class EventCount {
+public:
+    uint32_t prepareWait();
+    void cancelWait();
+
+    // Sleep until notified after prepareWait() returned `key`
+    void wait(uint32_t key);
+
+    // As wait(), but give up after `timeout`
+    void waitFor(uint32_t key, chrono::nanoseconds timeout);
+
+    void notifyOne();
+    void notifyAll();
+
+private:
+    void leave();   // A waiter is done: cancelled, woken or timed out
+
+    alignas(64) atomic<uint32_t> epoch{0};   // Futex word, bumped by each notify
+    atomic<uint64_t> state{0};               // Waiters, and wake-ups sent to them not yet taken
+};
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "timer_wheel.h"
+
+using namespace std;
+
+class ThreadPool;
+
+// Longest the poller sleeps, so it notices new deadlines and shutdown
+constexpr int IDLE_POLL_MS = 1000;
+
+// How soon the poller retries sockets the ThreadPool had no room for
+constexpr int IDLE_RETRY_MS = 1;
+
+/*
+  IdleSet: keep-alive connections parked between requests.
+
+  - A worker that has answered every request a connection sent parks it
+    here instead of waiting on it; no thread is tied to an idle socket.
+    So does one whose next request has only partly arrived: those bytes
+    are kept with it until a worker takes the socket back.
+  - One poller thread watches every parked socket with a one-shot epoll
+    registration. A socket that becomes readable leaves the set and is
+    queued on the ThreadPool like a new connection. The poller never
+    waits for room in the queue: sockets that find it full are kept in
+    order and retried every IDLE_RETRY_MS, so one full queue does not
+    hold up every other parked socket and the idle timeouts.
+  - A socket left idle for the timeout is closed; deadlines sit in a
+    TimerWheel guarded by a mutex, as workers park from any thread.
+*/
+class IdleSet {
+public:
+    IdleSet(ThreadPool* pool, chrono::seconds idleTimeout);
+    ~IdleSet();
+
+    IdleSet(const IdleSet&) = delete;
+    IdleSet& operator=(const IdleSet&) = delete;
+
+    // Hand over a connection with no complete request pending, and the
+    // start of its next request if any; the set owns it now
+    void park(int fd, string partial = string());
+
+    // The bytes parked with fd, for the worker it was queued to; empty if none
+    string takePartial(int fd);
+
+    // ---- Metrics accessors ----
+    size_t getParked();              // Connections idle right now
+    size_t getTimeouts();            // Connections closed for idling too long
+
+private:
+    // One parked socket, indexed by its descriptor
+    struct Parked {
+        int fd;
+        TimerNode timer;
+        string partial;              // Start of a request whose rest is awaited
+
+        explicit Parked(int parkedFd) : fd(parkedFd), timer(this) {}
+    };
+
+    void pollLoop();                 // Poller thread main loop
+    void unpark(int fd);             // Stop watching fd; the caller owns it again
+    void queueReady(int fd);         // Queue a readable socket, or hold it in `ready`
+
+    ThreadPool* pool;
+    chrono::milliseconds timeout;
+    int epollFd;
+
+    mutex parkedMutex;                   // Guards parked and wheel
+    vector<unique_ptr<Parked>> parked;   // Slots reused as descriptors are
+    TimerWheel wheel;
+
+    vector<int> ready;                   // Readable, waiting for queue room; poller only
+
+    thread poller;
+    atomic<bool> stopping{false};
+    atomic<size_t> parkedCount{0};
+    atomic<size_t> timeouts{0};
+};
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+#include "EventCount.h"
+#include "MpmcQueue.h"
+
+using namespace std;
+
+/*
+  JobQueue: bounded hand-off of connections from the accept thread to
+  the worker threads.
+
+  - Jobs pass through a lock-free MpmcQueue; a hand-off takes no lock.
+  - A worker parks on an EventCount only when it finds the queue empty,
+    and a producer only when it finds it full, so the other side makes
+    the wake-up system call only when somebody is actually parked.
+  - size() reads two counters and never blocks.
+  - Each job is stamped when queued, so pop() can report how long it
+    waited.
+*/
+class JobQueue {
+public:
+    explicit JobQueue(size_t capacity);
+
+    JobQueue(const JobQueue&) = delete;
+    JobQueue& operator=(const JobQueue&) = delete;
+
+    // Queue a job, waiting while the queue is full
+    void push(int fd);
+
+    // Queue a job unless the queue is full
+    bool tryPush(int fd);
+
+    // Take a job, waiting up to `timeout` for one; false if none came
+    bool pop(int& fd, chrono::milliseconds timeout);
+
+    // As pop(), also storing how long the job sat in the queue
+    bool pop(int& fd, chrono::milliseconds timeout, chrono::nanoseconds& waited);
+
+    size_t size() const { return ring.size(); }
+
+private:
+    struct QueuedJob {
+        int fd;
+        chrono::steady_clock::time_point queuedAt;
+    };
+
+    MpmcQueue<QueuedJob> ring;
+    EventCount jobPosted;    // Workers park here while the ring is empty
+    EventCount spaceFreed;   // Producers park here while it is full
+};
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+using namespace std;
+
+/*
+  MpmcQueue: bounded lock-free multi-producer multi-consumer ring
+  (Dmitry Vyukov's design).
+
+  - Every cell carries a sequence number saying whose turn it is: a
+    producer at position p may fill the cell once its sequence is p, a
+    consumer may empty it once it is p + 1.
+  - Producers and consumers each claim positions with one CAS on their
+    own counter, so neither side takes a lock or touches the other's
+    cache line to claim.
+  - tryPush() and tryPop() never wait; they report full and empty.
+  - Any capacity works: cells are indexed modulo their count. The ring
+    has at least two cells, since with one a filled cell's sequence
+    (p + 1) is also the next producer's turn and it would be overwritten;
+    a capacity of one is then kept by checking the consumers' counter.
+*/
+template <typename T>
+class MpmcQueue {
+public:
+    explicit MpmcQueue(size_t cap)
+        : capacity(cap > 0 ? cap : 1),
+          cellCount(capacity > 1 ? capacity : 2),
+          cells(new Cell[cellCount])
+    {
+        for (size_t i = 0; i < cellCount; ++i) {
+            cells[i].sequence.store(i, memory_order_relaxed);
+        }
+    }
+
+    MpmcQueue(const MpmcQueue&) = delete;
+    MpmcQueue& operator=(const MpmcQueue&) = delete;
+
+    // Append a value; false if the queue is full
+    bool tryPush(const T& value) {
+        size_t pos = enqueuePos.load(memory_order_relaxed);
+        while (true) {
+            // Signed: `pos` may be stale, with consumers already past it
+            if (cellCount != capacity &&
+                static_cast<intptr_t>(pos - dequeuePos.load(memory_order_acquire)) >=
+                    static_cast<intptr_t>(capacity)) {
+                return false;   // Full at the capacity asked for, short of the spare cell
+            }
+            Cell& cell = cells[pos % cellCount];
+            size_t seq = cell.sequence.load(memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+
+            if (diff == 0) {
+                if (enqueuePos.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) {
+                    cell.value = value;
+                    cell.sequence.store(pos + 1, memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;   // The cell still holds the value from one lap ago
+            } else {
+                pos = enqueuePos.load(memory_order_relaxed);
+            }
+        }
+    }
+
+    // Take the oldest value; false if the queue is empty
+    bool tryPop(T& value) {
+        size_t pos = dequeuePos.load(memory_order_relaxed);
+        while (true) {
+            Cell& cell = cells[pos % cellCount];
+            size_t seq = cell.sequence.load(memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+
+            if (diff == 0) {
+                if (dequeuePos.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) {
+                    value = cell.value;
+                    cell.sequence.store(pos + cellCount, memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;   // Nothing published in this cell yet
+            } else {
+                pos = dequeuePos.load(memory_order_relaxed);
+            }
+        }
+    }
+
+    // Values queued right now; a snapshot, exact only while nobody pushes or pops
+    size_t size() const {
+        size_t head = dequeuePos.load(memory_order_relaxed);
+        size_t tail = enqueuePos.load(memory_order_relaxed);
+        if (tail <= head) {
+            return 0;
+        }
+        return tail - head < capacity ? tail - head : capacity;
+    }
+
+    size_t getCapacity() const { return capacity; }
+
+private:
+    // One cache line per cell, so neighbouring hand-offs do not false-share
+    struct alignas(64) Cell {
+        atomic<size_t> sequence;
+        T value;
+    };
+
+    const size_t capacity;    // Values held at most
+    const size_t cellCount;   // Cells in the ring, never fewer than two
+    unique_ptr<Cell[]> cells;
+
+    alignas(64) atomic<size_t> enqueuePos{0};   // Next position producers claim
+    alignas(64) atomic<size_t> dequeuePos{0};   // Next position consumers claim
+};
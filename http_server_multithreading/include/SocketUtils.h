@@ -7,6 +7,7 @@
 #include <sys/wait.h>
 #include <sys/stat.h>
 #include <sys/mman.h>
+#include <sys/sendfile.h>
 #include <netdb.h>
 #include <fcntl.h>
 #include <cstring>
@@ -22,8 +23,9 @@ using sockaddr_in_t = struct sockaddr_in;
 constexpr int DEFAULT_PORT = 10000;
 constexpr int QUEUE_SIZE   = 1024;
 
-// Open a listening socket on the given port
-int open_listen_fd(int port);
+// Open a listening socket on the given port; with reusePort, several
+// sockets can listen on it and the kernel spreads connections among them
+int open_listen_fd(int port, bool reusePort = false);
 
 // ----- Convenience wrappers (error-checked) -----
 inline int open_listen_fd_or_die(int port) {
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+using namespace std;
+
+/*
+  WorkDeque: bounded Chase-Lev work-stealing deque of job descriptors
+  (with the C11 orderings of Lê et al., "Correct and Efficient
+  Work-Stealing for Weak Memory Models").
+
+  - One owner thread pushes and pops at the bottom, newest first, so the
+    work it queued last runs while its state is still in cache.
+  - Any other thread steals from the top, oldest first. Steals and the
+    owner's pop only contend over the last job, with one CAS.
+  - Fixed capacity: push() reports a full deque instead of growing.
+  - Each job carries the time it was queued, kept beside its fd and
+    published with it, so whoever takes it can tell how long it waited.
+*/
+class WorkDeque {
+public:
+    explicit WorkDeque(size_t cap)
+        : capacity(cap > 0 ? cap : 1),
+          slots(new atomic<int>[capacity]),
+          stamps(new atomic<uint64_t>[capacity])
+    {}
+
+    WorkDeque(const WorkDeque&) = delete;
+    WorkDeque& operator=(const WorkDeque&) = delete;
+
+    // Owner only: add a job queued at queuedUs at the bottom; false if the deque is full
+    bool push(int fd, uint64_t queuedUs) {
+        int64_t b = bottom.load(memory_order_relaxed);
+        int64_t t = top.load(memory_order_acquire);
+        if (b - t >= static_cast<int64_t>(capacity)) {
+            return false;
+        }
+        slot(b).store(fd, memory_order_relaxed);
+        stamp(b).store(queuedUs, memory_order_relaxed);
+        // Publishes the job (and whatever the owner did with the fd) to thieves
+        bottom.store(b + 1, memory_order_release);
+        return true;
+    }
+
+    // Owner only: take the newest job; false if the deque is empty
+    bool pop(int& fd, uint64_t& queuedUs) {
+        int64_t b = bottom.load(memory_order_relaxed) - 1;
+        bottom.store(b, memory_order_relaxed);
+        atomic_thread_fence(memory_order_seq_cst);
+        int64_t t = top.load(memory_order_relaxed);
+
+        if (t > b) {
+            bottom.store(b + 1, memory_order_relaxed);
+            return false;
+        }
+        fd = slot(b).load(memory_order_relaxed);
+        queuedUs = stamp(b).load(memory_order_relaxed);
+        if (t == b) {
+            // Last job: race the thieves for it
+            bool won = top.compare_exchange_strong(t, t + 1, memory_order_seq_cst,
+                                                   memory_order_relaxed);
+            bottom.store(b + 1, memory_order_relaxed);
+            return won;
+        }
+        return true;
+    }
+
+    // Any thread: take the oldest job; false once the deque is empty
+    bool steal(int& fd, uint64_t& queuedUs) {
+        while (true) {
+            int64_t t = top.load(memory_order_acquire);
+            atomic_thread_fence(memory_order_seq_cst);
+            int64_t b = bottom.load(memory_order_acquire);
+            if (t >= b) {
+                return false;
+            }
+            fd = slot(t).load(memory_order_relaxed);
+            queuedUs = stamp(t).load(memory_order_relaxed);
+            if (top.compare_exchange_strong(t, t + 1, memory_order_seq_cst,
+                                            memory_order_relaxed)) {
+                return true;
+            }
+            // Lost the job to the owner or another thief; look again
+        }
+    }
+
+    // Jobs queued right now; a snapshot
+    size_t size() const {
+        int64_t t = top.load(memory_order_relaxed);
+        int64_t b = bottom.load(memory_order_relaxed);
+        return b > t ? static_cast<size_t>(b - t) : 0;
+    }
+
+private:
+    atomic<int>& slot(int64_t index) {
+        return slots[static_cast<size_t>(index) % capacity];
+    }
+
+    atomic<uint64_t>& stamp(int64_t index) {
+        return stamps[static_cast<size_t>(index) % capacity];
+    }
+
+    const size_t capacity;
+    unique_ptr<atomic<int>[]> slots;
+    unique_ptr<atomic<uint64_t>[]> stamps;   // When each slot's job was queued, in monotonic_us()
+
+    alignas(64) atomic<int64_t> top{0};      // Next job thieves take
+    alignas(64) atomic<int64_t> bottom{0};   // Next free slot of the owner
+};
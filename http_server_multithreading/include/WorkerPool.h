@@ -2,59 +2,160 @@
 
 #include <thread>
 #include <vector>
-#include <queue>
-#include <mutex>
-#include <condition_variable>
 #include <atomic>
+#include <chrono>
+#include <memory>
+
+#include "EventCount.h"
+#include "IdleSet.h"
+#include "JobQueue.h"
+#include "WorkDeque.h"
+#include "load_shedder.h"
 
 using namespace std;
 
+// Threads other than the workers that may queue jobs in work-stealing mode
+constexpr size_t MAX_WORK_SOURCES = 64;
+
+// ---- Thread scaling (shared-queue mode) ----
+constexpr chrono::milliseconds SCALE_INTERVAL(100);          // How often the scaler looks
+constexpr chrono::milliseconds SCALE_UP_WAIT(10);            // Mean queue wait that adds threads
+constexpr chrono::milliseconds RETIRE_CHECK_INTERVAL(1000);  // Longest an idle worker sleeps
+constexpr size_t SPARE_THREADS = 2;                          // Idle threads kept warm for a burst
+constexpr double SCALE_DOWN_UTILIZATION = 0.5;               // Busy share below which threads retire
+constexpr int SCALE_DOWN_TICKS = 50;                         // Calm ticks before retiring (5 s)
+
+// How queued jobs reach the workers
+enum class Scheduling {
+    SHARED_QUEUE,    // One lock-free queue that every worker takes from
+    WORK_STEALING    // A deque per queuing thread; idle workers steal
+};
+
+/*
+  WorkSource: a thread's own deque in work-stealing mode, and where its
+  owner parks while the deque is full.
+*/
+struct WorkSource {
+    explicit WorkSource(size_t capacity) : deque(capacity) {}
+
+    WorkDeque deque;
+    EventCount spaceFreed;
+};
+
+// One worker thread; `exited` tells the scaler it can be joined
+struct Worker {
+    thread handle;
+    atomic<bool> exited{false};
+};
+
 /*
   ThreadPool class for managing a pool of worker threads.
 
   - Accepts incoming jobs (file descriptors) and distributes them
-    to worker threads.
-  - Supports dynamic scaling of threads based on load.
+    to worker threads through a lock-free JobQueue.
+  - A scaler thread sizes the pool between minThreads and maxThreads
+    (see scaleLoop()) and joins the threads it retires.
   - Maintains runtime metrics: active threads, live threads, total requests, queue size.
+
+  In work-stealing mode there is no shared queue: every thread that
+  queues jobs (the accept thread, or a worker queuing follow-up work)
+  pushes onto its own WorkDeque of bufferSize jobs, a worker runs its own
+  jobs newest first, and an idle worker steals the oldest job of a random
+  victim. The pool then keeps a fixed set of initialThreads workers,
+  which may exceed maxThreads.
 */
 class ThreadPool {
 public:
     ThreadPool(size_t initialThreads,
                size_t bufferSize,
                size_t minThreads = 1,
-               size_t maxThreads = 16);
+               size_t maxThreads = 16,
+               Scheduling scheduling = Scheduling::SHARED_QUEUE);
 
     ~ThreadPool();
 
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
     // Queue a new job (file descriptor)
     void queueJob(int fd);
 
+    // Queue a job unless that would mean waiting for room; false if the
+    // queue (in steal mode, the caller's deque) is full
+    bool tryQueueJob(int fd);
+
+    // Shed load past this standing queue wait (see LoadShedder); call before
+    // queuing jobs. Then a job that finds the queue full is answered with a
+    // 503 at once instead of blocking the caller.
+    void enableShedding(uint32_t targetMs);
+
+    // Keep connections open between requests, parked in an IdleSet for up to
+    // idleTimeout; call before queuing jobs
+    void enableKeepAlive(chrono::seconds idleTimeout);
+    bool keepsAlive() const { return idle != nullptr; }
+
+    // A connection's requests are answered: park it for its next one, with
+    // the start of that request if it has partly arrived, or close it
+    void releaseConnection(int fd, bool keepAlive, string partial = string());
+
     // ---- Metrics accessors ----
-    size_t getQueueSize();       // Current queue size
+    size_t getQueueSize();       // Current queue size (lock-free read)
     size_t getActiveThreads();   // Threads currently processing jobs
     size_t getTotalRequests();   // Total jobs processed
     size_t getLiveThreads();     // Threads currently alive
+    size_t getIdleConnections(); // Keep-alive connections parked right now
+    size_t getIdleTimeouts();    // Parked connections closed for idling too long
 
 private:
-    void threadLoop();           // Worker thread main loop
-    void processJob(int fd);     // Execute a single job
+    void threadLoop(Worker* self);   // Worker thread main loop
+    void processJob(int fd, uint64_t waitedUs = 0);  // Execute a single job
 
-    // Worker threads
-    vector<thread> threads;
+    // ---- Scaling ----
+    void scaleLoop();                // Scaler thread main loop
+    void spawnWorker();
+    bool claimRetirement();          // True if the calling worker should exit
+    void reapWorkers();              // Join and drop exited workers
+    void wakeScalerIfShort();        // Before queuing a job
 
-    // Job queue
-    queue<int> jobs;
+    // ---- Work-stealing mode ----
+    void stealLoop(WorkSource* own);         // Worker loop
+    void queueLocal(int fd);                 // Push onto the caller's deque
+    WorkSource* localSource();               // The caller's deque, added on first use
+    bool findJob(WorkSource* own, int& fd, uint64_t& queuedUs);  // Own deque first, then steal
+    WorkSource* addSource();
 
-    // Synchronization primitives
-    mutex queueMutex;
-    condition_variable jobAvailable;
-    condition_variable spaceAvailable;
+    // Worker threads; only the constructor, the scaler and the destructor touch this
+    vector<unique_ptr<Worker>> workers;
+
+    // Job queue
+    JobQueue jobs;
 
     // Limits
-    size_t queueSize;
+    size_t bufferSize;
     size_t minThreads;
     size_t maxThreads;
 
+    // Work-stealing state: sources are added, never removed, until the pool dies
+    Scheduling scheduling;
+    size_t sourceSlots = 0;
+    unique_ptr<atomic<WorkSource*>[]> sources;
+    atomic<size_t> sourceCount{0};
+    EventCount workPosted;               // Idle workers park here
+
+    // Scaler state
+    thread scaler;
+    EventCount scaleNeeded;              // The scaler sleeps here between ticks
+    atomic<bool> stopping{false};
+    atomic<size_t> retireRequests{0};    // Workers asked to exit, not yet gone
+    atomic<uint64_t> queueWaitNanos{0};  // Time jobs spent queued, summed
+    atomic<uint64_t> queueWaits{0};      // Jobs counted in queueWaitNanos
+
+    // Load shedding (off unless enabled)
+    LoadShedder shedder;
+
+    // Parked keep-alive connections (none unless enabled)
+    unique_ptr<IdleSet> idle;
+
     // Runtime metrics
     atomic<size_t> liveThreads{0};      // Number of threads currently alive
     atomic<size_t> activeThreads{0};    // Threads actively processing jobs
@@ -2,4 +2,12 @@
 
 #define MAXBUF (8192)
 
-void handle_request(int fd);
\ No newline at end of file
+#include <cstdint>
+#include <string>
+
+// Answer the requests waiting on a connection; true if it should stay open
+// for more. The caller parks or closes it. `partial` holds the start of a
+// request read earlier; on return, that of one whose rest has not arrived
+// yet, to be parked with the connection. queuedUs is how long the
+// connection already waited for a worker, counted in the first request's time.
+bool handle_request(int fd, std::string& partial, uint64_t queuedUs = 0);
\ No newline at end of file
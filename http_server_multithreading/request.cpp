@@ -1,112 +1,197 @@
-#include <sstream>
 #include <cstring>
+#include <cerrno>
+#include <csignal>
 #include <sys/stat.h>
+#include <sys/uio.h>
 #include "include/SocketUtils.h"
-#include "include/ThreadSafeCout.h"
 #include "include/request.h"
 #include "include/WorkerPool.h"
+#include "include/CgiWorkerPool.h"
+#include "include/AcceptorPool.h"
+#include "file_cache.h"
+#include "response_cache.h"
+#include "http_header.h"
+#include "http_parser.h"
+#include "routes.h"
+#include "load_shedder.h"
+#include "request_metrics.h"
+#include "logger.h"
 
 using namespace std;
 
 // Global thread pool (extern)
 extern ThreadPool* g_threadpool;
 
-// ---- Helper: Send HTTP error ----
-static void sendError(int fd, const string& errCode, const string& shortMsg,
-                      const string& longMsg, const string& cause) {
-    ostringstream body, response;
-
-    body << "<!doctype html>\r\n"
-         << "<head>\r\n"
-         << "  <title>WebServer Error</title>\r\n"
-         << "</head>\r\n"
-         << "<body>\r\n"
-         << "  <h2>" << errCode << ": " << shortMsg << "</h2>\r\n"
-         << "  <p>" << longMsg << ": " << cause << "</p>\r\n"
-         << "</body>\r\n"
-         << "</html>\r\n";
-
-    string bodyStr = body.str();
+// ---- Helper: Send header and body with one writev(), resuming after partial writes ----
+static bool sendHeaderAndBody(int fd, const HeaderBuilder& header, const string& body) {
+    struct iovec iov[2];
+    iov[0].iov_base = const_cast<char*>(header.data());
+    iov[0].iov_len  = header.size();
+    iov[1].iov_base = const_cast<char*>(body.data());
+    iov[1].iov_len  = body.size();
+
+    struct iovec* next = iov;
+    int remaining = 2;
+    while (remaining > 0) {
+        ssize_t rc = writev(fd, next, remaining);
+        if (rc < 0 && errno == EINTR)
+            continue;
+        if (rc <= 0)
+            return false;
+        record_bytes_sent(static_cast<uint64_t>(rc));
+
+        size_t written = static_cast<size_t>(rc);
+        while (remaining > 0 && written >= next->iov_len) {
+            written -= next->iov_len;
+            ++next;
+            --remaining;
+        }
+        if (remaining > 0) {
+            next->iov_base = static_cast<char*>(next->iov_base) + written;
+            next->iov_len -= written;
+        }
+    }
+    return true;
+}
 
-    response << "HTTP/1.0 " << errCode << " " << shortMsg << "\r\n"
-             << "Content-Type: text/html\r\n"
-             << "Content-Length: " << bodyStr.length() << "\r\n\r\n";
+// ---- Helper: Connection header announcing whether the connection stays open ----
+static const char* connectionHeader(bool keepAlive) {
+    return keepAlive ? "Connection: keep-alive\r\n" : "Connection: close\r\n";
+}
 
-    string headerStr = response.str();
+// ---- Helper: Send HTTP error; returns whether the connection can take another request ----
+static bool sendError(int fd, int errCode, const string& longMsg, const string& cause,
+                      bool keepAlive = false) {
+    const char* shortMsg = status_reason(errCode);
+
+    string body;
+    body.reserve(256 + longMsg.size() + cause.size());
+    body += "<!doctype html>\r\n"
+            "<head>\r\n"
+            "  <title>WebServer Error</title>\r\n"
+            "</head>\r\n"
+            "<body>\r\n"
+            "  <h2>";
+    append_number(body, static_cast<uint64_t>(errCode));
+    body.append(": ").append(shortMsg).append("</h2>\r\n");
+    body.append("  <p>").append(longMsg).append(": ").append(cause).append("</p>\r\n");
+    body += "</body>\r\n"
+            "</html>\r\n";
+
+    HeaderBuilder header("HTTP/1.1", errCode);
+    header.add_date()
+          .add_raw(connectionHeader(keepAlive))
+          .add("Content-Type", "text/html")
+          .add("Content-Length", body.size())
+          .finish();
+
+    bool sent = sendHeaderAndBody(fd, header, body);
+
+    LOG_DEBUG("[Request FD={}] Sent HTTP error: {} {} (Cause: {})", fd, errCode, shortMsg, cause);
+    return sent && keepAlive;
+}
 
-    send_or_die(fd, headerStr.c_str(), headerStr.length(), 0);
-    send_or_die(fd, bodyStr.c_str(), bodyStr.length(), 0);
+// ---- Helper: Send a whole file with sendfile(), resuming after partial sends ----
+static bool sendFileBody(int fd, int srcFd, size_t fileSize) {
+    off_t offset = 0;
+    while (static_cast<size_t>(offset) < fileSize) {
+        ssize_t sent = sendfile(fd, srcFd, &offset, fileSize - offset);
+        if (sent < 0 && errno == EINTR)
+            continue;
+        if (sent <= 0) {
+            LOG_DEBUG("[Request FD={}] sendfile stopped after {} of {} bytes",
+                      fd, offset, fileSize);
+            return false;
+        }
+        record_bytes_sent(static_cast<uint64_t>(sent));
+    }
+    return true;
+}
 
-    ThreadSafeCout() << "[Request FD=" << fd << "] Sent HTTP error: " << errCode 
-                 << " " << shortMsg << " (Cause: " << cause << ")" << endl;
+// ---- Helper: Send a whole buffer, resuming after partial sends ----
+static bool sendAll(int fd, string_view data, int flags = 0) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t rc = send(fd, data.data() + sent, data.size() - sent, flags | MSG_NOSIGNAL);
+        if (rc < 0 && errno == EINTR)
+            continue;
+        if (rc <= 0)
+            return false;
+        record_bytes_sent(static_cast<uint64_t>(rc));
+        sent += static_cast<size_t>(rc);
+    }
+    return true;
 }
 
-// ---- Helper: Determine content type ----
-static void getFileType(const string& filename, string& fileType) {
-    if (filename.find(".html") != string::npos)
-        fileType = "text/html";
-    else if (filename.find(".gif") != string::npos)
-        fileType = "image/gif";
-    else if (filename.find(".jpg") != string::npos)
-        fileType = "image/jpeg";
-    else
-        fileType = "text/plain";
+// ---- Helper: Send a header block whose body follows separately; false if the client is gone ----
+static bool sendHeader(int fd, const HeaderBuilder& header, int flags) {
+    return sendAll(fd, string_view(header.data(), header.size()), flags);
 }
 
 // ---- Serve static files ----
-static void serveStatic(int fd, const string& filename, int fileSize) {
-    ThreadSafeCout() << "[Request FD=" << fd << "] Serving static file: " << filename
-                 << " (" << fileSize << " bytes)" << endl;
-
-    string fileType;
-    getFileType(filename, fileType);
-
-    int srcFd = open_or_die(filename.c_str(), O_RDONLY, 0);
-    void* srcPtr = mmap_or_die(0, fileSize, PROT_READ, MAP_PRIVATE, srcFd, 0);
-    close_or_die(srcFd);
-
-    ostringstream response;
-    response << "HTTP/1.0 200 OK\r\n"
-             << "Server: WebServer\r\n"
-             << "Content-Length: " << fileSize << "\r\n"
-             << "Content-Type: " << fileType << "\r\n\r\n";
+// Small files are answered from the rendered-response cache with a single send().
+// Otherwise the body goes from the cached descriptor to the socket with sendfile();
+// the header is sent with MSG_MORE so it leaves in the same packet as the first body bytes.
+// Returns whether the connection can take another request.
+static bool serveStatic(int fd, const CachedFile& file, bool keepAlive) {
+    size_t fileSize = static_cast<size_t>(file.size);
+    LOG_DEBUG("[Request FD={}] Serving static file: {} ({} bytes)", fd, file.path, fileSize);
+
+    // One rendering per file and Connection header
+    int variant = keepAlive ? 1 : 0;
+    shared_ptr<const string> cached = g_response_cache.find(file, variant);
+    if (cached) {
+        bool sent = sendAll(fd, *cached);
+        LOG_DEBUG("[Request FD={}] Served from response cache: {}", fd, file.path);
+        return sent && keepAlive;
+    }
 
-    string headerStr = response.str();
+    HeaderBuilder header("HTTP/1.1", 200);
+    header.add("Server", "WebServer")
+          .add_date()
+          .add_raw(connectionHeader(keepAlive))
+          .add("Content-Length", fileSize)
+          .add("Content-Type", file.mime_type)
+          .finish();
+
+    cached = g_response_cache.store(file, variant, string_view(header.data(), header.size()));
+    if (cached) {
+        bool sent = sendAll(fd, *cached);
+        LOG_DEBUG("[Request FD={}] Finished serving: {}", fd, file.path);
+        return sent && keepAlive;
+    }
 
-    send_or_die(fd, headerStr.c_str(), headerStr.length(), 0);
-    send_or_die(fd, static_cast<char*>(srcPtr), fileSize, 0);
-    munmap_or_die(srcPtr, fileSize);
+    bool sent = sendHeader(fd, header, fileSize > 0 ? MSG_MORE : 0) &&
+                sendFileBody(fd, file.fd, fileSize);
 
-    ThreadSafeCout() << "[Request FD=" << fd << "] Finished serving: " << filename << endl;
+    LOG_DEBUG("[Request FD={}] Finished serving: {}", fd, file.path);
+    return sent && keepAlive;
 }
 
-// ---- Serve dynamic CGI ----
-static void serveDynamic(int fd, const string& filename, const string& cgiArgs) {
-    ThreadSafeCout() << "[Request FD=" << fd << "] Running CGI: " << filename 
-                 << " Args: '" << cgiArgs << "'" << endl;
-
-    struct stat sbuf;
-    if (stat(filename.c_str(), &sbuf) < 0) {
-        sendError(fd, "404", "Not Found", "CGI program not found", filename);
-        return;
-    }
-
-    if (!(S_ISREG(sbuf.st_mode)) || !(S_IXUSR & sbuf.st_mode)) {
-        sendError(fd, "403", "Forbidden", "CGI program not executable", filename);
-        return;
-    }
+// ---- Serve dynamic CGI; returns the response status, or 0 if the client left first ----
+// The program's own output goes straight to the socket and is not counted in bytes_sent.
+static int serveDynamic(int fd, const string& filename, const string& cgiArgs) {
+    LOG_DEBUG("[Request FD={}] Running CGI: {} Args: '{}'", fd, filename, cgiArgs);
 
-    char buf[MAXBUF] = "HTTP/1.0 200 OK\r\nServer: WebServer\r\n";
-    send_or_die(fd, buf, strlen(buf), 0);
+    // The CGI program supplies the rest of the header block; the end of its
+    // output is only known when the connection closes
+    HeaderBuilder header("HTTP/1.0", 200);
+    header.add("Server", "WebServer")
+          .add_date()
+          .add_raw(connectionHeader(false));
+    if (!sendHeader(fd, header, 0))
+        return 0;
 
     char* argv[] = { nullptr };
     pid_t pid = fork();
 
     if (pid < 0) {
-        sendError(fd, "500", "Internal Server Error", "Failed to fork", filename);
-        return;
+        sendError(fd, 500, "Failed to fork", filename);
+        return 500;
     } 
     else if (pid == 0) {
+        // The server ignores SIGPIPE; the program gets the usual default
+        signal(SIGPIPE, SIG_DFL);
         setenv_or_die("QUERY_STRING", cgiArgs.c_str(), 1);
         dup2_or_die(fd, STDOUT_FILENO);
         extern char **environ;
@@ -117,104 +202,251 @@ static void serveDynamic(int fd, const string& filename, const string& cgiArgs)
         int status;
         waitpid(pid, &status, 0);
         if (WIFEXITED(status) && WEXITSTATUS(status) == 0)
-            ThreadSafeCout() << "[Request FD=" << fd << "] CGI executed successfully" << endl;
+            LOG_DEBUG("[Request FD={}] CGI executed successfully", fd);
         else
-            ThreadSafeCout() << "[Request FD=" << fd << "] CGI exited with error: " 
-                         << WEXITSTATUS(status) << endl;
+            LOG_WARN("[Request FD={}] CGI exited with error: {}", fd, WEXITSTATUS(status));
     }
+    return 200;
 }
 
-// ---- Parse URI ----
-static bool parseUri(const string& uri, string& filename, string& cgiArgs) {
-    if (uri.find("cgi") == string::npos) {
-        // Static content
-        cgiArgs = "";
-        filename = "." + uri;
-        if (uri.back() == '/')
-            filename += "index.html";
-        ThreadSafeCout() << "[Request] Parsed URI '" << uri << "' as static: " << filename << endl;
-        return true;
-    } else {
-        // Dynamic content
-        size_t qmark = uri.find("?");
-        cgiArgs = (qmark == string::npos) ? "" : uri.substr(qmark + 1);
-        filename = "." + uri;
-        ThreadSafeCout() << "[Request] Parsed URI '" << uri << "' as dynamic: " << filename
-                     << " Args: '" << cgiArgs << "'" << endl;
+// ---- Serve dynamic CGI from a persistent worker ----
+// Returns false if no worker could take the request, so the caller forks instead;
+// otherwise `status` is the response status.
+static bool serveFromWorker(int fd, const string& filename, string_view path, const string& cgiArgs,
+                            int& status) {
+    shared_ptr<CgiReply> reply = g_cgiWorkers->submit(path, cgiArgs);
+    if (!reply)
         return false;
+
+    LOG_DEBUG("[Request FD={}] Running CGI on worker: {} Args: '{}'", fd, filename, cgiArgs);
+
+    // As with a forked program, the worker's output completes the header block
+    bool sentHeader = false;
+    string chunk;
+    while (reply->next(chunk)) {
+        if (!sentHeader) {
+            HeaderBuilder header("HTTP/1.0", 200);
+            header.add("Server", "WebServer")
+                  .add_date()
+                  .add_raw(connectionHeader(false));
+            if (!sendHeader(fd, header, MSG_MORE))
+                break;
+            sentHeader = true;
+        }
+        if (!sendAll(fd, chunk))
+            break;
+    }
+
+    status = 200;
+    if (!sentHeader && reply->failed()) {
+        sendError(fd, 502, "CGI worker failed", filename);
+        status = 502;
     }
+    g_cgiWorkers->finish(reply);
+    return true;
 }
 
-// ---- Serve /metrics ----
-static void serveMetrics(int fd) {
-    ostringstream body;
-    body << "active_threads " << g_threadpool->getActiveThreads() << "\n"
-         << "live_threads "   << g_threadpool->getLiveThreads()   << "\n"
-         << "queue_size "     << g_threadpool->getQueueSize()     << "\n"
-         << "total_requests " << g_threadpool->getTotalRequests() << "\n";
-
-    string bodyStr = body.str();
-    ostringstream response;
-    response << "HTTP/1.1 200 OK\r\n"
-             << "Content-Type: text/plain\r\n"
-             << "Content-Length: " << bodyStr.size() << "\r\n\r\n";
-
-    string header = response.str();
-    send_or_die(fd, header.c_str(), header.size(), 0);
-    send_or_die(fd, bodyStr.c_str(), bodyStr.size(), 0);
+// ---- Map a request path to a file under the document root ----
+static string resolvePath(string_view path) {
+    string filename = "." + string(path);
+    if (path.empty() || path.back() == '/')
+        filename += "index.html";
+    return filename;
 }
 
-// ---- Handle incoming request ----
-void handle_request(int fd) {
-    char buf[MAXBUF];
-    ssize_t bytes = recv(fd, buf, MAXBUF - 1, 0);
-    if (bytes <= 0) {
-        ThreadSafeCout() << "[Request FD=" << fd << "] Failed to receive data" << endl;
-        return;
+// ---- Helper: Share of cache lookups that hit ----
+static double hitRatio(uint64_t hits, uint64_t misses) {
+    return hits + misses > 0 ? double(hits) / double(hits + misses) : 0.0;
+}
+
+// ---- Serve /metrics in Prometheus text format; returns whether the connection can take another request ----
+static bool serveMetrics(int fd, bool keepAlive) {
+    const struct {
+        const char* name;
+        const char* type;
+        uint64_t value;
+    } metrics[] = {
+        { "active_threads",           "gauge",   g_threadpool->getActiveThreads() },
+        { "live_threads",             "gauge",   g_threadpool->getLiveThreads() },
+        { "queue_size",               "gauge",   g_threadpool->getQueueSize() },
+        { "total_requests",           "counter", g_threadpool->getTotalRequests() },
+        { "idle_connections",         "gauge",   g_threadpool->getIdleConnections() },
+        { "idle_timeouts",            "counter", g_threadpool->getIdleTimeouts() },
+        { "acceptor_threads",         "gauge",   g_acceptors ? g_acceptors->getAcceptors() : 0 },
+        { "acceptor_requests",        "counter", g_acceptors ? g_acceptors->getInlineRequests() : 0 },
+        { "acceptor_overflow",        "counter", g_acceptors ? g_acceptors->getOverflowJobs() : 0 },
+        { "file_cache_entries",       "gauge",   g_file_cache.size() },
+        { "file_cache_hits",          "counter", g_file_cache.hits() },
+        { "file_cache_misses",        "counter", g_file_cache.misses() },
+        { "file_cache_invalidations", "counter", g_file_cache.invalidations() },
+        { "file_cache_evictions",     "counter", g_file_cache.evictions() },
+        { "response_cache_bytes",     "gauge",   g_response_cache.bytes_used() },
+        { "response_cache_hits",      "counter", g_response_cache.hits() },
+        { "response_cache_misses",    "counter", g_response_cache.misses() },
+        { "response_cache_evictions", "counter", g_response_cache.evictions() },
+        { "log_records_dropped",      "counter", Logger::dropped() },
+        { "connections_shed_total",   "counter", connections_shed() },
+    };
+
+    string body;
+    for (const auto& metric : metrics) {
+        append_metric(body, metric.name, metric.type, metric.value);
     }
-    buf[bytes] = '\0';
+    append_metric(body, "file_cache_hit_ratio", "gauge",
+                  hitRatio(g_file_cache.hits(), g_file_cache.misses()));
+    append_metric(body, "response_cache_hit_ratio", "gauge",
+                  hitRatio(g_response_cache.hits(), g_response_cache.misses()));
+    append_request_metrics(body);
+
+    HeaderBuilder header("HTTP/1.1", 200);
+    header.add_date()
+          .add_raw(connectionHeader(keepAlive))
+          .add("Content-Type", "text/plain; version=0.0.4")
+          .add("Content-Length", body.size())
+          .finish();
+
+    return sendHeaderAndBody(fd, header, body) && keepAlive;
+}
+
+// ---- Decide whether the connection stays open after a request ----
+// HTTP/1.1 defaults to persistent connections, HTTP/1.0 only on request.
+// A request body is never read, so it would be taken for the next request.
+static bool wantsKeepAlive(const HttpRequest& request) {
+    if (!g_threadpool->keepsAlive() || request.connection_close || request.has_body())
+        return false;
+    return request.minor_version >= 1 || request.connection_keep_alive;
+}
+
+// ---- What a request was and how it was answered, for the latency histograms ----
+struct Outcome {
+    RequestClass kind = RequestClass::REJECTED;
+    int status = 0;
+};
 
-    istringstream reqStream(buf);
-    string method, uri, version;
-    reqStream >> method >> uri >> version;
+// ---- Answer one parsed request; returns whether the connection can take another ----
+static bool serveRequest(int fd, const HttpRequest& request, Outcome& outcome) {
+    string method(request.method), uri(request.target), version(request.version);
 
-    ThreadSafeCout() << "[Request FD=" << fd << "] Received request: Method=" << method
-                 << " URI=" << uri << " Version=" << version << endl;
+    LOG_DEBUG("[Request FD={}] Received request: Method={} URI={} Version={}",
+              fd, method, uri, version);
+
+    bool keepAlive = wantsKeepAlive(request);
 
     if (method != "GET") {
-        sendError(fd, "501", "Not Implemented", "HTTP method not supported", method);
-        return;
+        outcome.status = 501;
+        return sendError(fd, 501, "HTTP method not supported", method, keepAlive);
     }
 
+    Route route = route_request(request.target);
+    outcome.kind = request_class(route.kind);
+    outcome.status = 200;
+
     // Handle /metrics endpoint
-    if (uri == "/metrics") {
-        serveMetrics(fd);
-        close_or_die(fd);
-        ThreadSafeCout() << "[Request FD=" << fd << "] Served /metrics" << endl;
-        return;
+    if (route.kind == RouteKind::METRICS) {
+        LOG_DEBUG("[Request FD={}] Serving /metrics", fd);
+        return serveMetrics(fd, keepAlive);
     }
 
     // --- Handle static or dynamic file ---
-    string filename, cgiArgs;
-    bool isStatic = parseUri(uri, filename, cgiArgs);
+    string filename = resolvePath(route.path);
+    LOG_DEBUG("[Request] Routed URI '{}' to {}{}",
+              uri, route.kind == RouteKind::STATIC ? "static: " : "dynamic: ", filename);
+
+    shared_ptr<const CachedFile> file = g_file_cache.lookup(filename);
+    if (!file) {
+        outcome.status = 404;
+        return sendError(fd, 404, "File not found", filename, keepAlive);
+    }
 
-    struct stat sbuf;
-    if (stat(filename.c_str(), &sbuf) < 0) {
-        sendError(fd, "404", "Not Found", "File not found", filename);
-        return;
+    if (route.kind == RouteKind::STATIC) {
+        if (!(S_ISREG(file->mode)) || !(S_IRUSR & file->mode) || file->fd < 0) {
+            outcome.status = 403;
+            return sendError(fd, 403, "Cannot read file", filename, keepAlive);
+        }
+        return serveStatic(fd, *file, keepAlive);
+    }
+
+    if (!(S_ISREG(file->mode)) || !(S_IXUSR & file->mode)) {
+        outcome.status = 403;
+        return sendError(fd, 403, "Cannot execute CGI", filename, keepAlive);
     }
+    string cgiArgs(route.query);
+    if (!(g_cgiWorkers && g_cgi_workers.serves(route.path) &&
+          serveFromWorker(fd, filename, route.path, cgiArgs, outcome.status)))
+        outcome.status = serveDynamic(fd, filename, cgiArgs);
+    return false;
+}
 
-    if (isStatic) {
-        if (!(S_ISREG(sbuf.st_mode)) || !(S_IRUSR & sbuf.st_mode)) {
-            sendError(fd, "403", "Forbidden", "Cannot read file", filename);
-            return;
+// ---- Entry point: answer the requests a connection has sent ----
+// Pipelined requests already read are answered in turn; the connection is
+// handed back once nothing is left buffered, or a response closes it.
+// A request that has only partly arrived is handed back too, in `partial`,
+// rather than waited for here: with keep-alive the IdleSet waits for the rest.
+// Each request is timed from when the worker starts reading it; the first
+// one also counts the queuedUs the connection waited for the worker.
+bool handle_request(int fd, string& partial, uint64_t queuedUs) {
+    char buf[MAXBUF];
+    size_t length = min(partial.size(), sizeof(buf));
+    bool keepAlive;
+
+    memcpy(buf, partial.data(), length);
+    partial.clear();
+
+    uint64_t readFromUs = monotonic_us();
+    uint64_t startedUs = readFromUs - queuedUs;
+
+    do {
+        HttpParser parser;
+        HttpRequest request;
+
+        // ---- Read until the header block is complete ----
+        ParseStatus status = length > 0 ? parser.parse(buf, length, request)
+                                        : ParseStatus::INCOMPLETE;
+        while (status == ParseStatus::INCOMPLETE) {
+            if (length == MAXBUF) {
+                sendError(fd, 431, "Request header exceeds limit", to_string(MAXBUF) + " bytes");
+                record_request(RequestClass::REJECTED, 431, monotonic_us() - startedUs);
+                return false;
+            }
+            int flags = length > 0 && g_threadpool->keepsAlive() ? MSG_DONTWAIT : 0;
+            ssize_t bytes = recv(fd, buf + length, MAXBUF - length, flags);
+            if (bytes < 0 && errno == EINTR) {
+                continue;
+            }
+            if (bytes < 0 && flags != 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                LOG_DEBUG("[Request FD={}] Parking {} bytes of a partial request", fd, length);
+                partial.assign(buf, length);
+                return true;
+            }
+            if (bytes <= 0) {
+                LOG_DEBUG("[Request FD={}] Failed to receive data", fd);
+                return false;
+            }
+            length += static_cast<size_t>(bytes);
+            status = parser.parse(buf, length, request);
         }
-        serveStatic(fd, filename, sbuf.st_size);
-    } else {
-        if (!(S_ISREG(sbuf.st_mode)) || !(S_IXUSR & sbuf.st_mode)) {
-            sendError(fd, "403", "Forbidden", "Cannot execute CGI", filename);
-            return;
+
+        if (status == ParseStatus::ERROR) {
+            sendError(fd, request.error_status, "Malformed request", "could not parse request head");
+            record_request(RequestClass::REJECTED, request.error_status, monotonic_us() - startedUs);
+            return false;
         }
-        serveDynamic(fd, filename, cgiArgs);
-    }
+
+        uint64_t parsedUs = monotonic_us();
+        record_phase(RequestPhase::READ, parsedUs - readFromUs);
+
+        Outcome outcome;
+        keepAlive = serveRequest(fd, request, outcome);
+
+        uint64_t doneUs = monotonic_us();
+        record_phase(RequestPhase::RESPOND, doneUs - parsedUs);
+        record_request(outcome.kind, outcome.status, doneUs - startedUs);
+        readFromUs = startedUs = doneUs;
+
+        // Whatever follows the header block is the next request
+        length -= request.header_length;
+        memmove(buf, buf + request.header_length, length);
+    } while (keepAlive && length > 0);
+
+    return keepAlive;
 }